@@ -0,0 +1,300 @@
+#pragma once
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// Asynchronous logger behind the LOG_* macros.
+//
+// A message is formatted on the calling thread into a fixed size line (no heap,
+// no lock), pushed to a lock-free multi producer ring and written to the
+// terminal by a background thread. A full ring drops the line and counts it,
+// so a render or present thread never waits for terminal I/O.
+// Levels above CURRENT_LOG_LEVEL compile to nothing, their arguments are not
+// evaluated. Define CURRENT_LOG_LEVEL before the first include to change it.
+//
+//   LOG_INFO("Brightness set to " << (int)value);
+//   LOG_PRINT("frames " << count);     // plain line to stdout, no level prefix
+//   AsyncLog::flush();                 // wait until queued lines are written
+
+// 日志级别定义
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+// 当前日志级别（编译时确定，更高级别的日志不会被编译）
+#ifndef CURRENT_LOG_LEVEL
+#define CURRENT_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define ASYNC_LOG_LINE_SIZE 256     // longer messages are truncated
+#define ASYNC_LOG_CAPACITY 256      // queued lines, power of two
+#define ASYNC_LOG_IDLE_MS 2         // writer thread poll interval when idle
+
+// level of plain LOG_PRINT lines, written to stdout without prefix
+#define LOG_LEVEL_PRINT 0xFF
+
+// 日志宏
+#define LOG_ERROR(msg) do { AsyncLog::Line(LOG_LEVEL_ERROR) << msg; } while (0)
+
+#if CURRENT_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(msg)  do { AsyncLog::Line(LOG_LEVEL_WARN) << msg; } while (0)
+#else
+#define LOG_WARN(msg)  do {} while (0)
+#endif
+
+#if CURRENT_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(msg)  do { AsyncLog::Line(LOG_LEVEL_INFO) << msg; } while (0)
+#else
+#define LOG_INFO(msg)  do {} while (0)
+#endif
+
+#if CURRENT_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(msg) do { AsyncLog::Line(LOG_LEVEL_DEBUG) << msg; } while (0)
+#else
+#define LOG_DEBUG(msg) do {} while (0)
+#endif
+
+#define LOG_PRINT(msg) do { AsyncLog::Line(LOG_LEVEL_PRINT) << msg; } while (0)
+
+namespace AsyncLog
+{
+    static_assert((ASYNC_LOG_CAPACITY & (ASYNC_LOG_CAPACITY - 1)) == 0, "ASYNC_LOG_CAPACITY must be a power of two");
+
+    struct Record
+    {
+        uint8_t level;
+        uint16_t length;
+        char text[ASYNC_LOG_LINE_SIZE];
+    };
+
+    // 'sequence' is stored minus the slot index, so the zero initialized ring is empty
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    struct LogStats
+    {
+        uint64_t written;       // lines written by the background thread
+        uint64_t dropped;       // lines lost because the ring was full
+        uint64_t truncated;     // lines cut at ASYNC_LOG_LINE_SIZE
+        uint32_t max_queued;    // highest ring fill seen by the writer
+    };
+
+    // bounded multi producer / single consumer ring, per slot sequence numbers
+    static Slot slots[ASYNC_LOG_CAPACITY];
+    alignas(64) static std::atomic<size_t> enqueue_pos(0);
+    alignas(64) static std::atomic<size_t> dequeue_pos(0);
+    static std::atomic<uint64_t> dropped(0);
+    static std::atomic<uint64_t> truncated(0);
+    static std::atomic<uint64_t> written(0);
+    static std::atomic<uint32_t> max_queued(0);
+
+    // 0 = not started, 1 = starting, 2 = running, 3 = stopping (writer finishing), 4 = stopped
+    static std::atomic<int> writer_state(0);
+    static std::atomic<bool> stop_requested(false);
+    static std::atomic_flag exit_drain = ATOMIC_FLAG_INIT;
+    static std::thread writer;
+
+    // write every queued line, only called by the owner of the consumer side
+    // return number of lines written
+    inline uint32_t drain() {
+        uint32_t count = 0;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        size_t queued = enqueue_pos.load(std::memory_order_relaxed) - pos;
+        if (queued > max_queued.load(std::memory_order_relaxed)) max_queued.store((uint32_t)queued, std::memory_order_relaxed);
+
+        bool used_out = false, used_err = false;
+        for (;;) {
+            size_t index = pos & (ASYNC_LOG_CAPACITY - 1);
+            Slot& slot = slots[index];
+            if (slot.sequence.load(std::memory_order_acquire) + index != pos + 1) break;
+            const Record& r = slot.record;
+            FILE* out = (r.level == LOG_LEVEL_ERROR) ? stderr : stdout;
+            fwrite(r.text, 1, r.length, out);
+            fputc('\n', out);
+            if (out == stderr) used_err = true;
+            else used_out = true;
+            slot.sequence.store(pos + ASYNC_LOG_CAPACITY - index, std::memory_order_release);
+            pos++;
+            count++;
+        }
+        dequeue_pos.store(pos, std::memory_order_release);
+        // one flush per batch instead of one per line
+        if (used_out) fflush(stdout);
+        if (used_err) fflush(stderr);
+        written.fetch_add(count, std::memory_order_relaxed);
+        return count;
+    }
+
+    inline void writerLoop() {
+        while (!stop_requested.load(std::memory_order_acquire)) {
+            if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(ASYNC_LOG_IDLE_MS));
+        }
+        drain();
+    }
+
+    // write lines queued while the writer was finishing, the logging threads
+    // take the same flag so there is only one consumer
+    inline void exitDrain() {
+        if (exit_drain.test_and_set(std::memory_order_acquire)) return;
+        drain();
+        exit_drain.clear(std::memory_order_release);
+    }
+
+    // stop the writer thread after writing every queued line, registered with atexit
+    // later lines are written directly by the logging thread
+    inline void stop() {
+        int state = 2;
+        if (!writer_state.compare_exchange_strong(state, 3)) return;
+        stop_requested.store(true, std::memory_order_release);
+        if (writer.joinable()) writer.join();
+        // the writer is gone, from here the logging threads drain
+        writer_state.store(4, std::memory_order_release);
+        exitDrain();
+    }
+
+    // started by the first line, the thread creation is the only allocation
+    inline void startWriter() {
+        int state = 0;
+        if (!writer_state.compare_exchange_strong(state, 1)) return;
+        writer = std::thread(writerLoop);
+        atexit(stop);
+        writer_state.store(2, std::memory_order_release);
+    }
+
+    // queue one formatted line, never blocks
+    // return false if the ring was full and the line was dropped
+    inline bool push(const Record& record) {
+        int state = writer_state.load(std::memory_order_acquire);
+        if (state == 0) {
+            startWriter();
+            state = writer_state.load(std::memory_order_acquire);
+        }
+
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        size_t index;
+        Slot* slot;
+        bool retried = false;
+        for (;;) {
+            index = pos & (ASYNC_LOG_CAPACITY - 1);
+            slot = &slots[index];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire) + index;
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                // no writer left to empty a full ring
+                if (state == 4 && !retried) {
+                    exitDrain();
+                    retried = true;
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                    continue;
+                }
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        memcpy(&slot->record, &record, offsetof(Record, text) + record.length);
+        slot->sequence.store(pos + 1 - index, std::memory_order_release);
+
+        // after shutdown the logging thread drains itself, while stopping the
+        // writer still owns the queue and stop() writes what it left
+        if (state == 4) exitDrain();
+        return true;
+    }
+
+    // wait until every line queued before the call is written
+    // for ordering with direct stdout writes (ex. RtProfile::verify(stdout)), not for frame loops
+    inline void flush() {
+        size_t target = enqueue_pos.load(std::memory_order_acquire);
+        int state;
+        while (((state = writer_state.load(std::memory_order_acquire)) == 2 || state == 3) &&
+               dequeue_pos.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    inline LogStats getStats() {
+        LogStats s;
+        s.written = written.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        s.truncated = truncated.load(std::memory_order_relaxed);
+        s.max_queued = max_queued.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // one log line formatted on the stack, queued when the statement ends
+    class Line
+    {
+    public:
+        explicit Line(uint8_t level) : cut(false) {
+            static const char* prefix[] = { "[ERROR] ", "[WARN]  ", "[INFO]  ", "[DEBUG] " };
+            record.level = level;
+            record.length = 0;
+            if (level <= LOG_LEVEL_DEBUG) append(prefix[level], strlen(prefix[level]));
+        }
+
+        ~Line() {
+            if (cut) truncated.fetch_add(1, std::memory_order_relaxed);
+            push(record);
+        }
+
+        Line(const Line&) = delete;
+        Line& operator=(const Line&) = delete;
+
+        Line& operator<<(const char* text) { return append(text ? text : "(null)", text ? strlen(text) : 6); }
+        Line& operator<<(char* text) { return *this << (const char*)text; }
+        Line& operator<<(const std::string& text) { return append(text.data(), text.size()); }
+        Line& operator<<(char c) { return append(&c, 1); }
+        Line& operator<<(bool value) { return format("%d", (int)value); }
+        Line& operator<<(float value) { return format("%g", (double)value); }
+        Line& operator<<(double value) { return format("%g", value); }
+        Line& operator<<(const void* p) { return format("%p", p); }
+
+        // integers like std::ostream, int8_t / uint8_t are characters there too
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value, Line&>::type operator<<(T value) {
+            if (sizeof(T) == 1) return append((const char*)&value, 1);
+            if (std::is_signed<T>::value) return format("%lld", (long long)value);
+            return format("%llu", (unsigned long long)value);
+        }
+
+    private:
+        Line& append(const char* text, size_t length) {
+            size_t room = ASYNC_LOG_LINE_SIZE - record.length;
+            if (length > room) {
+                length = room;
+                cut = true;
+            }
+            memcpy(record.text + record.length, text, length);
+            record.length += (uint16_t)length;
+            return *this;
+        }
+
+        __attribute__((format(printf, 2, 3))) Line& format(const char* fmt, ...) {
+            char buffer[64];
+            va_list args;
+            va_start(args, fmt);
+            int n = vsnprintf(buffer, sizeof(buffer), fmt, args);
+            va_end(args);
+            if (n < 0) return *this;
+            return append(buffer, (size_t)n < sizeof(buffer) ? (size_t)n : sizeof(buffer) - 1);
+        }
+
+        Record record;
+        bool cut;
+    };
+};
@@ -0,0 +1,363 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Sprite.h"
+
+// Sprite atlas: artwork packed offline into one file, drawn straight from the mapping.
+//
+// File layout, little endian:
+//   AtlasHeader
+//   sprites, each ATLAS_ALIGN aligned: row table (height + 1 uint32),
+//     Sprite::Run[run_count], pixel data (premultiplied, Sprite::Image layout)
+//   AtlasEntry[count] at index_offset, sorted by name
+// Sprites are stored in the format Sprite::draw reads, so using the atlas
+// costs an mmap and a check of the index: no image decoding, no
+// premultiplication, no run building at startup. Artwork comes in as PAM
+// (P7, RGB_ALPHA or RGB) or PPM (P6) files; convert PNG with
+// 'convert art.png art.pam' (ImageMagick) or 'pngtopam -alpha'.
+//
+//   Atlas::Writer atlas;
+//   atlas.addImage("tear", "art/tear.pam");
+//   atlas.write("eyes.atlas");
+//   Atlas::Reader art;
+//   art.open("eyes.atlas");
+//   Sprite::View<Color> tear;
+//   if (art.find("tear", tear) == 0) Sprite::draw<Display>(rgb_buffer, tear, x, y);
+//
+// An atlas can also be compiled in ('xxd -i eyes.atlas') and used with
+// Reader::attach. Sprites hold 24 bit pixels, they are drawn over the render
+// buffer before it is packed to the panel format.
+
+#define ATLAS_MAGIC 0x534C5441594C4F44ull     // "DOLYATLS"
+#define ATLAS_VERSION 1
+#define ATLAS_ALIGN 64
+#define ATLAS_NAME_SIZE 32
+
+struct AtlasHeader
+{
+    uint64_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t count;         // sprites
+    uint64_t index_offset;  // AtlasEntry table
+    uint64_t data_bytes;    // sprite bytes, informational
+    uint64_t reserved2[4];
+};
+
+struct AtlasEntry
+{
+    char name[ATLAS_NAME_SIZE];     // zero terminated
+    int16_t width;
+    int16_t height;
+    int16_t origin_x;
+    int16_t origin_y;
+    uint32_t run_count;
+    uint32_t data_size;     // pixel data bytes
+    uint64_t offset;        // row table from file start
+    uint64_t reserved;
+};
+
+static_assert(sizeof(AtlasHeader) == 64 && sizeof(AtlasEntry) == 64 && sizeof(Sprite::Run) == 12, "atlas file layout");
+
+namespace Atlas
+{
+    // read a binary PAM (P7, 8 bit RGB_ALPHA or RGB) or PPM (P6) into 'rgba', 4 bytes per pixel
+    inline bool readImage(const char* path, int& width, int& height, std::vector<uint8_t>& rgba) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        char magic[3] = {};
+        int channels = 0, max_value = 0;
+        width = height = 0;
+        bool ok = fread(magic, 1, 2, f) == 2;
+        if (ok && strcmp(magic, "P6") == 0) {
+            channels = 3;
+            ok = fscanf(f, "%d %d %d", &width, &height, &max_value) == 3 && fgetc(f) != EOF;
+        } else if (ok && strcmp(magic, "P7") == 0) {
+            // header lines until ENDHDR
+            char key[32], value[32];
+            while ((ok = fscanf(f, "%31s", key) == 1)) {
+                if (strcmp(key, "ENDHDR") == 0) break;
+                if (strcmp(key, "TUPLTYPE") == 0) {
+                    ok = fscanf(f, "%31s", value) == 1;
+                    continue;
+                }
+                int number = 0;
+                if (fscanf(f, "%d", &number) != 1) continue;
+                if (strcmp(key, "WIDTH") == 0) width = number;
+                if (strcmp(key, "HEIGHT") == 0) height = number;
+                if (strcmp(key, "DEPTH") == 0) channels = number;
+                if (strcmp(key, "MAXVAL") == 0) max_value = number;
+            }
+            ok = ok && fgetc(f) != EOF;
+        } else {
+            ok = false;
+        }
+        ok = ok && (channels == 3 || channels == 4) && max_value == 255 &&
+             width > 0 && height > 0 && width <= INT16_MAX && height <= INT16_MAX;
+        if (ok) {
+            std::vector<uint8_t> pixels((size_t)width * height * channels);
+            ok = fread(pixels.data(), 1, pixels.size(), f) == pixels.size();
+            rgba.resize((size_t)width * height * 4);
+            for (size_t i = 0; ok && i < (size_t)width * height; i++) {
+                memcpy(&rgba[i * 4], &pixels[i * channels], 3);
+                rgba[i * 4 + 3] = channels == 4 ? pixels[i * channels + 3] : 255;
+            }
+        }
+        fclose(f);
+        return ok;
+    }
+
+    // sprite of 'width' x 'height' RGBA pixels (not premultiplied)
+    inline void buildSprite(Sprite::Image<RenderCore::Color>& image, int width, int height, int origin_x, int origin_y,
+                            const uint8_t* rgba) {
+        Sprite::build(image, width, height, origin_x, origin_y, [&](int x, int y, RenderCore::Color& color) -> uint8_t {
+            const uint8_t* p = rgba + ((size_t)y * width + x) * 4;
+            color = { p[0], p[1], p[2] };
+            return p[3];
+        });
+    }
+
+    class Writer
+    {
+    public:
+        // add a built sprite, a name already added is replaced
+        // return 0 success
+        // return -1 name empty or too long
+        int8_t add(const char* name, const Sprite::Image<RenderCore::Color>& image) {
+            size_t length = strlen(name);
+            if (length == 0 || length >= ATLAS_NAME_SIZE) return -1;
+            for (Item& item : items) {
+                if (item.name == name) {
+                    item.image = image;
+                    return 0;
+                }
+            }
+            items.push_back({ name, image });
+            return 0;
+        }
+
+        // add an image file, placed by its center
+        // return 0 success
+        // return -1 name empty or too long
+        // return -2 image unreadable
+        int8_t addImage(const char* name, const char* path) {
+            int width, height;
+            std::vector<uint8_t> rgba;
+            if (!readImage(path, width, height, rgba)) return -2;
+            Sprite::Image<RenderCore::Color> image;
+            buildSprite(image, width, height, width / 2, height / 2, rgba.data());
+            return add(name, image);
+        }
+
+        uint32_t count() const { return (uint32_t)items.size(); }
+
+        // return >= 0 file bytes
+        // return -1 create / write failed
+        int64_t write(const char* path) {
+            std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.name < b.name; });
+            std::vector<uint8_t> file(sizeof(AtlasHeader));
+            std::vector<AtlasEntry> index;
+            for (const Item& item : items) {
+                const Sprite::Image<RenderCore::Color>& image = item.image;
+                file.resize((file.size() + ATLAS_ALIGN - 1) / ATLAS_ALIGN * ATLAS_ALIGN);
+                AtlasEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                memcpy(entry.name, item.name.c_str(), item.name.size());
+                entry.width = (int16_t)image.width;
+                entry.height = (int16_t)image.height;
+                entry.origin_x = (int16_t)image.origin_x;
+                entry.origin_y = (int16_t)image.origin_y;
+                entry.run_count = (uint32_t)image.runs.size();
+                entry.data_size = (uint32_t)image.data.size();
+                entry.offset = file.size();
+                index.push_back(entry);
+
+                append(file, image.rows.data(), image.rows.size() * sizeof(uint32_t));
+                for (const Sprite::Run& r : image.runs) {
+                    // field by field, the padding is written as zeros
+                    Sprite::Run run;
+                    memset(&run, 0, sizeof(run));
+                    run.x = r.x;
+                    run.length = r.length;
+                    run.kind = r.kind;
+                    run.offset = r.offset;
+                    append(file, &run, sizeof(run));
+                }
+                append(file, image.data.data(), image.data.size());
+            }
+            file.resize((file.size() + ATLAS_ALIGN - 1) / ATLAS_ALIGN * ATLAS_ALIGN);
+
+            AtlasHeader header;
+            memset(&header, 0, sizeof(header));
+            header.magic = ATLAS_MAGIC;
+            header.version = ATLAS_VERSION;
+            header.count = (uint32_t)index.size();
+            header.index_offset = file.size();
+            header.data_bytes = file.size() - sizeof(AtlasHeader);
+            memcpy(file.data(), &header, sizeof(header));
+            append(file, index.data(), index.size() * sizeof(AtlasEntry));
+
+            FILE* f = fopen(path, "wb");
+            if (!f) return -1;
+            bool ok = fwrite(file.data(), 1, file.size(), f) == file.size();
+            ok = fclose(f) == 0 && ok;
+            return ok ? (int64_t)file.size() : -1;
+        }
+
+    private:
+        struct Item
+        {
+            std::string name;
+            Sprite::Image<RenderCore::Color> image;
+        };
+
+        static void append(std::vector<uint8_t>& file, const void* data, size_t size) {
+            const uint8_t* p = (const uint8_t*)data;
+            file.insert(file.end(), p, p + size);
+        }
+
+        std::vector<Item> items;
+    };
+
+    // true if 'entry' lies inside 'size' bytes of 'base' and its runs stay inside the sprite
+    inline bool validEntry(const AtlasEntry& entry, const uint8_t* base, size_t size) {
+        if (entry.name[ATLAS_NAME_SIZE - 1] != 0 || entry.width <= 0 || entry.height <= 0) return false;
+        uint64_t rows_bytes = ((uint64_t)entry.height + 1) * sizeof(uint32_t);
+        uint64_t runs_bytes = (uint64_t)entry.run_count * sizeof(Sprite::Run);
+        if (entry.offset % 4 != 0 || entry.offset > size || rows_bytes + runs_bytes + entry.data_size > size - entry.offset) {
+            return false;
+        }
+        const uint32_t* rows = (const uint32_t*)(base + entry.offset);
+        const Sprite::Run* runs = (const Sprite::Run*)(base + entry.offset + rows_bytes);
+        if (rows[0] != 0 || rows[entry.height] != entry.run_count) return false;
+        for (int y = 0; y < entry.height; y++) {
+            if (rows[y] > rows[y + 1]) return false;
+        }
+        for (uint32_t i = 0; i < entry.run_count; i++) {
+            const Sprite::Run& run = runs[i];
+            uint64_t bytes = (uint64_t)run.length * 3 * (run.kind == Sprite::BLEND ? 2 : 1);
+            if (run.kind > Sprite::BLEND || run.x < 0 || run.x + run.length > entry.width ||
+                run.offset + bytes > entry.data_size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    class Reader
+    {
+    public:
+        Reader() : map(nullptr), map_size(0), mapped(false) {}
+        ~Reader() { close(); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // return 0 success
+        // return -1 open / mmap failed
+        // return -2 not an atlas or damaged
+        int8_t open(const char* path) {
+            close();
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -1;
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                ::close(fd);
+                return -1;
+            }
+            if ((size_t)st.st_size < sizeof(AtlasHeader)) {
+                ::close(fd);
+                return -2;
+            }
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) return -1;
+            if (attach(p, st.st_size) != 0) {
+                munmap(p, st.st_size);
+                return -2;
+            }
+            mapped = true;
+            return 0;
+        }
+
+        // atlas already in memory (compiled in), 'data' 8 byte aligned and kept until close()
+        // return 0 success
+        // return -2 not an atlas or damaged
+        int8_t attach(const void* data, size_t size) {
+            close();
+            const uint8_t* base = (const uint8_t*)data;
+            const AtlasHeader* h = (const AtlasHeader*)base;
+            if (size < sizeof(AtlasHeader) || h->magic != ATLAS_MAGIC || h->version != ATLAS_VERSION ||
+                h->index_offset % 8 != 0 || h->index_offset > size ||
+                (uint64_t)h->count * sizeof(AtlasEntry) > size - h->index_offset) {
+                return -2;
+            }
+            const AtlasEntry* index = (const AtlasEntry*)(base + h->index_offset);
+            for (uint32_t i = 0; i < h->count; i++) {
+                if (!validEntry(index[i], base, size)) return -2;
+                if (i > 0 && strcmp(index[i - 1].name, index[i].name) >= 0) return -2;
+            }
+            map = base;
+            map_size = size;
+            return 0;
+        }
+
+        void close() {
+            if (map && mapped) munmap((void*)map, map_size);
+            map = nullptr;
+            map_size = 0;
+            mapped = false;
+        }
+
+        bool isOpen() const { return map != nullptr; }
+        const AtlasHeader* header() const { return (const AtlasHeader*)map; }
+        uint32_t count() const { return map ? header()->count : 0; }
+
+        const AtlasEntry& entry(uint32_t index) const {
+            return ((const AtlasEntry*)(map + header()->index_offset))[index];
+        }
+
+        // sprite 'index' pointing into the atlas
+        Sprite::View<RenderCore::Color> sprite(uint32_t index) const {
+            const AtlasEntry& e = entry(index);
+            const uint8_t* rows = map + e.offset;
+            const uint8_t* runs = rows + ((size_t)e.height + 1) * sizeof(uint32_t);
+            const uint8_t* data = runs + (size_t)e.run_count * sizeof(Sprite::Run);
+            return { e.width, e.height, e.origin_x, e.origin_y,
+                     (const uint32_t*)rows, (const Sprite::Run*)runs, data };
+        }
+
+        // return 0 found, 'view' set
+        // return -1 no sprite named 'name'
+        int8_t find(const char* name, Sprite::View<RenderCore::Color>& view) const {
+            uint32_t low = 0, high = count();
+            while (low < high) {
+                uint32_t mid = (low + high) / 2;
+                int order = strcmp(entry(mid).name, name);
+                if (order == 0) {
+                    view = sprite(mid);
+                    return 0;
+                }
+                if (order < 0) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            return -1;
+        }
+
+    private:
+        const uint8_t* map;
+        size_t map_size;
+        bool mapped;        // map is ours to unmap
+    };
+};
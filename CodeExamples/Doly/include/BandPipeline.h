@@ -0,0 +1,225 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "SpscQueue.h"
+#include "FrameArena.h"
+#include "RtProfile.h"
+#include "AsyncLog.h"
+#include "RenderCore.h"
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Cache blocked band rendering of display lists.
+//
+// A frame is produced in strips of BAND_PIPELINE_ROWS rows, each strip is
+// resolved into a small 24 bit band buffer, packed into the panel buffer and,
+// when the driver has partial writes (LCD_PARTIAL_WRITE), queued to the
+// presenter thread at once. The band stays in L1 from raster to pack, the full
+// 24 bit frame is never streamed through L2, and the SPI transfer of the first
+// strips overlaps rendering of the later ones.
+// Without partial writes the packed frame is written with writeLcd at the end.
+// With a palette the strip is resolved to 1 byte indices and expanded by the
+// palette lookup while packing (RenderCore::Palette).
+//
+//   BandPipeline::init();
+//   BandPipeline::render<Display>(list, FrameArena::get(LcdLeft));   // returns when the frame is sent
+//   BandPipeline::render<Display>(list, palette, FrameArena::get(LcdLeft));
+//
+// render() is called by one thread at a time (the eye render thread).
+
+#define BAND_PIPELINE_ROWS 16
+#define BAND_PIPELINE_QUEUE 32     // strips in flight, power of two
+
+namespace BandPipeline
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Strip
+    {
+        LcdData* frame;
+        uint16_t first_row;
+        uint16_t rows;
+    };
+
+    struct BandStats
+    {
+        uint32_t frames;
+        uint32_t strips;
+        uint32_t early_strips;  // strips queued before the rest of the frame was rendered
+        uint32_t windows;       // partial writes, consecutive queued strips are merged
+        float avg_render_us;    // raster + pack of one frame
+        float avg_frame_us;     // render() call until the last strip is sent
+    };
+
+    // band buffer, 16 rows of 240 pixels = 11.5 KB (24 bit) or 3.8 KB (indexed)
+    alignas(64) static uint8_t band[BAND_PIPELINE_ROWS * LCD_WIDTH * 3];
+
+    static SpscQueue<Strip, BAND_PIPELINE_QUEUE> strips;
+    static std::mutex band_mutex;
+    static std::condition_variable strip_ready;
+    static std::condition_variable strip_done;
+    static uint32_t queued = 0;         // strips queued, under band_mutex
+    static uint32_t sent = 0;           // strips written by the presenter, under band_mutex
+    static bool quit = false;           // writeLcdRows reported the window closed, under band_mutex
+    static std::thread presenter;
+    static std::atomic<bool> running(false);
+    static BandStats band_stats = {};
+
+    inline void presenterLoop() {
+        RtProfile::enter(RT_PRESENT);
+        Strip carry;
+        bool has_carry = false;
+        for (;;) {
+            Strip strip;
+            uint32_t count = 1;
+            {
+                std::unique_lock<std::mutex> lock(band_mutex);
+                if (has_carry) {
+                    strip = carry;
+                    has_carry = false;
+                } else {
+                    strip_ready.wait(lock, [] { return !strips.empty() || !running.load(); });
+                    if (!strips.pop(strip)) return;     // stopped and drained
+                }
+                // strips rendered while the last window was on the bus go out as one window,
+                // every window costs command overhead
+                while (strips.pop(carry)) {
+                    if (carry.frame != strip.frame || carry.first_row != strip.first_row + strip.rows) {
+                        has_carry = true;
+                        break;
+                    }
+                    strip.rows += carry.rows;
+                    count++;
+                }
+            }
+#ifdef LCD_PARTIAL_WRITE
+            int8_t result = LcdControl::writeLcdRows(strip.frame, strip.first_row, strip.rows);
+            if (result != 0 && result != -3) LOG_ERROR("writeLcdRows failed: " << (int)result);
+#endif
+            std::lock_guard<std::mutex> lock(band_mutex);
+#ifdef LCD_PARTIAL_WRITE
+            // window closed: the render thread exits once this frame is accounted for
+            if (result == -3) quit = true;
+#endif
+            sent += count;
+            band_stats.windows++;
+            strip_done.notify_all();
+        }
+    }
+
+    // start the presenter thread if the driver has partial writes
+    // return 0 success
+    // return 1 already running or no partial writes, render() writes whole frames
+    inline int8_t init() {
+#ifdef LCD_PARTIAL_WRITE
+        if (running.exchange(true)) return 1;
+        presenter = std::thread(presenterLoop);
+        return 0;
+#else
+        return 1;
+#endif
+    }
+
+    inline void release() {
+        if (!running.exchange(false)) return;
+        {
+            std::lock_guard<std::mutex> lock(band_mutex);
+            strip_ready.notify_all();
+        }
+        if (presenter.joinable()) presenter.join();
+    }
+
+    // presenter still running at exit (no release() before exit / return from main)
+    static struct PresenterGuard { ~PresenterGuard() { release(); } } presenter_guard;
+
+    inline bool isActive() {
+        return running.load();
+    }
+
+    // strip loop of render(), 'strip(y, rows)' fills rows y..y + rows - 1 of 'eye.lcd'
+    template <class Spec, class StripFn>
+    void renderStrips(StripFn strip_fn, FrameArena::DisplayBuffers& eye) {
+        static_assert(Spec::WIDTH == LCD_WIDTH && Spec::HEIGHT <= LCD_HEIGHT, "band buffer is sized for the lcd");
+        Clock::time_point begin = Clock::now();
+        bool partial = running.load();
+        uint32_t target = 0;
+        uint32_t frame_strips = 0;
+        uint32_t early = 0;
+
+        for (int y = 0; y < Spec::HEIGHT; y += BAND_PIPELINE_ROWS) {
+            int rows = std::min(BAND_PIPELINE_ROWS, Spec::HEIGHT - y);
+            strip_fn(y, rows);
+            frame_strips++;
+            if (!partial) continue;
+
+            Strip strip = { &eye.frame, (uint16_t)y, (uint16_t)rows };
+            std::unique_lock<std::mutex> lock(band_mutex);
+            // queue full: wait for the presenter, it is behind anyway
+            strip_done.wait(lock, [] { return queued - sent < BAND_PIPELINE_QUEUE - 1; });
+            strips.push(strip);
+            target = ++queued;
+            if (y + rows < Spec::HEIGHT) early++;
+            strip_ready.notify_one();
+        }
+        float render_us = std::chrono::duration<float, std::micro>(Clock::now() - begin).count();
+
+        if (partial) {
+            // eye.lcd is reused by the next frame
+            bool closed;
+            {
+                std::unique_lock<std::mutex> lock(band_mutex);
+                strip_done.wait(lock, [target] { return (int32_t)(sent - target) >= 0; });
+                closed = quit;
+            }
+            // window closed: stop the presenter and exit from this thread, as writeLcd does
+            if (closed) {
+                release();
+                LcdControl::release();
+                exit(0);
+            }
+        } else {
+            int8_t result = LcdControl::writeLcd(&eye.frame);
+            if (result != 0) LOG_ERROR("writeLcd failed: " << (int)result);
+        }
+
+        float frame_us = std::chrono::duration<float, std::micro>(Clock::now() - begin).count();
+        std::lock_guard<std::mutex> lock(band_mutex);
+        band_stats.frames++;
+        band_stats.strips += frame_strips;
+        band_stats.early_strips += early;
+        band_stats.avg_render_us += (render_us - band_stats.avg_render_us) / band_stats.frames;
+        band_stats.avg_frame_us += (frame_us - band_stats.avg_frame_us) / band_stats.frames;
+    }
+
+    // resolve 'list' band by band into 'eye.lcd' and send it, returns when the frame is sent
+    // Spec must match the running LcdControl (Spec::matchesLcd())
+    template <class Spec, class List>
+    void render(const List& list, FrameArena::DisplayBuffers& eye) {
+        renderStrips<Spec>([&](int y, int rows) {
+            list.resolveRows(band, y, rows);
+            Spec::packRows(eye.lcd + y * Spec::LCD_STRIDE, band, rows);
+        }, eye);
+    }
+
+    // same with an indexed band, shape colors are looked up in 'palette'
+    template <class Spec, class List>
+    void render(const List& list, RenderCore::Palette<Spec>& palette, FrameArena::DisplayBuffers& eye) {
+        renderStrips<Spec>([&](int y, int rows) {
+            list.resolveRows(band, y, rows, palette);
+            palette.packRows(eye.lcd + y * Spec::LCD_STRIDE, band, rows);
+        }, eye);
+    }
+
+    inline BandStats getStats() {
+        std::lock_guard<std::mutex> lock(band_mutex);
+        return band_stats;
+    }
+};
@@ -0,0 +1,583 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <map>
+#include <vector>
+#include "FrameRecorder.h"
+#include "RtProfile.h"
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Baked animation clips: panel format frames with timing, played by mmap.
+//
+// File layout, little endian:
+//   ClipHeader
+//   payloads, each CLIP_ALIGN aligned, identical keyframes stored once
+//   ClipFrame[frame_count] at index_offset (8 byte aligned), sorted by time
+// A payload is a keyframe (CLIP_ENCODING_RAW, the panel buffer) or a delta
+// to the previous frame of the same side (CLIP_ENCODING_DELTA): the changed
+// byte ranges of each row, as ClipSpan headers each followed by its bytes.
+// Unchanged runs (zero runs of the xor with the previous frame) are skipped,
+// changed runs carry the new bytes, so decoding is one memcpy per span into
+// the side buffer. Every side starts with a keyframe.
+// A clip is compiled offline from a FrameRecorder recording of the
+// procedural expressions (bakeRecording) or from an image sequence
+// (bakeImages). Keyframes are handed to writeLcd straight from the mapping,
+// deltas are applied to a side buffer by Player right before the write,
+// playback does no rendering and no conversion.
+//
+//   ./lcd_eye_demo --record expressions.frm
+//   Clip::bakeRecording("expressions.frm", "expressions.clip");
+//   Clip::Reader clip;
+//   clip.open("expressions.clip");
+//   Clip::play(clip);
+//
+// Frames are written by the caller of play(), the presenter of a clip.
+
+#define CLIP_MAGIC 0x50494C43594C4F44ull      // "DOLYCLIP"
+#define CLIP_VERSION 1
+#define CLIP_ALIGN 64
+#define CLIP_ENCODING_RAW 0
+#define CLIP_ENCODING_DELTA 1
+#define CLIP_KEYFRAME_INTERVAL 30   // frames per side between keyframes, about one second
+
+struct ClipHeader
+{
+    uint64_t magic;
+    uint16_t version;
+    uint16_t width;
+    uint16_t height;
+    uint8_t depth;          // LcdColorDepth
+    uint8_t reserved;
+    uint32_t frame_size;    // lcd buffer size of one frame
+    uint32_t frame_count;
+    uint32_t duration_ms;   // time of the last frame
+    uint32_t reserved2;
+    uint64_t index_offset;  // ClipFrame table
+    uint64_t data_bytes;    // payload bytes, informational
+    uint64_t reserved3[2];
+};
+
+struct ClipFrame
+{
+    uint64_t offset;        // payload from file start
+    uint32_t size;          // payload bytes
+    uint32_t time_ms;       // presentation time from clip start
+    uint8_t side;
+    uint8_t encoding;       // CLIP_ENCODING_RAW / CLIP_ENCODING_DELTA
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+// delta payload entry, 'length' bytes follow
+struct ClipSpan
+{
+    uint16_t row;
+    uint16_t offset;        // byte in the row
+    uint16_t length;
+};
+
+static_assert(sizeof(ClipHeader) == 64 && sizeof(ClipFrame) == 24 && sizeof(ClipSpan) == 6, "clip file layout");
+
+namespace Clip
+{
+    struct WriterStats
+    {
+        uint32_t frames;
+        uint32_t unique;        // keyframes stored, the rest point to an identical earlier frame
+        uint32_t deltas;        // frames stored as delta
+        uint64_t raw_bytes;     // frames * frame size, the clip without dedup and deltas
+        uint64_t data_bytes;    // payload bytes stored
+        uint64_t bytes;         // file size
+        float ratio;            // raw_bytes / data_bytes
+    };
+
+    // merge changed runs closer than a span header
+    static const int SPAN_GAP = sizeof(ClipSpan);
+
+    // changed ranges of 'frame' against 'previous' into 'out', 'stride' bytes per row
+    // return false if the delta is not smaller than half a frame, the frame is stored as keyframe
+    inline bool encodeDelta(const uint8_t* previous, const uint8_t* frame, uint32_t size, uint32_t stride,
+                            std::vector<uint8_t>& out) {
+        out.clear();
+        for (uint32_t row = 0; row * stride < size; row++) {
+            const uint8_t* a = previous + row * stride;
+            const uint8_t* b = frame + row * stride;
+            if (memcmp(a, b, stride) == 0) continue;
+            uint32_t x = 0;
+            while (x < stride) {
+                while (x < stride && a[x] == b[x]) x++;
+                if (x == stride) break;
+                uint32_t start = x;
+                uint32_t end = x;
+                // extend over equal gaps shorter than a new span would cost
+                while (x < stride) {
+                    if (a[x] != b[x]) {
+                        end = ++x;
+                    } else if (x - end < (uint32_t)SPAN_GAP) {
+                        x++;
+                    } else {
+                        break;
+                    }
+                }
+                ClipSpan span = { (uint16_t)row, (uint16_t)start, (uint16_t)(end - start) };
+                const uint8_t* h = (const uint8_t*)&span;
+                out.insert(out.end(), h, h + sizeof(span));
+                out.insert(out.end(), b + start, b + end);
+                x = end;
+            }
+            if (out.size() * 2 >= size) return false;
+        }
+        return true;
+    }
+
+    // apply a delta payload to 'frame'
+    // return false if a span lies outside the frame
+    inline bool decodeDelta(uint8_t* frame, uint32_t size, uint32_t stride, const uint8_t* delta, uint32_t delta_size) {
+        const uint8_t* p = delta;
+        const uint8_t* end = delta + delta_size;
+        while (end - p >= (ptrdiff_t)sizeof(ClipSpan)) {
+            ClipSpan span;
+            memcpy(&span, p, sizeof(span));
+            p += sizeof(span);
+            size_t at = (size_t)span.row * stride + span.offset;
+            if (span.offset + span.length > stride || at + span.length > size || end - p < span.length) return false;
+            memcpy(frame + at, p, span.length);
+            p += span.length;
+        }
+        return p == end;
+    }
+
+    // clip compiler output, frames must be added in time order
+    class Writer
+    {
+    public:
+        Writer() : fd(-1), offset(0), keyframe_interval(0) {}
+        ~Writer() { if (fd >= 0) ::close(fd); }
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // create 'path' for frames of 'frame_size' bytes at 'depth'
+        // 'keyframe_interval' frames per side from one keyframe to the next, 0 = keyframes only
+        // return 0 success
+        // return -1 open failed
+        // return -2 write failed
+        int8_t open(const char* path, LcdColorDepth depth, uint32_t frame_size,
+                    uint32_t keyframe_interval = CLIP_KEYFRAME_INTERVAL) {
+            if (fd >= 0) ::close(fd);
+            fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) return -1;
+            header = {};
+            header.magic = CLIP_MAGIC;
+            header.version = CLIP_VERSION;
+            header.width = LCD_WIDTH;
+            header.height = LCD_HEIGHT;
+            header.depth = (uint8_t)depth;
+            header.frame_size = frame_size;
+            index.clear();
+            payloads.clear();
+            writer_stats = {};
+            offset = 0;
+            this->keyframe_interval = keyframe_interval;
+            for (uint8_t side = 0; side < 2; side++) {
+                previous[side].clear();
+                since_key[side] = 0;
+            }
+            if (!append(&header, sizeof(header))) return -2;
+            return 0;
+        }
+
+        // return 0 success
+        // return -1 not open or time before the previous frame
+        // return -2 write failed
+        int8_t add(uint8_t side, uint32_t time_ms, const uint8_t* lcd) {
+            if (fd < 0 || (!index.empty() && time_ms < index.back().time_ms)) return -1;
+            ClipFrame frame = {};
+            frame.size = header.frame_size;
+            frame.time_ms = time_ms;
+            frame.side = side;
+            frame.encoding = CLIP_ENCODING_RAW;
+            std::vector<uint8_t>& last = previous[side & 1];
+            bool delta = keyframe_interval > 0 && !last.empty() && since_key[side & 1] < keyframe_interval &&
+                         encodeDelta(last.data(), lcd, header.frame_size, header.frame_size / LCD_HEIGHT, delta_buffer);
+            if (delta) {
+                frame.encoding = CLIP_ENCODING_DELTA;
+                frame.size = (uint32_t)delta_buffer.size();
+                if (!appendPayload(delta_buffer.data(), frame.size, &frame.offset)) return -2;
+                writer_stats.deltas++;
+                since_key[side & 1]++;
+            } else {
+                frame.offset = findPayload(lcd);
+                if (frame.offset == 0) {
+                    if (!appendPayload(lcd, header.frame_size, &frame.offset)) return -2;
+                    payloads[FrameRecorder::hash(lcd, header.frame_size)].push_back(frame.offset);
+                    writer_stats.unique++;
+                }
+                since_key[side & 1] = 1;
+            }
+            if (keyframe_interval > 0) last.assign(lcd, lcd + header.frame_size);
+            index.push_back(frame);
+            writer_stats.frames++;
+            return 0;
+        }
+
+        // write the frame table and the final header, close the file
+        // return 0 success
+        // return -1 not open
+        // return -2 write failed
+        int8_t finish() {
+            if (fd < 0) return -1;
+            static const uint8_t padding[8] = { 0 };
+            if (!append(padding, (8 - offset % 8) % 8)) return -2;
+            header.index_offset = offset;
+            header.frame_count = (uint32_t)index.size();
+            header.duration_ms = index.empty() ? 0 : index.back().time_ms;
+            bool ok = append(index.data(), index.size() * sizeof(ClipFrame)) &&
+                      pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+            writer_stats.bytes = offset;
+            writer_stats.raw_bytes = (uint64_t)writer_stats.frames * header.frame_size;
+            writer_stats.data_bytes = header.data_bytes;
+            writer_stats.ratio = header.data_bytes ? (float)writer_stats.raw_bytes / header.data_bytes : 0.0f;
+            ::close(fd);
+            fd = -1;
+            return ok ? 0 : -2;
+        }
+
+        WriterStats stats() const { return writer_stats; }
+
+    private:
+        bool append(const void* data, size_t size) {
+            const uint8_t* p = (const uint8_t*)data;
+            while (size > 0) {
+                ssize_t n = write(fd, p, size);
+                if (n < 0) return false;
+                p += n;
+                size -= n;
+                offset += n;
+            }
+            return true;
+        }
+
+        bool appendPayload(const uint8_t* data, uint32_t size, uint64_t* at) {
+            static const uint8_t padding[CLIP_ALIGN] = { 0 };
+            if (!append(padding, (CLIP_ALIGN - offset % CLIP_ALIGN) % CLIP_ALIGN)) return false;
+            *at = offset;
+            header.data_bytes += size;
+            return append(data, size);
+        }
+
+        // offset of an identical stored keyframe, 0 = none
+        uint64_t findPayload(const uint8_t* lcd) {
+            auto it = payloads.find(FrameRecorder::hash(lcd, header.frame_size));
+            if (it == payloads.end()) return 0;
+            std::vector<uint8_t> stored(header.frame_size);
+            for (uint64_t candidate : it->second) {
+                if (pread(fd, stored.data(), stored.size(), candidate) == (ssize_t)stored.size() &&
+                    memcmp(stored.data(), lcd, stored.size()) == 0) return candidate;
+            }
+            return 0;
+        }
+
+        int fd;
+        uint64_t offset;
+        ClipHeader header;
+        std::vector<ClipFrame> index;
+        std::map<uint64_t, std::vector<uint64_t>> payloads;    // keyframe hash -> offsets
+        WriterStats writer_stats;
+        uint32_t keyframe_interval;
+        std::vector<uint8_t> previous[2];   // last frame of each side, base of the next delta
+        uint32_t since_key[2];
+        std::vector<uint8_t> delta_buffer;
+    };
+
+    // header of a file of 'file_size' bytes, the index aligned for direct use from the mapping
+    inline bool validHeader(const ClipHeader& h, uint64_t file_size) {
+        return h.magic == CLIP_MAGIC && h.version == CLIP_VERSION && h.width == LCD_WIDTH && h.height == LCD_HEIGHT &&
+               h.frame_size > 0 && h.index_offset % 8 == 0 && h.index_offset <= file_size &&
+               (uint64_t)h.frame_count * sizeof(ClipFrame) <= file_size - h.index_offset;
+    }
+
+    // payloads inside the file, keyframes of full size, every side starting with a keyframe
+    inline bool validIndex(const ClipHeader& h, const ClipFrame* index, uint64_t file_size) {
+        bool has_key[2] = { false, false };
+        for (uint32_t i = 0; i < h.frame_count; i++) {
+            const ClipFrame& f = index[i];
+            bool valid = f.side <= LcdRight && f.offset <= file_size && f.size <= file_size - f.offset &&
+                         ((f.encoding == CLIP_ENCODING_RAW && f.size == h.frame_size) ||
+                          (f.encoding == CLIP_ENCODING_DELTA && f.size <= h.frame_size && has_key[f.side]));
+            if (!valid) return false;
+            if (f.encoding == CLIP_ENCODING_RAW) has_key[f.side] = true;
+        }
+        return true;
+    }
+
+    // mmapped clip
+    class Reader
+    {
+    public:
+        Reader() : map(nullptr), map_size(0) {}
+        ~Reader() { close(); }
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // return 0 success
+        // return -1 open / mmap failed
+        // return -2 not a clip or truncated
+        int8_t open(const char* path) {
+            close();
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -1;
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                ::close(fd);
+                return -1;
+            }
+            if ((size_t)st.st_size < sizeof(ClipHeader)) {
+                ::close(fd);
+                return -2;
+            }
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) return -1;
+            map = (const uint8_t*)p;
+            map_size = st.st_size;
+
+            if (!validHeader(*header(), map_size) ||
+                !validIndex(*header(), (const ClipFrame*)(map + header()->index_offset), map_size)) {
+                close();
+                return -2;
+            }
+            // start reading the payload now, playback should not wait for storage
+            madvise((void*)map, map_size, MADV_WILLNEED);
+            return 0;
+        }
+
+        void close() {
+            if (map) munmap((void*)map, map_size);
+            map = nullptr;
+            map_size = 0;
+        }
+
+        bool isOpen() const { return map != nullptr; }
+        const ClipHeader* header() const { return (const ClipHeader*)map; }
+        uint32_t count() const { return map ? header()->frame_count : 0; }
+
+        const ClipFrame& frame(uint32_t index) const {
+            return ((const ClipFrame*)(map + header()->index_offset))[index];
+        }
+
+        // payload of frame 'index' inside the mapping, the panel buffer of a keyframe
+        const uint8_t* data(uint32_t index) const {
+            return map + frame(index).offset;
+        }
+
+        // true if frames can be written to the running LcdControl
+        bool matchesLcd() const {
+            return map && header()->depth == LcdControl::getColorDepth() &&
+                   header()->frame_size == (uint32_t)LcdControl::getBufferSize();
+        }
+
+    private:
+        const uint8_t* map;
+        size_t map_size;
+    };
+
+    // panel buffers of a clip in play order
+    class Player
+    {
+    public:
+        explicit Player(const Reader& clip) : clip(&clip) {
+            current[0] = current[1] = nullptr;
+            if (clip.isOpen()) resize(clip.header()->frame_size);
+        }
+
+        // player of frames coming from somewhere else than a Reader (Clip::Stream)
+        explicit Player(uint32_t frame_size) : clip(nullptr) {
+            current[0] = current[1] = nullptr;
+            resize(frame_size);
+        }
+
+        // panel buffer of frame 'index', valid until the next frame of the same side
+        // frames of a side are decoded in order from their keyframe, keyframes point into the mapping
+        // return nullptr for a delta without its base frame or with spans outside the frame
+        const uint8_t* decode(uint32_t index) {
+            return decode(clip->frame(index), clip->data(index), true);
+        }
+
+        // same for frame 'f' with its 'payload', 'stable' false if the payload is
+        // reused before the next frame of the side (keyframes are then copied)
+        const uint8_t* decode(const ClipFrame& f, const uint8_t* payload, bool stable) {
+            std::vector<uint8_t>& buffer = buffers[f.side];
+            if (f.encoding == CLIP_ENCODING_RAW) {
+                if (stable) {
+                    current[f.side] = payload;
+                } else {
+                    memcpy(buffer.data(), payload, buffer.size());
+                    current[f.side] = buffer.data();
+                }
+                return current[f.side];
+            }
+            if (!current[f.side]) return nullptr;
+            // first delta after a mapped keyframe: copy the keyframe once, later deltas apply in place
+            if (current[f.side] != buffer.data()) memcpy(buffer.data(), current[f.side], buffer.size());
+            current[f.side] = nullptr;
+            uint32_t size = (uint32_t)buffer.size();
+            if (!decodeDelta(buffer.data(), size, size / LCD_HEIGHT, payload, f.size)) return nullptr;
+            current[f.side] = buffer.data();
+            return current[f.side];
+        }
+
+        // start over from the first frame
+        void rewind() {
+            current[0] = current[1] = nullptr;
+        }
+
+    private:
+        void resize(uint32_t frame_size) {
+            buffers[0].resize(frame_size);
+            buffers[1].resize(frame_size);
+        }
+
+        const Reader* clip;
+        std::vector<uint8_t> buffers[2];
+        const uint8_t* current[2];
+    };
+
+    struct PlayStats
+    {
+        uint32_t frames;
+        uint32_t late;          // frames written more than one millisecond after their time
+        float max_late_ms;
+        float avg_write_us;     // writeLcd call per frame
+        float avg_decode_us;    // delta decode per frame, keyframes cost nothing
+    };
+
+    // write every frame of 'clip' at its time, 'realtime' false writes as fast as possible
+    // with RtProfile the waits are measured as RT_PRESENT wakeups
+    // return >= 0 frames written
+    // return -1 clip not open
+    // return -2 lcd depth or buffer size differs from the clip
+    // return -3 writeLcd failed
+    // return -4 corrupt delta
+    inline int32_t play(const Reader& clip, bool realtime = true, PlayStats* stats = nullptr) {
+        typedef std::chrono::steady_clock Clock;
+        if (!clip.isOpen()) return -1;
+        if (!clip.matchesLcd()) return -2;
+        PlayStats s = {};
+        Player player(clip);
+        Clock::time_point origin = Clock::now();
+        for (uint32_t i = 0; i < clip.count(); i++) {
+            const ClipFrame& f = clip.frame(i);
+            Clock::time_point due = origin + std::chrono::milliseconds(f.time_ms);
+            if (realtime) RtProfile::sleepUntil(RT_PRESENT, due);
+            Clock::time_point begin = Clock::now();
+            float late_ms = std::chrono::duration<float, std::milli>(begin - due).count();
+            if (realtime && late_ms > 1.0f) s.late++;
+            if (realtime && late_ms > s.max_late_ms) s.max_late_ms = late_ms;
+
+            const uint8_t* lcd = player.decode(i);
+            Clock::time_point decoded = Clock::now();
+            if (!lcd) {
+                if (stats) *stats = s;
+                return -4;
+            }
+            LcdData frame = { f.side, (uint8_t*)lcd };
+            if (LcdControl::writeLcd(&frame) != 0) {
+                if (stats) *stats = s;
+                return -3;
+            }
+            float decode_us = std::chrono::duration<float, std::micro>(decoded - begin).count();
+            float write_us = std::chrono::duration<float, std::micro>(Clock::now() - decoded).count();
+            s.frames++;
+            s.avg_decode_us += (decode_us - s.avg_decode_us) / s.frames;
+            s.avg_write_us += (write_us - s.avg_write_us) / s.frames;
+        }
+        if (stats) *stats = s;
+        return (int32_t)s.frames;
+    }
+
+    // compile frames recorded with FrameRecorder between 'from_ms' and 'to_ms' (0 = end) into a clip
+    // return >= 0 frames in the clip
+    // return -1 recording open failed
+    // return -2 clip write failed
+    // return -3 recording mixes color depths or is empty in the range
+    // 'keyframe_interval' see Writer::open
+    inline int32_t bakeRecording(const char* recording_path, const char* clip_path,
+                                 uint32_t from_ms = 0, uint32_t to_ms = 0, WriterStats* stats = nullptr,
+                                 uint32_t keyframe_interval = CLIP_KEYFRAME_INTERVAL) {
+        FrameReplay::Recording recording;
+        if (recording.open(recording_path) != 0) return -1;
+        Writer writer;
+        bool opened = false;
+        LcdColorDepth depth = LCD_12BIT;
+        uint32_t size = 0;
+        for (size_t i = 0; i < recording.count(); i++) {
+            const FrameReplay::Frame& f = recording[i];
+            uint64_t ms = f.time_ns / 1000000;
+            if (ms < from_ms || (to_ms > 0 && ms > to_ms)) continue;
+            if (!opened) {
+                depth = f.depth;
+                size = f.size;
+                if (writer.open(clip_path, depth, size, keyframe_interval) != 0) return -2;
+                opened = true;
+            } else if (f.depth != depth || f.size != size) {
+                return -3;
+            }
+            if (writer.add(f.side, (uint32_t)(ms - from_ms), f.data) != 0) return -2;
+        }
+        if (!opened) return -3;
+        if (writer.finish() != 0) return -2;
+        if (stats) *stats = writer.stats();
+        return (int32_t)writer.stats().frames;
+    }
+
+    // read a binary PPM (P6, 8 bit) of LCD_WIDTH x LCD_HEIGHT into 'rgb'
+    inline bool readPpm(const char* path, uint8_t* rgb) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return false;
+        int width = 0, height = 0, max_value = 0;
+        bool ok = fscanf(f, "P6 %d %d %d", &width, &height, &max_value) == 3 && fgetc(f) != EOF &&
+                  width == LCD_WIDTH && height == LCD_HEIGHT && max_value == 255 &&
+                  fread(rgb, 1, LCD_WIDTH * LCD_HEIGHT * 3, f) == LCD_WIDTH * LCD_HEIGHT * 3;
+        fclose(f);
+        return ok;
+    }
+
+    // compile an image sequence, 'pattern' is a printf pattern of the frame number (ex. "blink_%03d.ppm")
+    // starting at 'first' until a file is missing, every image goes to both displays 'frame_ms' apart
+    // images are converted with LcdControl::LcdBufferFrom24Bit, call after LcdControl::init
+    // return >= 0 images in the clip
+    // return -1 no image found
+    // return -2 clip write failed
+    inline int32_t bakeImages(const char* pattern, int first, uint32_t frame_ms, const char* clip_path,
+                              WriterStats* stats = nullptr) {
+        std::vector<uint8_t> rgb(LCD_WIDTH * LCD_HEIGHT * 3);
+        std::vector<uint8_t> lcd(LcdControl::getBufferSize());
+        Writer writer;
+        int32_t images = 0;
+        char path[512];
+        for (int n = first;; n++) {
+            snprintf(path, sizeof(path), pattern, n);
+            if (!readPpm(path, rgb.data())) break;
+            if (images == 0 && writer.open(clip_path, LcdControl::getColorDepth(), (uint32_t)lcd.size()) != 0) return -2;
+            LcdControl::LcdBufferFrom24Bit(lcd.data(), rgb.data());
+            uint32_t time_ms = (uint32_t)images * frame_ms;
+            if (writer.add(LcdLeft, time_ms, lcd.data()) != 0 || writer.add(LcdRight, time_ms, lcd.data()) != 0) return -2;
+            images++;
+        }
+        if (images == 0) return -1;
+        if (writer.finish() != 0) return -2;
+        if (stats) *stats = writer.stats();
+        return images;
+    }
+};
@@ -0,0 +1,344 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Clip.h"
+#include "SpscQueue.h"
+#include "RtProfile.h"
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Streaming clip playback for clips larger than memory should hold.
+//
+// Instead of mapping the whole file, a background I/O thread reads payloads in
+// play order into a small pool of CLIP_STREAM_SLOTS buffers and queues them to
+// the presenter. The kernel is told the access pattern (POSIX_FADV_SEQUENTIAL)
+// and asked to read CLIP_STREAM_READAHEAD bytes ahead of the I/O thread
+// (POSIX_FADV_WILLNEED), pages already played are dropped (POSIX_FADV_DONTNEED)
+// unless the clip loops. The presenter only pops filled buffers and pushes
+// them back, it never waits for storage unless the pool runs empty, which is
+// counted as an underrun.
+//
+//   Clip::Stream stream;
+//   stream.open("expressions.clip", true);     // loop
+//   Clip::playStream(stream);     // until stream.stop() from another thread
+//
+// Header and frame table are read by open(), payloads only by the I/O thread.
+
+#define CLIP_STREAM_SLOTS 8                 // payload buffers, power of two
+#define CLIP_STREAM_READAHEAD (1 << 20)     // bytes hinted ahead of the read position
+
+namespace Clip
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct StreamStats
+    {
+        uint32_t frames_read;
+        uint64_t bytes_read;
+        float avg_read_us;      // pread of one payload
+        uint32_t underruns;     // frames the presenter had to wait for
+        float max_stall_ms;     // longest of those waits
+        uint32_t ready;         // frames buffered now
+    };
+
+    class Stream
+    {
+    public:
+        struct Slot
+        {
+            uint32_t index;         // frame in the clip
+            uint64_t time_ms;       // presentation time, continues across loops
+            ClipFrame frame;
+            const uint8_t* data;    // payload, valid until release()
+            uint32_t buffer;
+        };
+
+        Stream() : fd(-1), pool(nullptr), pool_bytes(0), slot_stride(0), loop(false), loop_ms(0),
+                   running(false), ended(false), failed(false), stream_stats() {}
+        ~Stream() { close(); }
+        Stream(const Stream&) = delete;
+        Stream& operator=(const Stream&) = delete;
+
+        // read header and frame table of 'path' and start the I/O thread, 'loop' restarts at the end
+        // return 0 success
+        // return -1 open, read or allocation failed
+        // return -2 not a clip or truncated
+        int8_t open(const char* path, bool loop = false) {
+            close();
+            fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -1;
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                close();
+                return -1;
+            }
+            if ((size_t)st.st_size < sizeof(clip_header) ||
+                pread(fd, &clip_header, sizeof(clip_header), 0) != (ssize_t)sizeof(clip_header) ||
+                !validHeader(clip_header, st.st_size)) {
+                close();
+                return -2;
+            }
+            index.resize(clip_header.frame_count);
+            size_t index_bytes = index.size() * sizeof(ClipFrame);
+            if (pread(fd, index.data(), index_bytes, clip_header.index_offset) != (ssize_t)index_bytes) {
+                close();
+                return -1;
+            }
+            if (!validIndex(clip_header, index.data(), st.st_size)) {
+                close();
+                return -2;
+            }
+
+            // pool of page aligned, pre-faulted payload buffers
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            slot_stride = (clip_header.frame_size + page - 1) / page * page;
+            pool_bytes = slot_stride * CLIP_STREAM_SLOTS;
+            void* p = mmap(nullptr, pool_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+            if (p == MAP_FAILED) {
+                close();
+                return -1;
+            }
+            pool = (uint8_t*)p;
+            memset(pool, 0, pool_bytes);
+            mlock(pool, pool_bytes);
+
+            // a loop restarts one frame step after the last frame
+            this->loop = loop;
+            loop_ms = clip_header.duration_ms;
+            for (const ClipFrame& f : index) {
+                if (f.time_ms > 0) {
+                    loop_ms += f.time_ms;
+                    break;
+                }
+            }
+
+            Slot slot;
+            while (filled.pop(slot)) {}
+            uint32_t buffer;
+            while (free_buffers.pop(buffer)) {}
+            for (uint32_t i = 0; i < CLIP_STREAM_SLOTS; i++) free_buffers.push(i);
+            stream_stats = {};
+            ended = false;
+            failed = false;
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            running = true;
+            io_thread = std::thread(&Stream::ioLoop, this);
+            return 0;
+        }
+
+        // end playback from any thread, next() returns -1 from now on
+        void stop() {
+            running = false;
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            buffer_free.notify_all();
+            frame_ready.notify_all();
+        }
+
+        // stop the I/O thread and free the pool, not while playStream() runs
+        void close() {
+            stop();
+            if (io_thread.joinable()) io_thread.join();
+            if (pool) {
+                munlock(pool, pool_bytes);
+                munmap(pool, pool_bytes);
+            }
+            pool = nullptr;
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+
+        bool isOpen() const { return pool != nullptr; }
+        const ClipHeader& header() const { return clip_header; }
+
+        // true if frames can be written to the running LcdControl
+        bool matchesLcd() const {
+            return isOpen() && clip_header.depth == LcdControl::getColorDepth() &&
+                   clip_header.frame_size == (uint32_t)LcdControl::getBufferSize();
+        }
+
+        // presenter side: next frame in play order, waits only if no frame is buffered
+        // return 0 'slot' filled
+        // return 1 'slot' filled after an underrun
+        // return -1 end of clip
+        // return -2 read failed
+        int8_t next(Slot& slot) {
+            if (!running) return -1;
+            if (filled.pop(slot)) return 0;
+            Clock::time_point begin = Clock::now();
+            std::unique_lock<std::mutex> lock(stream_mutex);
+            frame_ready.wait(lock, [&] { return !filled.empty() || ended || failed || !running; });
+            if (!filled.pop(slot)) return failed ? -2 : -1;
+            float stall_ms = std::chrono::duration<float, std::milli>(Clock::now() - begin).count();
+            stream_stats.underruns++;
+            if (stall_ms > stream_stats.max_stall_ms) stream_stats.max_stall_ms = stall_ms;
+            return 1;
+        }
+
+        // presenter side: hand the buffer of 'slot' back after the frame was written
+        void release(const Slot& slot) {
+            free_buffers.push(slot.buffer);
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            buffer_free.notify_one();
+        }
+
+        StreamStats getStats() {
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            StreamStats s = stream_stats;
+            s.ready = (uint32_t)filled.size();
+            return s;
+        }
+
+    private:
+        void ioLoop() {
+            uint32_t i = 0;
+            uint64_t cycle_ms = 0;
+            uint64_t hinted = 0;        // WILLNEED issued up to this offset
+            uint64_t dropped = 0;       // DONTNEED issued below this offset
+            while (running) {
+                if (i == index.size()) {
+                    if (!loop || index.empty()) break;
+                    i = 0;
+                    cycle_ms += loop_ms;
+                    hinted = 0;
+                }
+                uint32_t buffer;
+                {
+                    std::unique_lock<std::mutex> lock(stream_mutex);
+                    buffer_free.wait(lock, [&] { return !free_buffers.empty() || !running; });
+                    if (!free_buffers.pop(buffer)) break;
+                }
+
+                const ClipFrame& f = index[i];
+                if (f.offset + f.size + CLIP_STREAM_READAHEAD / 2 > hinted) {
+                    posix_fadvise(fd, f.offset, CLIP_STREAM_READAHEAD, POSIX_FADV_WILLNEED);
+                    hinted = f.offset + CLIP_STREAM_READAHEAD;
+                }
+                Clock::time_point begin = Clock::now();
+                uint8_t* data = pool + (size_t)buffer * slot_stride;
+                if (!readAll(data, f.size, f.offset)) {
+                    std::lock_guard<std::mutex> lock(stream_mutex);
+                    failed = true;
+                    frame_ready.notify_all();
+                    return;
+                }
+                float read_us = std::chrono::duration<float, std::micro>(Clock::now() - begin).count();
+                // played pages are not needed again, keep the page cache to the readahead window
+                if (!loop && f.offset > dropped + CLIP_STREAM_READAHEAD) {
+                    posix_fadvise(fd, dropped, f.offset - dropped, POSIX_FADV_DONTNEED);
+                    dropped = f.offset;
+                }
+
+                Slot slot = { i, cycle_ms + f.time_ms, f, data, buffer };
+                std::lock_guard<std::mutex> lock(stream_mutex);
+                filled.push(slot);
+                stream_stats.frames_read++;
+                stream_stats.bytes_read += f.size;
+                stream_stats.avg_read_us += (read_us - stream_stats.avg_read_us) / stream_stats.frames_read;
+                frame_ready.notify_one();
+                i++;
+            }
+            std::lock_guard<std::mutex> lock(stream_mutex);
+            ended = true;
+            frame_ready.notify_all();
+        }
+
+        bool readAll(uint8_t* data, size_t size, uint64_t offset) {
+            while (size > 0) {
+                ssize_t n = pread(fd, data, size, offset);
+                if (n <= 0) return false;
+                data += n;
+                size -= n;
+                offset += n;
+            }
+            return true;
+        }
+
+        int fd;
+        ClipHeader clip_header;
+        std::vector<ClipFrame> index;
+        uint8_t* pool;
+        size_t pool_bytes;
+        size_t slot_stride;
+        bool loop;
+        uint64_t loop_ms;               // clip period when looping
+
+        // one slot more than buffers, SpscQueue keeps one slot free
+        SpscQueue<Slot, CLIP_STREAM_SLOTS * 2> filled;              // I/O thread -> presenter
+        SpscQueue<uint32_t, CLIP_STREAM_SLOTS * 2> free_buffers;    // presenter -> I/O thread
+        std::mutex stream_mutex;
+        std::condition_variable frame_ready;
+        std::condition_variable buffer_free;
+        std::thread io_thread;
+        std::atomic<bool> running;
+        bool ended;                     // under stream_mutex
+        bool failed;                    // under stream_mutex
+        StreamStats stream_stats;       // under stream_mutex
+    };
+
+    // write every frame of 'stream' at its time, like play() but payloads come from the I/O thread
+    // with 'realtime' false frames are written as fast as they are read
+    // return >= 0 frames written
+    // return -1 stream not open
+    // return -2 lcd depth or buffer size differs from the clip
+    // return -3 writeLcd failed
+    // return -4 corrupt delta
+    // return -5 read failed
+    inline int32_t playStream(Stream& stream, bool realtime = true, PlayStats* stats = nullptr) {
+        if (!stream.isOpen()) return -1;
+        if (!stream.matchesLcd()) return -2;
+        PlayStats s = {};
+        Player player(stream.header().frame_size);
+        Clock::time_point origin = Clock::now();
+        int32_t result = 0;
+        for (;;) {
+            Stream::Slot slot;
+            int8_t next_result = stream.next(slot);
+            if (next_result < 0) {
+                if (next_result == -2) result = -5;
+                break;
+            }
+            Clock::time_point due = origin + std::chrono::milliseconds(slot.time_ms);
+            if (realtime) RtProfile::sleepUntil(RT_PRESENT, due);
+            Clock::time_point begin = Clock::now();
+            float late_ms = std::chrono::duration<float, std::milli>(begin - due).count();
+            if (realtime && late_ms > 1.0f) s.late++;
+            if (realtime && late_ms > s.max_late_ms) s.max_late_ms = late_ms;
+
+            // keyframes are copied, the slot goes back to the I/O thread right after the write
+            const uint8_t* lcd = player.decode(slot.frame, slot.data, false);
+            Clock::time_point decoded = Clock::now();
+            if (!lcd) {
+                stream.release(slot);
+                result = -4;
+                break;
+            }
+            LcdData frame = { slot.frame.side, (uint8_t*)lcd };
+            int8_t write_result = LcdControl::writeLcd(&frame);
+            stream.release(slot);
+            if (write_result != 0) {
+                result = -3;
+                break;
+            }
+            float decode_us = std::chrono::duration<float, std::micro>(decoded - begin).count();
+            float write_us = std::chrono::duration<float, std::micro>(Clock::now() - decoded).count();
+            s.frames++;
+            s.avg_decode_us += (decode_us - s.avg_decode_us) / s.frames;
+            s.avg_write_us += (write_us - s.avg_write_us) / s.frames;
+        }
+        if (stats) *stats = s;
+        return result < 0 ? result : (int32_t)s.frames;
+    }
+};
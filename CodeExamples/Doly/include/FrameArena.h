@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Preallocated frame buffers for both displays.
+//
+// One anonymous mapping holds every stage buffer of the render pipeline:
+// 24 bit render target, scratch for post effects and the panel buffer handed
+// to writeLcd. Each buffer starts on its own page (so also 64 byte aligned),
+// all pages are written once and mlocked at init, the render loop then never
+// calls the allocator and never takes a page fault.
+//
+//   LcdControl::init(LCD_12BIT);
+//   FrameArena::init();
+//   FrameArena::DisplayBuffers& left = FrameArena::get(LcdLeft);
+//   draw(left.render); LcdControl::LcdBufferFrom24Bit(left.lcd, left.render);
+//   LcdControl::writeLcd(&left.frame);
+
+namespace FrameArena
+{
+    struct DisplayBuffers
+    {
+        uint8_t* render;    // 24 bit RGB or palette indices, render_size bytes
+        uint8_t* scratch;   // 24 bit RGB, render_size bytes, free for effects
+        uint8_t* lcd;       // panel format, lcd_size bytes
+        LcdData frame;      // { side, lcd } ready for writeLcd
+    };
+
+    struct ArenaStats
+    {
+        size_t bytes;           // mapping size
+        size_t render_size;
+        size_t lcd_size;
+        uint32_t pages;         // pre-faulted pages
+        bool locked;            // mlock succeeded
+    };
+
+    static uint8_t* arena = nullptr;
+    static DisplayBuffers displays[2];
+    static ArenaStats arena_stats = {};
+
+    inline size_t pageRound(size_t size, size_t page) {
+        return (size + page - 1) / page * page;
+    }
+
+    // allocate, pre-fault and lock buffers of both displays
+    // call after LcdControl::init, 'lcd_size' 0 = LcdControl::getBufferSize()
+    // return 0 success
+    // return 1 already initialized
+    // return 2 allocated but mlock failed (RLIMIT_MEMLOCK), pages may still be swapped
+    // return -1 allocation failed
+    inline int8_t init(size_t render_size = LCD_WIDTH * LCD_HEIGHT * 3, size_t lcd_size = 0) {
+        if (arena) return 1;
+        if (lcd_size == 0) lcd_size = (size_t)LcdControl::getBufferSize();
+
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t render_slot = pageRound(render_size, page);
+        size_t lcd_slot = pageRound(lcd_size, page);
+        size_t display_slot = render_slot * 2 + lcd_slot;
+        size_t bytes = display_slot * 2;
+
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (p == MAP_FAILED) return -1;
+        arena = (uint8_t*)p;
+
+        // touch every page even if MAP_POPULATE was ignored
+        memset(arena, 0, bytes);
+        bool locked = mlock(arena, bytes) == 0;
+
+        for (uint8_t side = 0; side < 2; side++) {
+            uint8_t* base = arena + side * display_slot;
+            displays[side].render = base;
+            displays[side].scratch = base + render_slot;
+            displays[side].lcd = base + render_slot * 2;
+            displays[side].frame.side = side;
+            displays[side].frame.buffer = displays[side].lcd;
+        }
+
+        arena_stats.bytes = bytes;
+        arena_stats.render_size = render_size;
+        arena_stats.lcd_size = lcd_size;
+        arena_stats.pages = (uint32_t)(bytes / page);
+        arena_stats.locked = locked;
+        return locked ? 0 : 2;
+    }
+
+    // unmap buffers, views returned by get() become invalid
+    inline void release() {
+        if (!arena) return;
+        munlock(arena, arena_stats.bytes);
+        munmap(arena, arena_stats.bytes);
+        arena = nullptr;
+        memset(displays, 0, sizeof(displays));
+        arena_stats = {};
+    }
+
+    inline bool isActive() {
+        return arena != nullptr;
+    }
+
+    // buffers of one display, valid between init and release
+    inline DisplayBuffers& get(LcdSide side) {
+        return displays[side & 1];
+    }
+
+    inline ArenaStats getStats() {
+        return arena_stats;
+    }
+};
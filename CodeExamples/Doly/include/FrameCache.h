@@ -0,0 +1,264 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// LRU cache of converted panel frames.
+//
+// Frames are keyed by the same parameter key as FramePacer (expression, pupil
+// offset, blink progress, ...) plus the display side. A hit writes the cached
+// panel buffer straight to writeLcd, rendering and conversion are skipped.
+// The budget is fixed at init, the least recently used frame is replaced when
+// it is full. Keys must describe the frame content completely, frames with
+// per frame effects (flames, shake) are not stored.
+//
+//   FrameCache::init(16);                                  // 16 MB
+//   if (FrameCache::present(key, LcdLeft) != 0) {          // not cached
+//       render(left.lcd); LcdControl::writeLcd(&left.frame);
+//       FrameCache::store(key, LcdLeft, left.lcd);
+//   }
+//
+// Memory is reserved at init and touched on first store, with mlockall
+// (RtProfile) the whole budget is resident from init on.
+
+#define FRAME_CACHE_DEFAULT_MB 16
+
+namespace FrameCache
+{
+    struct CacheStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t evictions;     // frames replaced because the budget was full
+        uint32_t entries;       // frames cached
+        uint32_t capacity;      // frames fitting in the budget
+        size_t used_bytes;      // entries * frame size
+        size_t budget_bytes;
+        float hit_rate;         // hits / (hits + misses)
+    };
+
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t prev, next;    // LRU list, head = most recently used
+        uint32_t pins;          // present() in progress, not evicted
+    };
+
+    static std::mutex cache_mutex;
+    static uint8_t* frames = nullptr;
+    static size_t frame_size = 0;
+    static size_t mapped_bytes = 0;
+    static uint32_t capacity = 0;
+    static uint32_t used = 0;
+    static uint32_t head = NONE, tail = NONE;
+    static std::vector<Entry> entries;
+    static std::vector<uint32_t> table;     // open addressing, entry index + 1, 0 = empty
+    static uint32_t table_mask = 0;
+    static CacheStats cache_stats = {};
+
+    // frame key and side -> cache key
+    inline uint64_t mix(uint64_t key, uint8_t side) {
+        return key ^ ((uint64_t)(side + 1) * 0x9E3779B97F4A7C15ull);
+    }
+
+    inline uint32_t home(uint64_t key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return (uint32_t)key & table_mask;
+    }
+
+    inline uint32_t find(uint64_t key) {
+        for (uint32_t i = home(key); table[i] != 0; i = (i + 1) & table_mask) {
+            if (entries[table[i] - 1].key == key) return table[i] - 1;
+        }
+        return NONE;
+    }
+
+    inline void tableInsert(uint32_t e) {
+        uint32_t i = home(entries[e].key);
+        while (table[i] != 0) i = (i + 1) & table_mask;
+        table[i] = e + 1;
+    }
+
+    // linear probing delete, later entries of the probe run are shifted back
+    inline void tableErase(uint32_t e) {
+        uint32_t i = home(entries[e].key);
+        while (table[i] != e + 1) i = (i + 1) & table_mask;
+        table[i] = 0;
+        for (uint32_t j = (i + 1) & table_mask; table[j] != 0; j = (j + 1) & table_mask) {
+            uint32_t h = home(entries[table[j] - 1].key);
+            // stays if its home lies cyclically in (i, j]
+            bool stays = (i <= j) ? (h > i && h <= j) : (h > i || h <= j);
+            if (stays) continue;
+            table[i] = table[j];
+            table[j] = 0;
+            i = j;
+        }
+    }
+
+    inline void unlink(uint32_t e) {
+        Entry& en = entries[e];
+        if (en.prev != NONE) entries[en.prev].next = en.next;
+        else head = en.next;
+        if (en.next != NONE) entries[en.next].prev = en.prev;
+        else tail = en.prev;
+    }
+
+    inline void pushFront(uint32_t e) {
+        entries[e].prev = NONE;
+        entries[e].next = head;
+        if (head != NONE) entries[head].prev = e;
+        head = e;
+        if (tail == NONE) tail = e;
+    }
+
+    // reserve 'budget_mb' MB for frames of 'lcd_size' bytes, 0 = LcdControl::getBufferSize()
+    // return 0 success
+    // return 1 already initialized, or budget below one frame (cache stays off)
+    // return -1 allocation failed
+    inline int8_t init(uint32_t budget_mb, size_t lcd_size = 0) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (frames) return 1;
+        if (lcd_size == 0) lcd_size = (size_t)LcdControl::getBufferSize();
+        if (lcd_size == 0) return -1;
+        size_t budget = (size_t)budget_mb * 1024 * 1024;
+        size_t count = budget / lcd_size;
+        if (count == 0) return 1;
+        if (count > (1u << 24)) count = 1u << 24;
+
+        void* p = mmap(nullptr, count * lcd_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) return -1;
+        frames = (uint8_t*)p;
+        frame_size = lcd_size;
+        mapped_bytes = count * lcd_size;
+        capacity = (uint32_t)count;
+
+        uint32_t table_size = 1;
+        while (table_size < capacity * 2) table_size <<= 1;
+        entries.assign(capacity, Entry());
+        table.assign(table_size, 0);
+        table_mask = table_size - 1;
+        used = 0;
+        head = tail = NONE;
+        cache_stats = {};
+        cache_stats.capacity = capacity;
+        cache_stats.budget_bytes = budget;
+        return 0;
+    }
+
+    inline void release() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (!frames) return;
+        munmap(frames, mapped_bytes);
+        frames = nullptr;
+        capacity = used = 0;
+        head = tail = NONE;
+        std::vector<Entry>().swap(entries);
+        std::vector<uint32_t>().swap(table);
+    }
+
+    inline bool isActive() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return frames != nullptr;
+    }
+
+    // write the cached frame of ('key', 'side') to the display
+    // return 0 written from the cache
+    // return 1 not cached or cache off, the caller renders
+    // return -1 writeLcd failed
+    inline int8_t present(uint64_t key, uint8_t side) {
+        uint32_t e;
+        uint8_t* frame;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            if (!frames) return 1;
+            e = find(mix(key, side));
+            if (e == NONE) {
+                cache_stats.misses++;
+                return 1;
+            }
+            cache_stats.hits++;
+            unlink(e);
+            pushFront(e);
+            entries[e].pins++;
+            frame = frames + (size_t)e * frame_size;
+        }
+        // written without the lock, the pin keeps the frame from being replaced
+        LcdData data = { side, frame };
+        int8_t result = LcdControl::writeLcd(&data);
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        entries[e].pins--;
+        return result == 0 ? 0 : -1;
+    }
+
+    // copy the panel buffer 'lcd' in as frame of ('key', 'side')
+    inline void store(uint64_t key, uint8_t side, const uint8_t* lcd) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (!frames) return;
+        uint64_t k = mix(key, side);
+        uint32_t e = find(k);
+        if (e != NONE) {
+            // same key, same content: only refresh the position
+            unlink(e);
+            pushFront(e);
+            return;
+        }
+        if (used < capacity) {
+            e = used++;
+        } else {
+            e = tail;
+            while (e != NONE && entries[e].pins > 0) e = entries[e].prev;
+            if (e == NONE) return;      // every frame is being written
+            tableErase(e);
+            unlink(e);
+            cache_stats.evictions++;
+        }
+        memcpy(frames + (size_t)e * frame_size, lcd, frame_size);
+        entries[e].key = k;
+        entries[e].pins = 0;
+        tableInsert(e);
+        pushFront(e);
+        cache_stats.stores++;
+    }
+
+    // drop every frame, ex. after a palette or asset change, not while present() runs
+    inline void clear() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (!frames) return;
+        used = 0;
+        head = tail = NONE;
+        std::fill(table.begin(), table.end(), 0);
+    }
+
+    inline void resetStats() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        uint32_t cap = cache_stats.capacity;
+        size_t budget = cache_stats.budget_bytes;
+        cache_stats = {};
+        cache_stats.capacity = cap;
+        cache_stats.budget_bytes = budget;
+    }
+
+    inline CacheStats getStats() {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        CacheStats s = cache_stats;
+        s.entries = used;
+        s.used_bytes = (size_t)used * frame_size;
+        uint64_t lookups = s.hits + s.misses;
+        s.hit_rate = lookups ? (float)s.hits / lookups : 0.0f;
+        return s;
+    }
+};
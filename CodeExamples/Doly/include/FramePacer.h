@@ -0,0 +1,143 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <mutex>
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Adaptive frame pacing for static expressions.
+//
+// The renderer describes every frame by a key built from the parameters it is
+// drawn from (expression, pupil offset, blink progress, ...), not from pixels.
+// needsFrame() returns false while the key of a display does not change, so
+// render, conversion and writeLcd are skipped entirely. A keepalive frame is
+// still let through every 'keepalive_ms', and the first changed key renders
+// immediately, so motion starts at full rate without any ramp delay.
+// Process CPU time per wall minute is reported to measure the savings.
+
+#define FRAME_PACER_KEEPALIVE_MS 1000
+
+namespace FramePacer
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // frame key, ex. FramePacer::Key().add(EXPR_SAD).add(offset_x).add(blink).value()
+    class Key
+    {
+    public:
+        Key() : hash(0xcbf29ce484222325ull) {}
+
+        Key& add(int64_t v) {
+            // values are mixed first, plain xor-multiply maps (x, y) and (-x, -y) to the same key
+            uint64_t m = (uint64_t)v + 0x9E3779B97F4A7C15ull;
+            m = (m ^ (m >> 30)) * 0xbf58476d1ce4e5b9ull;
+            m = (m ^ (m >> 27)) * 0x94d049bb133111ebull;
+            m ^= m >> 31;
+            hash = (hash ^ m) * 0x100000001b3ull;
+            return *this;
+        }
+
+        Key& add(float v) {
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            return add((int64_t)bits);
+        }
+
+        Key& add(int v) { return add((int64_t)v); }
+        Key& add(bool v) { return add((int64_t)v); }
+
+        uint64_t value() const { return hash; }
+
+    private:
+        uint64_t hash;
+    };
+
+    struct PacerStats
+    {
+        uint32_t rendered;      // frames let through because the key changed
+        uint32_t keepalive;     // frames let through by the keepalive timer
+        uint32_t skipped;       // unchanged frames not rendered
+        float wall_s;           // since resetStats()
+        float cpu_s;            // process cpu time since resetStats()
+        float cpu_ms_per_min;   // cpu_s normalized to one wall minute
+    };
+
+    static std::mutex pacer_mutex;
+    static uint32_t keepalive_ms = FRAME_PACER_KEEPALIVE_MS;
+    static bool pacing_enabled = true;
+    static bool has_key[2] = { false, false };
+    static uint64_t last_key[2];
+    static Clock::time_point last_frame[2];
+    static PacerStats pacer_stats = {};
+    static Clock::time_point stats_wall_start = Clock::now();
+    static double stats_cpu_start = -1;
+
+    inline double processCpuSeconds() {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    // longest time a display keeps an unchanged image without rewrite, 0 = never rewrite
+    inline void setKeepalive(uint32_t ms) {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        keepalive_ms = ms;
+    }
+
+    // false renders every frame, for comparing cpu time with and without pacing
+    inline void setEnabled(bool enabled) {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        pacing_enabled = enabled;
+    }
+
+    // true if the frame of 'side' described by 'key' has to be rendered and written,
+    // the caller is expected to write it when true is returned
+    inline bool needsFrame(LcdSide side, uint64_t key) {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        uint8_t s = side & 1;
+        Clock::time_point now = Clock::now();
+        if (!pacing_enabled || !has_key[s] || last_key[s] != key) {
+            has_key[s] = true;
+            last_key[s] = key;
+            last_frame[s] = now;
+            pacer_stats.rendered++;
+            return true;
+        }
+        if (keepalive_ms > 0 && now - last_frame[s] >= std::chrono::milliseconds(keepalive_ms)) {
+            last_frame[s] = now;
+            pacer_stats.keepalive++;
+            return true;
+        }
+        pacer_stats.skipped++;
+        return false;
+    }
+
+    // forget the last key, next needsFrame() of 'side' returns true
+    // call when something else wrote the display (ex. LcdColorFill)
+    inline void invalidate(LcdSide side) {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        has_key[side & 1] = false;
+    }
+
+    inline void resetStats() {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        pacer_stats = {};
+        stats_wall_start = Clock::now();
+        stats_cpu_start = processCpuSeconds();
+    }
+
+    inline PacerStats getStats() {
+        std::lock_guard<std::mutex> lock(pacer_mutex);
+        if (stats_cpu_start < 0) stats_cpu_start = 0;     // never reset, count from process start
+        PacerStats result = pacer_stats;
+        result.wall_s = std::chrono::duration<float>(Clock::now() - stats_wall_start).count();
+        result.cpu_s = (float)(processCpuSeconds() - stats_cpu_start);
+        result.cpu_ms_per_min = result.wall_s > 0 ? result.cpu_s * 1000.0f * 60.0f / result.wall_s : 0;
+        return result;
+    }
+};
@@ -0,0 +1,375 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// LCD frame stream recorder, replayer and golden frame check.
+//
+// File layout, little endian, append only so a crashed recording stays
+// readable up to the last complete frame and the whole file can be mmapped:
+//   FrameFileHeader
+//   FrameRecord + payload (padded to 8 bytes), repeated
+// A frame identical to the previous frame of the same side is stored without
+// payload (FRAME_FLAG_REPEAT), static expressions cost 32 bytes per frame.
+//
+// With the x86 simulator every writeLcd is recorded automatically, on the
+// robot submit frames through FrameRecorder::writeLcd.
+
+#define FRAME_FILE_MAGIC 0x4D52464C594C4F44ull    // "DOLYLFRM"
+#define FRAME_RECORD_MAGIC 0x4D415246u            // "FRAM"
+#define FRAME_FILE_VERSION 1
+#define FRAME_FLAG_REPEAT 0x01
+
+struct FrameFileHeader
+{
+    uint64_t magic;
+    uint16_t version;
+    uint16_t width;
+    uint16_t height;
+    uint16_t reserved;
+    uint64_t start_ns;      // CLOCK_REALTIME of recording start, informational
+    uint64_t reserved2;
+};
+
+struct FrameRecord
+{
+    uint32_t magic;
+    uint32_t size;          // payload bytes, 0 for repeated frame
+    uint64_t time_ns;       // since recording start
+    uint8_t side;
+    uint8_t depth;          // LcdColorDepth
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t frame_size;    // lcd buffer size of the frame
+    uint64_t hash;          // FrameRecorder::hash of the lcd buffer
+};
+
+namespace FrameRecorder
+{
+    struct RecordStats
+    {
+        uint32_t frames;
+        uint32_t repeats;       // frames stored without payload
+        uint64_t bytes;         // file size
+        uint32_t write_errors;
+    };
+
+    static std::mutex recorder_mutex;
+    static int record_fd = -1;
+    static std::chrono::steady_clock::time_point record_start;
+    static uint64_t last_hash[2];
+    static bool has_last[2];
+    static RecordStats record_stats = {};
+
+    // 64 bit FNV-1a over 8 byte words, same result on robot and x86
+    inline uint64_t hash(const uint8_t* data, size_t size) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+        }
+        for (; i < size; i++) {
+            h = (h ^ data[i]) * 0x100000001b3ull;
+        }
+        return h ^ (h >> 29);
+    }
+
+    inline bool writeAll(int fd, const struct iovec* iov, int count) {
+        std::vector<struct iovec> parts(iov, iov + count);
+        size_t index = 0;
+        while (index < parts.size()) {
+            ssize_t n = writev(fd, &parts[index], (int)(parts.size() - index));
+            if (n < 0) return false;
+            while (index < parts.size() && (size_t)n >= parts[index].iov_len) {
+                n -= parts[index].iov_len;
+                index++;
+            }
+            if (index < parts.size()) {
+                parts[index].iov_base = (uint8_t*)parts[index].iov_base + n;
+                parts[index].iov_len -= n;
+            }
+        }
+        return true;
+    }
+
+    // append one frame, called by the simulator hook or FrameRecorder::writeLcd
+    inline void record(const LcdData* frame_data) {
+        if (!frame_data || !frame_data->buffer || frame_data->side > LcdRight) return;
+        uint64_t time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - record_start).count();
+        uint32_t frame_size = (uint32_t)LcdControl::getBufferSize();
+        uint64_t h = hash(frame_data->buffer, frame_size);
+
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (record_fd < 0) return;
+        uint8_t side = frame_data->side;
+        bool repeat = has_last[side] && last_hash[side] == h;
+        FrameRecord rec = {};
+        rec.magic = FRAME_RECORD_MAGIC;
+        rec.size = repeat ? 0 : frame_size;
+        rec.time_ns = time_ns;
+        rec.side = side;
+        rec.depth = LcdControl::getColorDepth();
+        rec.flags = repeat ? FRAME_FLAG_REPEAT : 0;
+        rec.frame_size = frame_size;
+        rec.hash = h;
+
+        static const uint8_t padding[8] = { 0 };
+        size_t pad = (8 - rec.size % 8) % 8;
+        struct iovec iov[3] = {
+            { &rec, sizeof(rec) },
+            { frame_data->buffer, rec.size },
+            { (void*)padding, pad },
+        };
+        if (!writeAll(record_fd, iov, 3)) {
+            record_stats.write_errors++;
+            return;
+        }
+        last_hash[side] = h;
+        has_last[side] = true;
+        record_stats.frames++;
+        if (repeat) record_stats.repeats++;
+        record_stats.bytes += sizeof(rec) + rec.size + pad;
+    }
+
+#ifdef DOLY_X86_SIM_LCD
+    inline void recordHook(const LcdData* frame_data) {
+        record(frame_data);
+    }
+#endif
+
+    // start recording into 'path', an existing file is replaced
+    // return 0 success
+    // return 1 already recording
+    // return -1 open failed
+    // return -2 write failed
+    inline int8_t start(const char* path) {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (record_fd >= 0) return 1;
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        FrameFileHeader header = {};
+        header.magic = FRAME_FILE_MAGIC;
+        header.version = FRAME_FILE_VERSION;
+        header.width = LCD_WIDTH;
+        header.height = LCD_HEIGHT;
+        header.start_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        struct iovec iov = { &header, sizeof(header) };
+        if (!writeAll(fd, &iov, 1)) {
+            close(fd);
+            return -2;
+        }
+
+        record_fd = fd;
+        record_start = std::chrono::steady_clock::now();
+        has_last[0] = has_last[1] = false;
+        record_stats = {};
+        record_stats.bytes = sizeof(header);
+#ifdef DOLY_X86_SIM_LCD
+        LcdControl::setFrameHook(recordHook);
+#endif
+        return 0;
+    }
+
+    // stop recording and close the file
+    inline void stop() {
+#ifdef DOLY_X86_SIM_LCD
+        LcdControl::setFrameHook(nullptr);
+#endif
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (record_fd < 0) return;
+        close(record_fd);
+        record_fd = -1;
+    }
+
+    inline bool isRecording() {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return record_fd >= 0;
+    }
+
+    inline RecordStats getStats() {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        return record_stats;
+    }
+
+    // LcdControl::writeLcd that records the frame first, for the real device
+    inline int8_t writeLcd(LcdData* frame_data) {
+#ifndef DOLY_X86_SIM_LCD
+        record(frame_data);
+#endif
+        return LcdControl::writeLcd(frame_data);
+    }
+};
+
+namespace FrameReplay
+{
+    struct Frame
+    {
+        uint64_t time_ns;
+        uint8_t side;
+        LcdColorDepth depth;
+        uint64_t hash;
+        uint32_t size;
+        const uint8_t* data;    // inside the mapping, repeated frames point to the earlier copy
+    };
+
+    struct CheckResult
+    {
+        uint32_t frames;            // frames compared
+        uint32_t mismatched;
+        int32_t first_mismatch;     // frame index in recording, -1 none
+        int32_t missing;            // golden frames minus recorded frames per side, summed absolute
+    };
+
+    // mmapped recording, frames are parsed once at open
+    class Recording
+    {
+    public:
+        Recording() : map(nullptr), map_size(0) {}
+        ~Recording() { close(); }
+        Recording(const Recording&) = delete;
+        Recording& operator=(const Recording&) = delete;
+
+        // return 0 success
+        // return -1 open / mmap failed
+        // return -2 not a frame recording
+        int8_t open(const char* path) {
+            close();
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -1;
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                ::close(fd);
+                return -1;
+            }
+            if ((size_t)st.st_size < sizeof(FrameFileHeader)) {
+                ::close(fd);
+                return -2;
+            }
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) return -1;
+            map = (const uint8_t*)p;
+            map_size = st.st_size;
+            madvise((void*)map, map_size, MADV_SEQUENTIAL);
+
+            const FrameFileHeader* header = (const FrameFileHeader*)map;
+            if (header->magic != FRAME_FILE_MAGIC || header->version != FRAME_FILE_VERSION ||
+                header->width != LCD_WIDTH || header->height != LCD_HEIGHT) {
+                close();
+                return -2;
+            }
+
+            // parse up to the last complete record
+            const uint8_t* last[2] = { nullptr, nullptr };
+            size_t offset = sizeof(FrameFileHeader);
+            while (offset + sizeof(FrameRecord) <= map_size) {
+                const FrameRecord* rec = (const FrameRecord*)(map + offset);
+                size_t payload = rec->size + (8 - rec->size % 8) % 8;
+                if (rec->magic != FRAME_RECORD_MAGIC || rec->side > LcdRight ||
+                    offset + sizeof(FrameRecord) + payload > map_size) break;
+                const uint8_t* data = map + offset + sizeof(FrameRecord);
+                if (rec->flags & FRAME_FLAG_REPEAT) {
+                    data = last[rec->side];
+                    if (!data) break;
+                } else if (rec->size != rec->frame_size) {
+                    break;
+                }
+                last[rec->side] = data;
+                frames.push_back({ rec->time_ns, rec->side, (LcdColorDepth)rec->depth, rec->hash, rec->frame_size, data });
+                offset += sizeof(FrameRecord) + payload;
+            }
+            return 0;
+        }
+
+        void close() {
+            if (map) munmap((void*)map, map_size);
+            map = nullptr;
+            map_size = 0;
+            frames.clear();
+        }
+
+        size_t count() const { return frames.size(); }
+        const Frame& operator[](size_t index) const { return frames[index]; }
+
+        // recording length
+        uint64_t durationNs() const { return frames.empty() ? 0 : frames.back().time_ns; }
+
+    private:
+        const uint8_t* map;
+        size_t map_size;
+        std::vector<Frame> frames;
+    };
+
+    // push recording back through LcdControl::writeLcd
+    // 'realtime' true keeps the original frame timing, false writes as fast as possible
+    // return >= 0 frames written
+    // return -1 open failed
+    // return -2 lcd depth differs from recording
+    // return -3 writeLcd failed
+    inline int32_t replay(const char* path, bool realtime = true) {
+        Recording recording;
+        if (recording.open(path) != 0) return -1;
+        std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+        int32_t written = 0;
+        for (size_t i = 0; i < recording.count(); i++) {
+            const Frame& f = recording[i];
+            if (f.depth != LcdControl::getColorDepth() || f.size != (uint32_t)LcdControl::getBufferSize()) return -2;
+            if (realtime) std::this_thread::sleep_until(origin + std::chrono::nanoseconds(f.time_ns));
+            LcdData frame = { f.side, (uint8_t*)f.data };
+            if (LcdControl::writeLcd(&frame) != 0) return -3;
+            written++;
+        }
+        return written;
+    }
+
+    // compare frame hashes with a golden recording, side by side in submission order
+    // timing is ignored so a faster renderer still passes
+    // return 0 identical
+    // return 1 hashes or frame counts differ, see 'result'
+    // return -1 open failed
+    inline int8_t check(const char* path, const char* golden_path, CheckResult* result = nullptr) {
+        Recording recording, golden;
+        if (recording.open(path) != 0 || golden.open(golden_path) != 0) return -1;
+
+        CheckResult r = { 0, 0, -1, 0 };
+        for (uint8_t side = 0; side < 2; side++) {
+            std::vector<size_t> a, b;
+            for (size_t i = 0; i < recording.count(); i++) if (recording[i].side == side) a.push_back(i);
+            for (size_t i = 0; i < golden.count(); i++) if (golden[i].side == side) b.push_back(i);
+            size_t n = std::min(a.size(), b.size());
+            for (size_t i = 0; i < n; i++) {
+                const Frame& x = recording[a[i]];
+                const Frame& y = golden[b[i]];
+                r.frames++;
+                if (x.hash != y.hash || x.depth != y.depth) {
+                    r.mismatched++;
+                    if (r.first_mismatch < 0 || (int32_t)a[i] < r.first_mismatch) r.first_mismatch = (int32_t)a[i];
+                }
+            }
+            r.missing += (int32_t)(a.size() > b.size() ? a.size() - b.size() : b.size() - a.size());
+        }
+        if (result) *result = r;
+        return (r.mismatched == 0 && r.missing == 0) ? 0 : 1;
+    }
+};
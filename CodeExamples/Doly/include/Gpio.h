@@ -33,6 +33,10 @@ enum PwmId :uint8_t
 
 namespace GPIO
 {
+	// PWM controller i2c file descriptor, valid after init(PwmId)
+	// see PwmShadow.h to batch register writes on this bus
+	extern int pwm_i2c_fd;
+
 	// Initialize IO pin
 	// state is optional for GPIO
 	// return 0 = success
@@ -0,0 +1,265 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "SpscQueue.h"
+
+// Single thread GPIO event loop.
+//
+// Every input pin event fd (GpioPin::get_fd() or requestEventFd()) is registered
+// in one epoll set. The loop thread reads gpioevent_data in batches, debounces
+// them on the kernel timestamps and pushes accepted edges to a lock-free queue.
+// Subscribers are called from dispatch() on the thread that owns the queue
+// (usually the main control loop), so no thread is needed per input pin.
+// On x86 (Gpio_x86_sim.h included first) requestEventFd() returns a simulated
+// line fed by GpioSim::injectEdge().
+
+#define GPIO_EVENT_MAX_PINS   32
+#define GPIO_EVENT_QUEUE_SIZE 256
+#define GPIO_EVENT_BATCH      16
+
+struct GpioEvent
+{
+    uint16_t pin;           // id given to addPin
+    bool rising;            // true = rising edge, false = falling edge
+    uint64_t timestamp_ns;  // kernel timestamp of the edge
+    void (*callback)(const GpioEvent& event);
+};
+
+typedef void (*GpioEventCallback)(const GpioEvent& event);
+
+namespace GpioEventLoop
+{
+    struct LoopStats
+    {
+        uint64_t wakeups;       // epoll_wait returns
+        uint64_t events_read;   // gpioevent_data read from kernel
+        uint64_t bounced;       // edges dropped by debounce
+        uint64_t dropped;       // edges lost because dispatch() did not keep up
+    };
+
+    struct PinSlot
+    {
+        int fd;
+        uint16_t pin;
+        uint64_t debounce_ns;
+        uint64_t last_accepted_ns;
+        bool has_last;
+        GpioEventCallback callback;
+    };
+
+    static std::mutex slot_mutex;
+    static PinSlot slots[GPIO_EVENT_MAX_PINS];
+    static int slot_count = 0;
+
+    static int epoll_fd = -1;
+    static int wake_fd = -1;
+    static std::thread loop_thread;
+    static std::atomic<bool> running(false);
+
+    static SpscQueue<GpioEvent, GPIO_EVENT_QUEUE_SIZE> event_queue;
+    static std::atomic<uint64_t> stat_wakeups(0);
+    static std::atomic<uint64_t> stat_events_read(0);
+    static std::atomic<uint64_t> stat_bounced(0);
+    static std::atomic<uint64_t> stat_dropped(0);
+
+    // request a both-edge event line directly from the gpio chip
+    // chip ex. "/dev/gpiochip0"
+    // return event fd
+    // return -1 open chip failed
+    // return -2 ioctl failed
+    inline int requestEventFd(const char* chip, uint16_t line, const char* consumer = "doly-event") {
+#ifdef DOLY_X86_SIM_GPIO
+        (void)chip;
+        (void)consumer;
+        return GpioSim::requestEventFd(line);
+#else
+        int chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+        if (chip_fd < 0) return -1;
+
+        struct gpioevent_request req;
+        memset(&req, 0, sizeof(req));
+        req.lineoffset = line;
+        req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+        req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+        strncpy(req.consumer_label, consumer, sizeof(req.consumer_label) - 1);
+
+        int ret = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+        close(chip_fd);
+        if (ret < 0) return -2;
+        return req.fd;
+#endif
+    }
+
+    static void readPin(PinSlot& slot) {
+        struct gpioevent_data data[GPIO_EVENT_BATCH];
+        for (;;) {
+            ssize_t n = read(slot.fd, data, sizeof(data));
+            if (n <= 0) return;
+            int count = (int)(n / sizeof(struct gpioevent_data));
+            stat_events_read.fetch_add(count, std::memory_order_relaxed);
+
+            for (int i = 0; i < count; i++) {
+                // contact bounce, keep first edge of the burst
+                if (slot.has_last && data[i].timestamp - slot.last_accepted_ns < slot.debounce_ns) {
+                    stat_bounced.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                slot.has_last = true;
+                slot.last_accepted_ns = data[i].timestamp;
+
+                GpioEvent event;
+                event.pin = slot.pin;
+                event.rising = (data[i].id == GPIOEVENT_EVENT_RISING_EDGE);
+                event.timestamp_ns = data[i].timestamp;
+                event.callback = slot.callback;
+                if (!event_queue.push(event)) {
+                    stat_dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            if (count < GPIO_EVENT_BATCH) return;
+        }
+    }
+
+    static void loop() {
+        struct epoll_event events[GPIO_EVENT_BATCH];
+        while (running.load(std::memory_order_acquire)) {
+            int n = epoll_wait(epoll_fd, events, GPIO_EVENT_BATCH, -1);
+            if (n < 0) continue;
+            stat_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(slot_mutex);
+            for (int i = 0; i < n; i++) {
+                int index = (int)events[i].data.u32;
+                if (index < 0) continue; // wake_fd
+                if (index < slot_count && slots[index].fd >= 0) readPin(slots[index]);
+            }
+        }
+    }
+
+    // register pin event fd, fd is switched to non-blocking
+    // 'pin' is any id the subscriber wants back in GpioEvent
+    // return 0 success
+    // return -1 epoll error
+    // return -2 too many pins
+    inline int8_t addPin(uint16_t pin, int event_fd, uint32_t debounce_us, GpioEventCallback callback) {
+        std::lock_guard<std::mutex> lock(slot_mutex);
+        // reuse a slot freed by removePin, its index is the epoll data of the new fd
+        int index = 0;
+        while (index < slot_count && slots[index].fd >= 0) index++;
+        if (index >= GPIO_EVENT_MAX_PINS) return -2;
+        if (epoll_fd < 0) {
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) return -1;
+        }
+
+        int flags = fcntl(event_fd, F_GETFL, 0);
+        fcntl(event_fd, F_SETFL, flags | O_NONBLOCK);
+
+        PinSlot& slot = slots[index];
+        slot.fd = event_fd;
+        slot.pin = pin;
+        slot.debounce_ns = (uint64_t)debounce_us * 1000;
+        slot.has_last = false;
+        slot.last_accepted_ns = 0;
+        slot.callback = callback;
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLPRI;
+        ev.data.u32 = (uint32_t)index;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &ev) < 0) {
+            slot.fd = -1;
+            return -1;
+        }
+        if (index == slot_count) slot_count++;
+        return 0;
+    }
+
+    // unregister pin, fd stays open and belongs to the caller
+    // return 0 success
+    // return -1 undefined pin
+    inline int8_t removePin(uint16_t pin) {
+        std::lock_guard<std::mutex> lock(slot_mutex);
+        for (int i = 0; i < slot_count; i++) {
+            if (slots[i].fd >= 0 && slots[i].pin == pin) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, slots[i].fd, nullptr);
+                slots[i].fd = -1;
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    // start loop thread
+    // return 0 success
+    // return 1 already running
+    // return -1 epoll error
+    inline int8_t start() {
+        if (running.load()) return 1;
+        {
+            std::lock_guard<std::mutex> lock(slot_mutex);
+            if (epoll_fd < 0) {
+                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if (epoll_fd < 0) return -1;
+            }
+            if (wake_fd < 0) {
+                wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (wake_fd < 0) return -1;
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.u32 = (uint32_t)-1;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) return -1;
+            }
+        }
+        running.store(true, std::memory_order_release);
+        loop_thread = std::thread(loop);
+        return 0;
+    }
+
+    // stop loop thread, registered pins are kept
+    inline void stop() {
+        if (!running.exchange(false)) return;
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {}
+        if (loop_thread.joinable()) loop_thread.join();
+        uint64_t drain;
+        if (read(wake_fd, &drain, sizeof(drain)) < 0) {}
+    }
+
+    // loop thread still running at exit (no stop() before exit / return from main)
+    static struct LoopThreadGuard
+    {
+        ~LoopThreadGuard() { stop(); }
+    } loop_thread_guard;
+
+    // call subscribers for queued events, must always be called from the same thread
+    // return number of dispatched events
+    inline int dispatch(int max_events = GPIO_EVENT_QUEUE_SIZE) {
+        int count = 0;
+        GpioEvent event;
+        while (count < max_events && event_queue.pop(event)) {
+            if (event.callback) event.callback(event);
+            count++;
+        }
+        return count;
+    }
+
+    inline LoopStats getStats() {
+        LoopStats stats;
+        stats.wakeups = stat_wakeups.load();
+        stats.events_read = stat_events_read.load();
+        stats.bounced = stat_bounced.load();
+        stats.dropped = stat_dropped.load();
+        return stats;
+    }
+};
@@ -0,0 +1,297 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// x86 stand-in for Gpio.h / libGpio.a
+// Same API as Gpio.h, plus the GpioSim namespace for tests and benchmarks:
+// simulated i2c latency, a PCA9685 register file, input edge injection
+// and a log of every command sent to the hardware.
+#define DOLY_X86_SIM_GPIO
+
+enum GpioType :uint8_t
+{
+    GPIO_INPUT = 0,
+    GPIO_OUTPUT = 1,
+    GPIO_PWM = 2
+};
+
+enum GpioState :bool
+{
+    LOW = false,
+    HIGH = true,
+};
+
+enum PinId :uint8_t
+{
+    // >= 50 GPIO_CHIP2
+    Pin_Servo_Left_Enable = 56,
+    Pin_Servo_Right_Enable = 57,
+};
+
+enum PwmId :uint8_t
+{
+    Pwm_Led_Left_B = 6,
+    Pwm_Led_Left_G = 7,
+    Pwm_Led_Left_R = 8,
+    Pwm_Led_Right_B = 9,
+    Pwm_Led_Right_G = 10,
+    Pwm_Led_Right_R = 11,
+};
+
+namespace GpioSim
+{
+    enum LogType :uint8_t
+    {
+        LOG_PIN_INIT = 0,
+        LOG_PIN_WRITE,
+        LOG_PWM_INIT,
+        LOG_PWM_WRITE,
+        LOG_BUS_WRITE,      // raw i2c transaction, id = start register, value = length
+        LOG_EDGE,           // injected input edge, value = 1 rising / 0 falling
+        LOG_SERVO_SET,      // id = channel, value = angle, arg = speed
+        LOG_SERVO_STOP,
+        LOG_SERVO_COMPLETE,
+        LOG_SERVO_ABORT,
+    };
+
+    struct LogEntry
+    {
+        uint64_t time_ns;   // CLOCK_MONOTONIC
+        LogType type;
+        uint16_t id;
+        float value;
+        uint16_t arg;
+    };
+
+    #define GPIO_SIM_MAX_LINES 64
+    #define GPIO_SIM_PIN_COUNT 256
+
+    static std::mutex sim_mutex;
+    static std::vector<LogEntry> command_log;
+    static bool log_enabled = true;
+
+    // i2c cost model, 400kHz bus ~ 25us per byte plus start/address/stop
+    static uint32_t i2c_transaction_us = 30;
+    static uint32_t i2c_byte_us = 25;
+    static uint64_t i2c_busy_ns = 0;
+
+    static bool pin_ready[GPIO_SIM_PIN_COUNT];
+    static GpioState pin_state[GPIO_SIM_PIN_COUNT];
+    static uint64_t pin_changed_ns[GPIO_SIM_PIN_COUNT];
+
+    static uint8_t pwm_registers[256];
+    static bool pwm_ready[16];
+
+    static int line_fd_write[GPIO_SIM_MAX_LINES] = {0};
+    static bool line_open[GPIO_SIM_MAX_LINES];
+
+    inline uint64_t nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    inline void record(LogType type, uint16_t id, float value, uint16_t arg = 0) {
+        if (!log_enabled) return;
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        command_log.push_back({ nowNs(), type, id, value, arg });
+    }
+
+    // set i2c cost, 0 disables the delay
+    inline void setI2cLatency(uint32_t transaction_us, uint32_t byte_us) {
+        i2c_transaction_us = transaction_us;
+        i2c_byte_us = byte_us;
+    }
+
+    // block caller like a blocking i2c-dev write would
+    inline void busDelay(uint32_t bytes) {
+        uint64_t us = i2c_transaction_us + (uint64_t)i2c_byte_us * bytes;
+        if (us == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(sim_mutex);
+            i2c_busy_ns += us * 1000;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+
+    // total time spent on the simulated bus
+    inline uint64_t busBusyNs() {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        return i2c_busy_ns;
+    }
+
+    // PwmShadow backend, ex. PwmShadow::init(GpioSim::busWrite, GpioSim::busRead)
+    inline int8_t busWrite(uint8_t reg, const uint8_t* data, uint8_t len) {
+        busDelay(len + 1);
+        {
+            std::lock_guard<std::mutex> lock(sim_mutex);
+            for (uint8_t i = 0; i < len; i++) pwm_registers[(uint8_t)(reg + i)] = data[i];
+        }
+        record(LOG_BUS_WRITE, reg, len);
+        return 0;
+    }
+
+    inline int8_t busRead(uint8_t reg, uint8_t* data, uint8_t len) {
+        busDelay(len + 2);
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        for (uint8_t i = 0; i < len; i++) data[i] = pwm_registers[(uint8_t)(reg + i)];
+        return 0;
+    }
+
+    // current simulated register value of PWM controller
+    inline uint8_t pwmRegister(uint8_t reg) {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        return pwm_registers[reg];
+    }
+
+    inline GpioState pinState(uint8_t id) {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        return pin_state[id];
+    }
+
+    // time of the last state change of output pin
+    inline uint64_t pinChangedNs(uint8_t id) {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        return pin_changed_ns[id];
+    }
+
+    // create simulated input line, returns readable fd delivering gpioevent_data
+    // usable with GpioEventLoop::addPin
+    // return -1 line out of range or pipe failed
+    inline int requestEventFd(uint16_t line) {
+        if (line >= GPIO_SIM_MAX_LINES) return -1;
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) return -1;
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        if (line_open[line]) close(line_fd_write[line]);
+        line_fd_write[line] = fds[1];
+        line_open[line] = true;
+        return fds[0];
+    }
+
+    // inject an input edge, timestamp 0 = now
+    // bounce_count extra edges 100us apart emulate contact bounce
+    // return 0 success
+    // return -1 line not requested
+    inline int8_t injectEdge(uint16_t line, bool rising, uint64_t timestamp_ns = 0, uint8_t bounce_count = 0) {
+        if (line >= GPIO_SIM_MAX_LINES) return -1;
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(sim_mutex);
+            if (!line_open[line]) return -1;
+            fd = line_fd_write[line];
+        }
+        if (timestamp_ns == 0) timestamp_ns = nowNs();
+
+        struct gpioevent_data data;
+        bool edge = rising;
+        for (uint8_t i = 0; i <= bounce_count * 2; i++) {
+            data.timestamp = timestamp_ns + (uint64_t)i * 100000;
+            data.id = edge ? GPIOEVENT_EVENT_RISING_EDGE : GPIOEVENT_EVENT_FALLING_EDGE;
+            if (write(fd, &data, sizeof(data)) != sizeof(data)) return -1;
+            edge = !edge;
+        }
+        record(LOG_EDGE, line, rising ? 1.0f : 0.0f, bounce_count);
+        return 0;
+    }
+
+    // copy of the command log
+    inline std::vector<LogEntry> getLog() {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        return command_log;
+    }
+
+    inline void clearLog() {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        command_log.clear();
+    }
+
+    inline void enableLog(bool enable) {
+        log_enabled = enable;
+    }
+
+    // write log as csv: time_ns,type,id,value,arg
+    inline void dumpLog(FILE* out) {
+        std::lock_guard<std::mutex> lock(sim_mutex);
+        static const char* names[] = { "pin_init", "pin_write", "pwm_init", "pwm_write", "bus_write",
+                                       "edge", "servo_set", "servo_stop", "servo_complete", "servo_abort" };
+        for (const LogEntry& e : command_log) {
+            fprintf(out, "%llu,%s,%u,%g,%u\n", (unsigned long long)e.time_ns, names[e.type], e.id, e.value, e.arg);
+        }
+    }
+};
+
+namespace GPIO
+{
+    // simulated, never a real device
+    [[maybe_unused]] static int pwm_i2c_fd = -1;
+
+    // Initialize IO pin
+    // return 0 = success
+    // return -2 = wrong type
+    inline int8_t init(PinId id, GpioType type, GpioState state = GpioState::LOW) {
+        if (type == GPIO_PWM) return -2;
+        {
+            std::lock_guard<std::mutex> lock(GpioSim::sim_mutex);
+            GpioSim::pin_ready[id] = true;
+            if (type == GPIO_OUTPUT) {
+                GpioSim::pin_state[id] = state;
+                GpioSim::pin_changed_ns[id] = GpioSim::nowNs();
+            }
+        }
+        GpioSim::record(GpioSim::LOG_PIN_INIT, id, state ? 1.0f : 0.0f, type);
+        return 0;
+    }
+
+    // Initialize PWM pin
+    // return 0 = success
+    inline int8_t init(PwmId id) {
+        {
+            std::lock_guard<std::mutex> lock(GpioSim::sim_mutex);
+            GpioSim::pwm_ready[id] = true;
+        }
+        GpioSim::record(GpioSim::LOG_PWM_INIT, id, 0);
+        return 0;
+    }
+
+    // return 0 success
+    // return -2 undefined id
+    inline int8_t writePin(PinId id, GpioState state) {
+        {
+            std::lock_guard<std::mutex> lock(GpioSim::sim_mutex);
+            if (!GpioSim::pin_ready[id]) return -2;
+            if (GpioSim::pin_state[id] != state) {
+                GpioSim::pin_state[id] = state;
+                GpioSim::pin_changed_ns[id] = GpioSim::nowNs();
+            }
+        }
+        GpioSim::record(GpioSim::LOG_PIN_WRITE, id, state ? 1.0f : 0.0f);
+        return 0;
+    }
+
+    // one 4 register transaction per call, like the library
+    // return 0 success
+    // return -2 undefined id
+    inline int8_t writePwm(PwmId id, uint16_t value) {
+        {
+            std::lock_guard<std::mutex> lock(GpioSim::sim_mutex);
+            if (!GpioSim::pwm_ready[id]) return -2;
+        }
+        uint16_t on = 0, off = value;
+        if (value >= 4095) { on = 0x1000; off = 0; }
+        else if (value == 0) { off = 0x1000; }
+        uint8_t data[4] = { (uint8_t)(on & 0xFF), (uint8_t)(on >> 8), (uint8_t)(off & 0xFF), (uint8_t)(off >> 8) };
+        GpioSim::busWrite(0x06 + 4 * id, data, 4);
+        GpioSim::record(GpioSim::LOG_PWM_WRITE, id, value);
+        return 0;
+    }
+};
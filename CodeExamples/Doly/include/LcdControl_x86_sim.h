@@ -1,28 +1,29 @@
 #pragma once
 #include <stdint.h>
 #include <vector>
-#include <iostream>
 #include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include <SDL2/SDL.h>
+#include "AsyncLog.h"
+
+// x86 stand-in for LcdControl.h / libLcdControl.a
+#define DOLY_X86_SIM_LCD
 
 // 模拟LCD屏幕参数
 #define LCD_WIDTH 240
 #define LCD_HEIGHT 240
 
-// 日志级别定义
-#define LOG_LEVEL_ERROR 0
-#define LOG_LEVEL_WARN  1
-#define LOG_LEVEL_INFO  2
-#define LOG_LEVEL_DEBUG 3
+// 模拟SPI传输：两块屏幕共用一个SPI控制器，writeLcd按传输时间阻塞
+#define LCD_SIM_SPI_HZ 40000000             // 默认SPI时钟
+#define LCD_SIM_SPI_FRAME_OVERHEAD_US 50    // 每帧CASET/RASET/RAMWR命令和片选开销
 
-// 当前日志级别（可以调整）
-#define CURRENT_LOG_LEVEL LOG_LEVEL_INFO
+// 支持按行窗口部分写入 LcdControl::writeLcdRows（真机驱动只有整帧 writeLcd）
+#define LCD_PARTIAL_WRITE
 
-// 日志宏
-#define LOG_ERROR(msg) if(CURRENT_LOG_LEVEL >= LOG_LEVEL_ERROR) std::cerr << "[ERROR] " << msg << std::endl
-#define LOG_WARN(msg)  if(CURRENT_LOG_LEVEL >= LOG_LEVEL_WARN)  std::cout << "[WARN]  " << msg << std::endl
-#define LOG_INFO(msg)  if(CURRENT_LOG_LEVEL >= LOG_LEVEL_INFO)  std::cout << "[INFO]  " << msg << std::endl
-#define LOG_DEBUG(msg) if(CURRENT_LOG_LEVEL >= LOG_LEVEL_DEBUG) std::cout << "[DEBUG] " << msg << std::endl
+// 日志宏 LOG_ERROR/WARN/INFO/DEBUG 见 AsyncLog.h（编译时级别，异步输出）
 
 enum LcdColorDepth :uint8_t
 {
@@ -50,13 +51,92 @@ namespace LcdControl
     static LcdColorDepth current_depth = LCD_12BIT;
     static uint8_t current_brightness = 7;
     
-    // SDL2相关变量
+    // SDL2相关变量（只在显示线程中使用）
     static SDL_Window* window = nullptr;
     static SDL_Renderer* renderer = nullptr;
-    static SDL_Texture* texture = nullptr;
+    static SDL_Texture* textures[2] = { nullptr, nullptr };   // 每个LcdSide一个纹理
     static bool sdl_initialized = false;
+
+    // writeLcd只写入暂存缓冲区，显示线程按屏幕刷新率取走并显示
+    struct PresentStats
+    {
+        uint64_t writes;        // writeLcd调用次数
+        uint64_t overwritten;   // 显示前被下一帧覆盖的帧
+        uint64_t presents;      // 实际SDL_RenderPresent次数
+        int refresh_rate;       // 主机屏幕刷新率
+        uint64_t spi_bytes;     // 模拟SPI传输字节数
+        uint64_t spi_busy_us;   // 模拟SPI传输时间
+    };
+
+    static std::mutex staging_mutex;
+    static std::vector<uint8_t> staging[2];     // 最新写入的帧
+    static std::vector<uint8_t> presenting[2];  // 显示线程持有的帧
+    static bool staging_dirty[2] = { false, false };
+    static PresentStats present_stats = {};
+
+    static std::thread present_thread;
+    static std::atomic<bool> present_running(false);
+    static std::atomic<bool> quit_requested(false);
+    static std::atomic<int> sdl_init_state(0);  // 0 = 等待, 1 = 成功, -1 = 失败
+
+    static std::mutex spi_mutex;
+    static uint32_t spi_clock_hz = LCD_SIM_SPI_HZ;
+    static std::vector<uint8_t> texture_rgb;    // 解包后的24位像素，显示线程使用
+
+    // 每次writeLcd提交帧时调用，例如FrameRecorder录制
+    typedef void (*FrameHook)(const LcdData* frame_data);
+    static std::atomic<FrameHook> frame_hook(nullptr);
+
+    // 每种颜色深度的LCD缓冲区大小
+    // 12位：两个像素3字节 RRRRGGGG BBBBRRRR GGGGBBBB
+    // 18位：每个像素3字节，每字节高6位有效
+    static int bufferSizeFor(LcdColorDepth depth) {
+        return depth == LCD_12BIT ? LCD_WIDTH * LCD_HEIGHT * 3 / 2 : LCD_WIDTH * LCD_HEIGHT * 3;
+    }
+
+    // 24位 -> LCD格式，与真机上的转换一致
+    static void packFrom24Bit(uint8_t* output, const uint8_t* input, LcdColorDepth depth) {
+        const int pixels = LCD_WIDTH * LCD_HEIGHT;
+        if (depth == LCD_12BIT) {
+            for (int i = 0; i < pixels; i += 2) {
+                const uint8_t* p0 = input + i * 3;
+                const uint8_t* p1 = p0 + 3;
+                output[0] = (p0[0] & 0xF0) | (p0[1] >> 4);
+                output[1] = (p0[2] & 0xF0) | (p1[0] >> 4);
+                output[2] = (p1[1] & 0xF0) | (p1[2] >> 4);
+                output += 3;
+            }
+        } else {
+            for (int i = 0; i < pixels * 3; ++i) {
+                output[i] = input[i] & 0xFC;
+            }
+        }
+    }
+
+    // LCD格式 -> 24位，显示量化后的真实颜色
+    static void unpackTo24Bit(uint8_t* output, const uint8_t* input, LcdColorDepth depth) {
+        const int pixels = LCD_WIDTH * LCD_HEIGHT;
+        if (depth == LCD_12BIT) {
+            for (int i = 0; i < pixels; i += 2) {
+                uint8_t n[6] = {
+                    (uint8_t)(input[0] >> 4), (uint8_t)(input[0] & 0x0F),
+                    (uint8_t)(input[1] >> 4), (uint8_t)(input[1] & 0x0F),
+                    (uint8_t)(input[2] >> 4), (uint8_t)(input[2] & 0x0F),
+                };
+                for (int c = 0; c < 6; ++c) {
+                    output[c] = (uint8_t)((n[c] << 4) | n[c]);
+                }
+                input += 3;
+                output += 6;
+            }
+        } else {
+            for (int i = 0; i < pixels * 3; ++i) {
+                output[i] = (uint8_t)((input[i] & 0xFC) | (input[i] >> 6));
+            }
+        }
+    }
     
-    // 初始化SDL2
+    // 初始化SDL2（在显示线程中调用，所有SDL调用都在同一线程）
     static bool initSDL() {
         if (sdl_initialized) return true;
         
@@ -65,19 +145,20 @@ namespace LcdControl
             return false;
         }
         
-        // 创建窗口，缩小到1/8大小并在屏幕右下角显示
-        int window_width = LCD_WIDTH / 4;   // 240/4 = 60
-        int window_height = LCD_HEIGHT / 4; // 240/4 = 60
+        // 两个屏幕左右并排，缩小到1/4大小并在屏幕右下角显示
+        int window_width = LCD_WIDTH / 4 * 2;   // 左右眼各 240/4 = 60
+        int window_height = LCD_HEIGHT / 4;     // 240/4 = 60
         
-        // 获取屏幕尺寸
+        // 获取屏幕尺寸和刷新率
         SDL_DisplayMode DM;
         SDL_GetCurrentDisplayMode(0, &DM);
         int screen_width = DM.w;
         int screen_height = DM.h;
+        present_stats.refresh_rate = DM.refresh_rate > 0 ? DM.refresh_rate : 60;
         
         // 计算右下角位置
-        int window_x = screen_width - window_width - 80;  // 距离右边缘20像素
-        int window_y = screen_height - window_height - 80; // 距离下边缘20像素
+        int window_x = screen_width - window_width - 80;  // 距离右边缘80像素
+        int window_y = screen_height - window_height - 80; // 距离下边缘80像素
         
         window = SDL_CreateWindow("LCD Eye Demo (X86 Simulated)", 
                                 window_x, window_y,
@@ -88,17 +169,20 @@ namespace LcdControl
             return false;
         }
         
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        // 垂直同步只阻塞显示线程，不影响writeLcd
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
         if (!renderer) {
             LOG_ERROR("Renderer could not be created! SDL_Error: " << SDL_GetError());
             return false;
         }
         
-        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, 
-                                  SDL_TEXTUREACCESS_STREAMING, LCD_WIDTH, LCD_HEIGHT);
-        if (!texture) {
-            LOG_ERROR("Texture could not be created! SDL_Error: " << SDL_GetError());
-            return false;
+        for (int side = 0; side < 2; ++side) {
+            textures[side] = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24,
+                                             SDL_TEXTUREACCESS_STREAMING, LCD_WIDTH, LCD_HEIGHT);
+            if (!textures[side]) {
+                LOG_ERROR("Texture could not be created! SDL_Error: " << SDL_GetError());
+                return false;
+            }
         }
         
         sdl_initialized = true;
@@ -108,9 +192,11 @@ namespace LcdControl
     
     // 清理SDL2资源
     static void cleanupSDL() {
-        if (texture) {
-            SDL_DestroyTexture(texture);
-            texture = nullptr;
+        for (int side = 0; side < 2; ++side) {
+            if (textures[side]) {
+                SDL_DestroyTexture(textures[side]);
+                textures[side] = nullptr;
+            }
         }
         if (renderer) {
             SDL_DestroyRenderer(renderer);
@@ -125,7 +211,81 @@ namespace LcdControl
             sdl_initialized = false;
         }
     }
+
+    // 把一帧转换成纹理格式
+    static void presentFrameToTexture(int side) {
+        unpackTo24Bit(texture_rgb.data(), presenting[side].data(), current_depth);
+        SDL_UpdateTexture(textures[side], nullptr, texture_rgb.data(), LCD_WIDTH * 3);
+    }
+
+    // 显示线程：按主机刷新率显示最新的帧，与writeLcd完全解耦
+    static void presentLoop() {
+        if (!initSDL()) {
+            cleanupSDL();
+            sdl_init_state.store(-1);
+            return;
+        }
+        sdl_init_state.store(1);
+
+        auto frame_period = std::chrono::microseconds(1000000 / present_stats.refresh_rate);
+        auto next = std::chrono::steady_clock::now();
+        while (present_running.load()) {
+            bool changed = false;
+            {
+                std::lock_guard<std::mutex> lock(staging_mutex);
+                for (int side = 0; side < 2; ++side) {
+                    if (!staging_dirty[side]) continue;
+                    presenting[side].swap(staging[side]);
+                    staging_dirty[side] = false;
+                    changed = true;
+                }
+            }
+
+            if (changed) {
+                for (int side = 0; side < 2; ++side) {
+                    if (!presenting[side].empty()) presentFrameToTexture(side);
+                }
+                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+                SDL_RenderClear(renderer);
+                
+                // 左眼在左半边，右眼在右半边
+                int current_width, current_height;
+                SDL_GetWindowSize(window, &current_width, &current_height);
+                for (int side = 0; side < 2; ++side) {
+                    SDL_Rect dest_rect = { side * current_width / 2, 0, current_width / 2, current_height };
+                    SDL_RenderCopy(renderer, textures[side], nullptr, &dest_rect);
+                }
+                SDL_RenderPresent(renderer);
+                std::lock_guard<std::mutex> lock(staging_mutex);
+                present_stats.presents++;
+            }
+            
+            // 处理SDL事件（保持窗口响应），关闭窗口由writeLcd所在线程退出程序
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {
+                if (event.type == SDL_QUIT) {
+                    quit_requested.store(true);
+                }
+            }
+
+            // 没有垂直同步时按刷新率节拍等待
+            next += frame_period;
+            auto now = std::chrono::steady_clock::now();
+            if (next < now) next = now;
+            std::this_thread::sleep_until(next);
+        }
+        cleanupSDL();
+    }
     
+    // 程序退出时如果没有调用release()，停止显示线程
+    static struct PresentThreadGuard
+    {
+        ~PresentThreadGuard() {
+            present_running.store(false);
+            if (present_thread.joinable()) present_thread.join();
+        }
+    } present_thread_guard;
+
     // Initialize lcd - 模拟初始化
     inline int8_t init(LcdColorDepth depth = LCD_12BIT) {
         if (lcd_initialized) {
@@ -133,14 +293,30 @@ namespace LcdControl
             return 1;
         }
         
-        // 初始化SDL2
-        if (!initSDL()) {
+        // 启动显示线程，SDL2在显示线程中初始化
+        current_depth = depth;
+        for (int side = 0; side < 2; ++side) {
+            staging[side].assign(bufferSizeFor(depth), 0);
+            presenting[side].assign(bufferSizeFor(depth), 0);
+            staging_dirty[side] = false;
+        }
+        texture_rgb.assign(LCD_WIDTH * LCD_HEIGHT * 3, 0);
+        present_stats = {};
+        quit_requested.store(false);
+        sdl_init_state.store(0);
+        present_running.store(true);
+        present_thread = std::thread(presentLoop);
+        while (sdl_init_state.load() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (sdl_init_state.load() < 0) {
+            present_running.store(false);
+            present_thread.join();
             LOG_ERROR("Failed to initialize SDL2!");
             return -1;
         }
         
         lcd_initialized = true;
-        current_depth = depth;
         LOG_INFO("LCD initialized successfully! (Simulated with SDL2 display)");
         LOG_INFO("Color depth: " << (depth == LCD_12BIT ? "12-bit" : "18-bit"));
         return 0;
@@ -154,7 +330,8 @@ namespace LcdControl
         }
         
         lcd_initialized = false;
-        cleanupSDL();
+        present_running.store(false);
+        if (present_thread.joinable()) present_thread.join();
         LOG_INFO("LCD released successfully! (Simulated)");
         return 0;
     }
@@ -172,51 +349,116 @@ namespace LcdControl
         }
         
         LOG_DEBUG("Filling LCD with RGB(" << (int)R << "," << (int)G << "," << (int)B << ")");
+        
+        if (side <= LcdRight) {
+            std::vector<uint8_t> rgb(LCD_WIDTH * LCD_HEIGHT * 3);
+            for (size_t i = 0; i < rgb.size(); i += 3) {
+                rgb[i] = R;
+                rgb[i + 1] = G;
+                rgb[i + 2] = B;
+            }
+            std::lock_guard<std::mutex> lock(staging_mutex);
+            packFrom24Bit(staging[side].data(), rgb.data(), current_depth);
+            staging_dirty[side] = true;
+        }
     }
 
-    // write buffer data to lcd - 模拟写入数据，并显示到SDL窗口
+    // 复制到暂存缓冲区并按SPI时钟阻塞传输时间，'complete' = 整帧已写完
+    // SPI总线同一时间只能传一个窗口，每个窗口有命令开销
+    static void transfer(const LcdData* frame_data, int offset, int bytes, bool complete) {
+        std::lock_guard<std::mutex> spi_lock(spi_mutex);
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(staging_mutex);
+            std::memcpy(staging[frame_data->side].data() + offset, frame_data->buffer + offset, bytes);
+            if (complete) {
+                if (staging_dirty[frame_data->side]) present_stats.overwritten++;
+                staging_dirty[frame_data->side] = true;
+                present_stats.writes++;
+            }
+        }
+        if (spi_clock_hz > 0) {
+            uint64_t transfer_us = (uint64_t)bytes * 8 * 1000000 / spi_clock_hz + LCD_SIM_SPI_FRAME_OVERHEAD_US;
+            std::this_thread::sleep_until(start + std::chrono::microseconds(transfer_us));
+            std::lock_guard<std::mutex> lock(staging_mutex);
+            present_stats.spi_bytes += bytes;
+            present_stats.spi_busy_us += transfer_us;
+        }
+    }
+
+    // write buffer data to lcd - 模拟写入数据，只复制到暂存缓冲区，由显示线程显示
     inline int8_t writeLcd(LcdData* frame_data) {
         if (!lcd_initialized) {
             LOG_ERROR("LCD not initialized!");
             return -2;
         }
         
+        // 用户关闭窗口，停止显示线程后退出程序
+        if (quit_requested.load()) {
+            release();
+            exit(0);
+        }
+        
         LOG_DEBUG("Writing to LCD");
         
-        // 更新SDL纹理并显示
-        if (texture && frame_data->buffer) {
-            SDL_UpdateTexture(texture, nullptr, frame_data->buffer, LCD_WIDTH * 3);
-            
-            // 清空渲染器
-            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-            SDL_RenderClear(renderer);
-            
-            // 渲染纹理，缩放到当前窗口大小
-            int current_width, current_height;
-            SDL_GetWindowSize(window, &current_width, &current_height);
-            SDL_Rect dest_rect = {0, 0, current_width, current_height};
-            SDL_RenderCopy(renderer, texture, nullptr, &dest_rect);
-            
-            // 显示到屏幕
-            SDL_RenderPresent(renderer);
-            
-            // 处理SDL事件（保持窗口响应）
-            SDL_Event event;
-            while (SDL_PollEvent(&event)) {
-                if (event.type == SDL_QUIT) {
-                    // 用户关闭窗口，退出程序
-                    exit(0);
-                }
-            }
+        if (frame_data->buffer && frame_data->side <= LcdRight) {
+            FrameHook hook = frame_hook.load();
+            if (hook) hook(frame_data);
+            transfer(frame_data, 0, bufferSizeFor(current_depth), true);
         }
         
         return 0;
     }
 
+    // write rows first_row..first_row + rows - 1 of 'frame_data' - 模拟部分写入
+    // frame_data->buffer 是整帧缓冲区，只传输这些行；写到最后一行时整帧交给帧钩子
+    // return 0 success
+    // return -1 rows out of range
+    // return -2 not active
+    // return -3 window closed, called from a transfer thread: the caller makes the
+    //           render thread release and exit like writeLcd does
+    inline int8_t writeLcdRows(LcdData* frame_data, uint16_t first_row, uint16_t rows) {
+        if (!lcd_initialized) {
+            LOG_ERROR("LCD not initialized!");
+            return -2;
+        }
+        if (rows == 0 || first_row + rows > LCD_HEIGHT) return -1;
+
+        if (quit_requested.load()) return -3;
+
+        if (frame_data->buffer && frame_data->side <= LcdRight) {
+            int row_bytes = bufferSizeFor(current_depth) / LCD_HEIGHT;
+            bool last = first_row + rows == LCD_HEIGHT;
+            if (last) {
+                FrameHook hook = frame_hook.load();
+                if (hook) hook(frame_data);
+            }
+            transfer(frame_data, first_row * row_bytes, rows * row_bytes, last);
+        }
+        return 0;
+    }
+
+    // 显示统计：写入帧数、被覆盖帧数、实际显示次数
+    inline PresentStats getPresentStats() {
+        std::lock_guard<std::mutex> lock(staging_mutex);
+        return present_stats;
+    }
+
     // return lcd buffer size
     inline int getBufferSize() {
-        // 240*240*3 = 172800 bytes for 24-bit color
-        return LCD_WIDTH * LCD_HEIGHT * 3;
+        // 12位: 240*240*1.5 = 86400 bytes, 18位: 240*240*3 = 172800 bytes
+        return bufferSizeFor(current_depth);
+    }
+
+    // 设置帧提交钩子，nullptr = 取消
+    inline void setFrameHook(FrameHook hook) {
+        frame_hook.store(hook);
+    }
+
+    // 模拟SPI时钟，0 = 不模拟传输时间
+    inline void setSpiClock(uint32_t hz) {
+        std::lock_guard<std::mutex> lock(spi_mutex);
+        spi_clock_hz = hz;
     }
 
     // returns lcd color depth
@@ -236,12 +478,9 @@ namespace LcdControl
         return 0;
     }
 
-    // converts 24 bit image to lcd image depth - 模拟转换
+    // converts 24 bit image to lcd image depth - 与真机一样按颜色深度打包
     inline void LcdBufferFrom24Bit(uint8_t* output, uint8_t* input) {
-        // 在模拟环境中，我们直接复制数据
-        // 在实际ARM环境中，这里会进行颜色深度转换
-        int buffer_size = LCD_WIDTH * LCD_HEIGHT * 3;
-        std::memcpy(output, input, buffer_size);
+        packFrom24Bit(output, input, current_depth);
         LOG_DEBUG("Converted 24-bit buffer to LCD format");
     }
 };
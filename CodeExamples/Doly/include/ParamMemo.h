@@ -0,0 +1,124 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <memory>
+#include <vector>
+
+// Memoization of sub-images by quantized expression parameters.
+//
+// Continuous parameters (anger level, blink progress, ...) are rounded to one
+// of 'steps' levels with quantize(), a drawing then only depends on the step.
+// Pieces built from a step (a pupil image, an eyelid mask) are kept in a
+// Table and reused the next time the step comes up, also as frame keys the
+// steps repeat so FramePacer and FrameCache see the same frame again.
+// All tables share one memory budget (setBudget), a piece that does not fit is
+// built into the table's scratch entry and not kept.
+//
+//   static ParamMemo::Table<PupilImage> pupils(20);
+//   int step = ParamMemo::quantize(anger_level, pupils.steps());
+//   const PupilImage& image = pupils.get(step, [&](PupilImage& p) { build(p, ParamMemo::level(step, 20)); });
+//
+// T must have 'size_t bytes() const'. Tables are used by one thread (the render thread).
+
+#define PARAM_MEMO_DEFAULT_STEPS 20
+#define PARAM_MEMO_DEFAULT_KB 3072
+
+namespace ParamMemo
+{
+    struct MemoStats
+    {
+        uint64_t hits;
+        uint64_t misses;        // pieces built
+        uint64_t refused;       // built but not kept, budget full
+        uint32_t entries;
+        size_t bytes;           // kept pieces
+        size_t budget_bytes;
+    };
+
+    static MemoStats memo_stats = { 0, 0, 0, 0, 0, (size_t)PARAM_MEMO_DEFAULT_KB * 1024 };
+
+    // 'value' in 0..1 -> step 0..steps, nearest level
+    inline int quantize(float value, int steps) {
+        if (!(value > 0.0f)) return 0;
+        if (value >= 1.0f) return steps;
+        return (int)lroundf(value * steps);
+    }
+
+    // step -> value in 0..1
+    inline float level(int step, int steps) {
+        return steps > 0 ? (float)step / steps : 0.0f;
+    }
+
+    // memory kept by all tables, pieces already kept stay when lowered
+    inline void setBudget(size_t kb) {
+        memo_stats.budget_bytes = kb * 1024;
+    }
+
+    inline MemoStats getStats() {
+        return memo_stats;
+    }
+
+    inline void resetStats() {
+        memo_stats.hits = memo_stats.misses = memo_stats.refused = 0;
+    }
+
+    template <class T>
+    class Table
+    {
+    public:
+        explicit Table(int steps = PARAM_MEMO_DEFAULT_STEPS) : step_count(steps), entries(steps + 1) {}
+        ~Table() { clear(); }
+        Table(const Table&) = delete;
+        Table& operator=(const Table&) = delete;
+
+        int steps() const { return step_count; }
+
+        // drop all pieces and use 'steps' levels from now on
+        void setSteps(int steps) {
+            clear();
+            step_count = steps;
+            entries.resize(steps + 1);
+        }
+
+        // piece of 'step', 'build(T&)' fills a new one on the first use
+        // the reference is valid until clear(), or until the next get() if the budget was full
+        template <class Builder>
+        const T& get(int step, Builder build) {
+            if (step < 0) step = 0;
+            if (step > step_count) step = step_count;
+            std::unique_ptr<T>& entry = entries[step];
+            if (entry) {
+                memo_stats.hits++;
+                return *entry;
+            }
+            memo_stats.misses++;
+            std::unique_ptr<T> piece(new T());
+            build(*piece);
+            size_t size = piece->bytes();
+            if (memo_stats.bytes + size > memo_stats.budget_bytes) {
+                memo_stats.refused++;
+                scratch = std::move(piece);
+                return *scratch;
+            }
+            memo_stats.bytes += size;
+            memo_stats.entries++;
+            entry = std::move(piece);
+            return *entry;
+        }
+
+        void clear() {
+            for (std::unique_ptr<T>& entry : entries) {
+                if (!entry) continue;
+                memo_stats.bytes -= entry->bytes();
+                memo_stats.entries--;
+                entry.reset();
+            }
+            scratch.reset();
+        }
+
+    private:
+        int step_count;
+        std::vector<std::unique_ptr<T>> entries;    // by step
+        std::unique_ptr<T> scratch;
+    };
+};
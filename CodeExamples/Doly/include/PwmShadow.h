@@ -0,0 +1,331 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#ifndef DOLY_X86_SIM_GPIO
+#include "Gpio.h"
+#endif
+
+// Shadow register cache in front of the PWM controller (PCA9685) i2c bus.
+//
+// Writes are staged into a 256 byte copy of the controller registers.
+// Writes that match the shadow are dropped, staged writes are sent by flush()
+// as auto-increment bursts, so call flush() once per control tick.
+//
+// Only route channels you own through this layer (e.g. LEDs). Servo channels
+// are written by libServoMotor directly, call invalidate() if you share them.
+
+// PCA9685 registers
+#define PWM_REG_MODE1     0x00
+#define PWM_REG_MODE2     0x01
+#define PWM_REG_LED0      0x06  // LEDn_ON_L = 0x06 + 4 * n
+#define PWM_REG_PRESCALE  0xFE
+
+#define PWM_MODE1_RESTART 0x80
+#define PWM_MODE1_AI      0x20
+#define PWM_MODE1_SLEEP   0x10
+
+#define PWM_CHANNEL_COUNT 16
+#define PWM_OSC_CLOCK     25000000
+
+namespace PwmShadow
+{
+    // bus backend, one call = one i2c transaction
+    // return 0 success
+    // return -1 bus error
+    typedef int8_t (*BusWrite)(uint8_t reg, const uint8_t* data, uint8_t len);
+    typedef int8_t (*BusRead)(uint8_t reg, uint8_t* data, uint8_t len);
+
+    struct BusStats
+    {
+        uint64_t requested;     // register writes requested by callers
+        uint64_t suppressed;    // register writes dropped, shadow already matched
+        uint64_t transactions;  // i2c write transactions sent
+        uint64_t bytes;         // bytes sent including register address
+        uint64_t flushes;       // flush() calls that sent at least one burst
+    };
+
+    // clean registers bridged inside a burst instead of starting a new transaction,
+    // a new transaction costs address + register byte, start/stop and a syscall,
+    // so resending up to 3 known bytes is cheaper (covers OFF_L -> next OFF_L of a channel bank)
+    static const uint8_t MAX_BRIDGE_GAP = 3;
+    // longest burst, i2c-dev and the controller are fine with a full channel bank
+    static const uint8_t MAX_BURST = 64;
+
+    static std::mutex shadow_mutex;
+    static uint8_t shadow[256];     // last value sent to the controller
+    static bool valid[256];         // shadow matches the controller
+    static uint8_t pending[256];    // staged value, sent on flush()
+    static bool dirty[256];
+    static uint16_t dirty_count = 0;
+
+    static BusWrite bus_write = nullptr;
+    static BusRead bus_read = nullptr;
+    static int bus_fd = -1;
+    static BusStats stats = {};
+
+    static int8_t i2cWrite(uint8_t reg, const uint8_t* data, uint8_t len) {
+        uint8_t buf[MAX_BURST + 1];
+        buf[0] = reg;
+        memcpy(buf + 1, data, len);
+        return (::write(bus_fd, buf, len + 1) == len + 1) ? 0 : -1;
+    }
+
+    static int8_t i2cRead(uint8_t reg, uint8_t* data, uint8_t len) {
+        if (::write(bus_fd, &reg, 1) != 1) return -1;
+        return (::read(bus_fd, data, len) == len) ? 0 : -1;
+    }
+
+    // send one transaction and keep shadow in sync, lock must be held
+    static int8_t send(uint8_t reg, const uint8_t* data, uint8_t len) {
+        if (!bus_write) return -1;
+        if (bus_write(reg, data, len) < 0) return -1;
+        stats.transactions++;
+        stats.bytes += len + 1;
+        for (uint8_t i = 0; i < len; i++) {
+            uint8_t r = reg + i;
+            shadow[r] = data[i];
+            valid[r] = true;
+            if (dirty[r]) {
+                dirty[r] = false;
+                dirty_count--;
+            }
+        }
+        return 0;
+    }
+
+    static void stage(uint8_t reg, uint8_t value) {
+        stats.requested++;
+        if (valid[reg] && shadow[reg] == value) {
+            if (dirty[reg]) {
+                // a staged value was reverted before flush, nothing to send anymore
+                dirty[reg] = false;
+                dirty_count--;
+            }
+            stats.suppressed++;
+            return;
+        }
+        if (!dirty[reg]) {
+            dirty[reg] = true;
+            dirty_count++;
+        }
+        pending[reg] = value;
+    }
+
+    static int8_t flushLocked() {
+        if (dirty_count == 0) return 0;
+
+        int8_t result = 0;
+        int reg = 0;
+        while (reg < 256) {
+            if (!dirty[reg]) {
+                reg++;
+                continue;
+            }
+            // grow burst over dirty registers, bridging short gaps of known registers
+            int start = reg;
+            int end = reg;
+            int scan = reg + 1;
+            while (scan < 256 && scan - start < MAX_BURST) {
+                if (dirty[scan]) {
+                    end = scan;
+                    scan++;
+                    continue;
+                }
+                int gap = 0;
+                while (scan + gap < 256 && !dirty[scan + gap] && valid[scan + gap] && gap <= MAX_BRIDGE_GAP) gap++;
+                if (gap > MAX_BRIDGE_GAP || scan + gap >= 256 || !dirty[scan + gap] || scan + gap - start >= MAX_BURST) break;
+                scan += gap;
+            }
+            uint8_t len = (uint8_t)(end - start + 1);
+            uint8_t data[MAX_BURST];
+            for (uint8_t i = 0; i < len; i++) {
+                data[i] = dirty[start + i] ? pending[start + i] : shadow[start + i];
+            }
+            if (send((uint8_t)start, data, len) < 0) result = -1;
+            reg = end + 1;
+        }
+        stats.flushes++;
+        return result;
+    }
+
+    static int8_t setup() {
+        memset(shadow, 0, sizeof(shadow));
+        memset(valid, 0, sizeof(valid));
+        memset(pending, 0, sizeof(pending));
+        memset(dirty, 0, sizeof(dirty));
+        dirty_count = 0;
+        stats = {};
+
+        // auto increment is required for bursts
+        uint8_t mode1 = 0;
+        if (bus_read && bus_read(PWM_REG_MODE1, &mode1, 1) == 0) {
+            shadow[PWM_REG_MODE1] = mode1;
+            valid[PWM_REG_MODE1] = true;
+            uint8_t prescale = 0;
+            if (bus_read(PWM_REG_PRESCALE, &prescale, 1) == 0) {
+                shadow[PWM_REG_PRESCALE] = prescale;
+                valid[PWM_REG_PRESCALE] = true;
+            }
+        }
+        if (!(mode1 & PWM_MODE1_AI) || !valid[PWM_REG_MODE1]) {
+            mode1 = (uint8_t)((mode1 | PWM_MODE1_AI) & ~PWM_MODE1_RESTART);
+            if (send(PWM_REG_MODE1, &mode1, 1) < 0) return -1;
+        }
+        return 0;
+    }
+
+    // attach to the controller i2c device, e.g. GPIO::pwm_i2c_fd after GPIO::init(PwmId)
+    // return 0 success
+    // return -1 bus error
+    inline int8_t init(int i2c_fd) {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        bus_fd = i2c_fd;
+        bus_write = i2cWrite;
+        bus_read = i2cRead;
+        return setup();
+    }
+
+    // attach to a custom backend (simulator, bus analyzer)
+    // 'read' is optional, without it the shadow starts empty
+    // return 0 success
+    // return -1 bus error
+    inline int8_t init(BusWrite write, BusRead read = nullptr) {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        bus_fd = -1;
+        bus_write = write;
+        bus_read = read;
+        return setup();
+    }
+
+    // stage single register write, sent on next flush()
+    inline void writeByte(uint8_t reg, uint8_t value) {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        stage(reg, value);
+    }
+
+    // stage channel on/off counts (0-4095, bit 12 = full on/off)
+    // return 0 success
+    // return -2 undefined channel
+    inline int8_t setPWM(uint8_t channel, uint16_t on, uint16_t off) {
+        if (channel >= PWM_CHANNEL_COUNT) return -2;
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        uint8_t reg = PWM_REG_LED0 + 4 * channel;
+        stage(reg, on & 0xFF);
+        stage(reg + 1, (on >> 8) & 0x1F);
+        stage(reg + 2, off & 0xFF);
+        stage(reg + 3, (off >> 8) & 0x1F);
+        return 0;
+    }
+
+    // stage duty cycle, same range as GPIO::writePwm
+    // 0 = off, >= 4095 = full on
+    // return 0 success
+    // return -2 undefined id
+    inline int8_t writePwm(PwmId id, uint16_t value) {
+        if (value >= 4095) return setPWM(id, 0x1000, 0);
+        if (value == 0) return setPWM(id, 0, 0x1000);
+        return setPWM(id, 0, value);
+    }
+
+    // send all staged writes as auto-increment bursts
+    // return 0 success
+    // return -1 bus error
+    inline int8_t flush() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        return flushLocked();
+    }
+
+    // sleep / wakeup / frequency change are ordered sequences,
+    // they flush staged writes first and go out immediately
+    // return 0 success
+    // return -1 bus error
+    inline int8_t sleep_pwm() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        if (flushLocked() < 0) return -1;
+        uint8_t mode1 = (uint8_t)((shadow[PWM_REG_MODE1] | PWM_MODE1_SLEEP) & ~PWM_MODE1_RESTART);
+        stats.requested++;
+        if (valid[PWM_REG_MODE1] && shadow[PWM_REG_MODE1] == mode1) {
+            stats.suppressed++;
+            return 0;
+        }
+        return send(PWM_REG_MODE1, &mode1, 1);
+    }
+
+    inline int8_t wakeup_pwm() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        if (flushLocked() < 0) return -1;
+        stats.requested++;
+        if (valid[PWM_REG_MODE1] && !(shadow[PWM_REG_MODE1] & PWM_MODE1_SLEEP)) {
+            stats.suppressed++;
+            return 0;
+        }
+        uint8_t mode1 = (uint8_t)(shadow[PWM_REG_MODE1] & ~(PWM_MODE1_SLEEP | PWM_MODE1_RESTART));
+        if (send(PWM_REG_MODE1, &mode1, 1) < 0) return -1;
+        // oscillator needs 500us before restart
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+        uint8_t restart = mode1 | PWM_MODE1_RESTART;
+        if (bus_write(PWM_REG_MODE1, &restart, 1) < 0) return -1;
+        stats.transactions++;
+        stats.bytes += 2;
+        return 0;
+    }
+
+    inline int8_t set_pwm_freq(uint16_t freq) {
+        if (freq == 0) return -1;
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        if (flushLocked() < 0) return -1;
+
+        int prescale_value = (int)((PWM_OSC_CLOCK / (4096.0 * freq)) + 0.5) - 1;
+        if (prescale_value < 3) prescale_value = 3;
+        if (prescale_value > 255) prescale_value = 255;
+        uint8_t prescale = (uint8_t)prescale_value;
+
+        stats.requested++;
+        if (valid[PWM_REG_PRESCALE] && shadow[PWM_REG_PRESCALE] == prescale) {
+            stats.suppressed++;
+            return 0;
+        }
+
+        // prescale is only writable while sleeping
+        uint8_t old_mode = shadow[PWM_REG_MODE1] & ~PWM_MODE1_RESTART;
+        uint8_t sleep_mode = old_mode | PWM_MODE1_SLEEP;
+        if (send(PWM_REG_MODE1, &sleep_mode, 1) < 0) return -1;
+        if (send(PWM_REG_PRESCALE, &prescale, 1) < 0) return -1;
+        if (send(PWM_REG_MODE1, &old_mode, 1) < 0) return -1;
+        if (!(old_mode & PWM_MODE1_SLEEP)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            uint8_t restart = old_mode | PWM_MODE1_RESTART;
+            if (bus_write(PWM_REG_MODE1, &restart, 1) < 0) return -1;
+            stats.transactions++;
+            stats.bytes += 2;
+        }
+        return 0;
+    }
+
+    // forget the shadow, next write of every register goes to the bus
+    // use after someone else wrote the controller (libServoMotor, GPIO::reset_pwm)
+    inline void invalidate() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        memset(valid, 0, sizeof(valid));
+    }
+
+    // returns number of registers waiting for flush()
+    inline uint16_t pendingCount() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        return dirty_count;
+    }
+
+    inline BusStats getStats() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        return stats;
+    }
+
+    inline void resetStats() {
+        std::lock_guard<std::mutex> lock(shadow_mutex);
+        stats = {};
+    }
+};
@@ -0,0 +1,756 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#ifdef RENDER_CORE_COUNT_WRITES
+#include <atomic>
+#endif
+
+// include real or x86 simulated LcdControl before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+
+// Software render core specialized at compile time on the display.
+//
+// Geometry and color depth are fixed per build, so everything derived from
+// them (row stride, buffer sizes, clip limits, the 24 bit -> panel packer) is
+// constexpr in DisplaySpec and the primitives in Canvas<Spec> compile to
+// fixed size loops. Shapes are filled as clipped horizontal spans, a pixel
+// test is done once per row instead of once per pixel. Circles of radii known
+// at compile time take their row spans from constexpr CircleSpans tables.
+//
+//   typedef RenderCore::DisplaySpec<LCD_WIDTH, LCD_HEIGHT, LCD_12BIT> Display;
+//   RenderCore::Canvas<Display> canvas(rgb_buffer);
+//   canvas.fillCircle(Display::CENTER_X, Display::CENTER_Y, 120, color);
+//   Display::pack(lcd_buffer, rgb_buffer);
+//
+// DisplayList<Spec> records opaque shapes of a frame and resolves them row by
+// row, every pixel is written once by the topmost shape covering it instead of
+// once per overlapping shape. Build with -DRENDER_CORE_COUNT_WRITES to count
+// pixel writes (RenderCore::pixelWrites) and compare both ways.
+//
+// Indexed mode: Canvas<Spec, uint8_t> and the palette overloads of
+// DisplayList::resolve write 1 byte palette indices instead of 24 bit pixels,
+// Palette<Spec>::pack expands them to the panel format through a lookup table.
+//   RenderCore::Palette<Display> palette;
+//   list.resolve(index_buffer, palette);
+//   palette.pack(lcd_buffer, index_buffer);
+
+// palette indices below are flat colors (Palette::indexOf), from here on gradient ramps (Palette::gradient)
+#define PALETTE_GRADIENT_FIRST 128
+
+namespace RenderCore
+{
+    struct Color
+    {
+        uint8_t r, g, b;
+    };
+
+    static_assert(sizeof(Color) == 3, "Color is one 24 bit pixel");
+
+#ifdef RENDER_CORE_COUNT_WRITES
+    static std::atomic<uint64_t> pixel_writes(0);
+    inline void countWrites(int pixels) { pixel_writes.fetch_add((uint64_t)pixels, std::memory_order_relaxed); }
+#else
+    inline void countWrites(int) {}
+#endif
+
+    // pixels written by Canvas and DisplayList since the last reset, 0 without RENDER_CORE_COUNT_WRITES
+    inline uint64_t pixelWrites(bool reset = false) {
+#ifdef RENDER_CORE_COUNT_WRITES
+        return reset ? pixel_writes.exchange(0) : pixel_writes.load();
+#else
+        (void)reset;
+        return 0;
+#endif
+    }
+
+    // 3 byte pixels x0..x1 inclusive from 'row', no clipping
+    inline void fillRow(uint8_t* row, int x0, int x1, const Color& color) {
+        uint8_t* p = row + x0 * 3;
+        int pixels = x1 - x0 + 1;
+        countWrites(pixels);
+        if (pixels < 32) {
+            for (int x = 0; x < pixels; x++, p += 3) {
+                p[0] = color.r;
+                p[1] = color.g;
+                p[2] = color.b;
+            }
+            return;
+        }
+        // long spans: 8 pixels by hand, then double the filled part
+        for (int i = 0; i < 24; i += 3) {
+            p[i] = color.r;
+            p[i + 1] = color.g;
+            p[i + 2] = color.b;
+        }
+        int bytes = pixels * 3;
+        int filled = 24;
+        while (filled < bytes) {
+            int n = std::min(filled, bytes - filled);
+            memcpy(p + filled, p, n);
+            filled += n;
+        }
+    }
+
+    // 1 byte palette indices x0..x1 inclusive from 'row', no clipping
+    inline void fillRow(uint8_t* row, int x0, int x1, uint8_t index) {
+        countWrites(x1 - x0 + 1);
+        memset(row + x0, index, x1 - x0 + 1);
+    }
+
+    inline void putPixel(uint8_t* p, const Color& color) {
+        p[0] = color.r;
+        p[1] = color.g;
+        p[2] = color.b;
+    }
+
+    inline void putPixel(uint8_t* p, uint8_t index) {
+        p[0] = index;
+    }
+
+    // W x H panel driven at 'Depth', render buffers are 24 bit RGB
+    template <int W, int H, LcdColorDepth Depth>
+    struct DisplaySpec
+    {
+        static_assert(W > 0 && H > 0, "empty display");
+        static_assert(Depth != LCD_12BIT || (W * H) % 2 == 0, "12 bit packs pixel pairs");
+
+        static constexpr int WIDTH = W;
+        static constexpr int HEIGHT = H;
+        static constexpr int CENTER_X = W / 2;
+        static constexpr int CENTER_Y = H / 2;
+        static constexpr LcdColorDepth DEPTH = Depth;
+
+        // 24 bit render buffer
+        static constexpr int PIXEL_SIZE = 3;
+        static constexpr int STRIDE = W * PIXEL_SIZE;
+        static constexpr int BUFFER_SIZE = STRIDE * H;
+
+        // panel buffer, 12 bit = 2 pixels in 3 bytes, 18 bit = 3 bytes per pixel
+        static constexpr int LCD_BUFFER_SIZE = (Depth == LCD_12BIT) ? W * H * 3 / 2 : W * H * 3;
+        // panel bytes per row, rows can be packed on their own if W is even
+        static constexpr int LCD_STRIDE = (Depth == LCD_12BIT) ? W * 3 / 2 : W * 3;
+
+        // indexed render buffer, 1 byte palette index per pixel
+        static constexpr int INDEX_STRIDE = W;
+        static constexpr int INDEX_BUFFER_SIZE = W * H;
+
+        static constexpr int offset(int x, int y) {
+            return y * STRIDE + x * PIXEL_SIZE;
+        }
+
+        static constexpr bool inside(int x, int y) {
+            return (unsigned)x < (unsigned)W && (unsigned)y < (unsigned)H;
+        }
+
+        // true if the running LcdControl uses this depth and buffer size
+        static bool matchesLcd() {
+            return LcdControl::getColorDepth() == Depth && LcdControl::getBufferSize() == LCD_BUFFER_SIZE;
+        }
+
+        // 24 bit buffer -> panel format, same output as LcdControl::LcdBufferFrom24Bit
+        static void pack(uint8_t* output, const uint8_t* input) {
+            packRows(output, input, H);
+        }
+
+        // 'rows' rows of 24 bit pixels -> panel format, 'output' at LCD_STRIDE * first row
+        static void packRows(uint8_t* output, const uint8_t* input, int rows) {
+            static_assert(Depth != LCD_12BIT || W % 2 == 0, "12 bit rows pack pixel pairs");
+            if (Depth == LCD_12BIT) {
+                // RRRRGGGG BBBBRRRR GGGGBBBB
+                for (int i = 0; i < W * rows / 2; i++) {
+                    const uint8_t* p = input + i * 6;
+                    uint8_t* o = output + i * 3;
+                    o[0] = (p[0] & 0xF0) | (p[1] >> 4);
+                    o[1] = (p[2] & 0xF0) | (p[3] >> 4);
+                    o[2] = (p[4] & 0xF0) | (p[5] >> 4);
+                }
+            } else {
+                // 6 bits per channel, MSB aligned
+                for (int i = 0; i < W * rows * 3; i++) {
+                    output[i] = input[i] & 0xFC;
+                }
+            }
+        }
+    };
+
+    // largest 'w' with w * w <= 'value', -1 for negative values
+    inline int isqrt(int value) {
+        if (value < 0) return -1;
+        int w = (int)sqrtf((float)value);
+        while (w * w > value) w--;
+        while ((w + 1) * (w + 1) <= value) w++;
+        return w;
+    }
+
+    // half width of row 'dy' of an ellipse, evaluated in float like a per pixel test, -1 = empty row
+    inline int ellipseHalf(int dy, int rx, int ry) {
+        float fy = (float)dy / ry;
+        int w = rx;
+        while (w >= 0) {
+            float fx = (float)w / rx;
+            if (fx * fx + fy * fy <= 1.0f) break;
+            w--;
+        }
+        return w;
+    }
+
+    // row half widths of one circle, half[dy + radius] = largest w with w*w + dy*dy <= radius*radius
+    struct CircleRows
+    {
+        int radius;
+        const int16_t* half;
+    };
+
+    // constexpr half width tables for every radius MinR..MaxR
+    //   static constexpr RenderCore::CircleSpans<75, 87> spans;
+    //   canvas.fillCircle(x, y, spans.get(75), color);
+    template <int MinR, int MaxR>
+    struct CircleSpans
+    {
+        static_assert(MinR >= 0 && MinR <= MaxR, "bad radius range");
+        static constexpr int COUNT = MaxR - MinR + 1;
+        static constexpr int SIZE = COUNT * (MinR + MaxR + 1);   // sum of 2r+1
+
+        int16_t half[SIZE];
+        int32_t first[COUNT];
+
+        constexpr CircleSpans() : half(), first() {
+            int index = 0;
+            for (int r = MinR; r <= MaxR; r++) {
+                first[r - MinR] = index;
+                int w = r;
+                // rows from the middle out, the width only shrinks
+                for (int dy = 0; dy <= r; dy++) {
+                    while (w * w + dy * dy > r * r) w--;
+                    half[index + r + dy] = (int16_t)w;
+                    half[index + r - dy] = (int16_t)w;
+                }
+                index += 2 * r + 1;
+            }
+        }
+
+        static constexpr bool contains(int radius) {
+            return radius >= MinR && radius <= MaxR;
+        }
+
+        constexpr CircleRows get(int radius) const {
+            return { radius, half + first[radius - MinR] };
+        }
+    };
+
+    // primitives on one render buffer of 'Spec'
+    // Ink = Color: 24 bit RGB pixels, Ink = uint8_t: palette indices (Palette<Spec>)
+    template <class Spec, class Ink = Color>
+    class Canvas
+    {
+    public:
+        static constexpr int PIXEL_SIZE = sizeof(Ink);
+        static constexpr int STRIDE = Spec::WIDTH * PIXEL_SIZE;
+        static constexpr int BUFFER_SIZE = STRIDE * Spec::HEIGHT;
+
+        explicit Canvas(uint8_t* buffer) : pixels(buffer) {}
+
+        uint8_t* data() const { return pixels; }
+
+        static constexpr int offset(int x, int y) {
+            return y * STRIDE + x * PIXEL_SIZE;
+        }
+
+        void setPixel(int x, int y, const Ink& color) {
+            if (!Spec::inside(x, y)) return;
+            putPixel(pixels + offset(x, y), color);
+            countWrites(1);
+        }
+
+        // pixels x0..x1 inclusive of row y, clipped
+        void hspan(int y, int x0, int x1, const Ink& color) {
+            if ((unsigned)y >= (unsigned)Spec::HEIGHT) return;
+            if (x0 < 0) x0 = 0;
+            if (x1 >= Spec::WIDTH) x1 = Spec::WIDTH - 1;
+            if (x0 > x1) return;
+            fillRow(pixels + offset(0, y), x0, x1, color);
+        }
+
+        // pixels y0..y1 inclusive of column x, clipped
+        void vspan(int x, int y0, int y1, const Ink& color) {
+            if ((unsigned)x >= (unsigned)Spec::WIDTH) return;
+            if (y0 < 0) y0 = 0;
+            if (y1 >= Spec::HEIGHT) y1 = Spec::HEIGHT - 1;
+            for (int y = y0; y <= y1; y++) {
+                putPixel(pixels + offset(x, y), color);
+            }
+            if (y1 >= y0) countWrites(y1 - y0 + 1);
+        }
+
+        void clear(const Ink& color) {
+            // first row by pixel, the rest copied
+            hspan(0, 0, Spec::WIDTH - 1, color);
+            for (int y = 1; y < Spec::HEIGHT; y++) {
+                memcpy(pixels + y * STRIDE, pixels, STRIDE);
+            }
+            countWrites(Spec::WIDTH * (Spec::HEIGHT - 1));
+        }
+
+        // pixels with dx*dx + dy*dy <= radius*radius
+        void fillCircle(int cx, int cy, int radius, const Ink& color) {
+            for (int dy = -radius; dy <= radius; dy++) {
+                int w = isqrt(radius * radius - dy * dy);
+                if (w >= 0) hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        // same pixels as fillCircle(cx, cy, circle.radius, color), spans from table
+        void fillCircle(int cx, int cy, const CircleRows& circle, const Ink& color) {
+            const int r = circle.radius;
+            for (int dy = -r; dy <= r; dy++) {
+                int w = circle.half[dy + r];
+                hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        // pixels with inner*inner < dx*dx + dy*dy <= outer*outer
+        void fillRing(int cx, int cy, int inner, int outer, const Ink& color) {
+            for (int dy = -outer; dy <= outer; dy++) {
+                int wo = isqrt(outer * outer - dy * dy);
+                if (wo < 0) continue;
+                int wi = isqrt(inner * inner - dy * dy);
+                if (wi < 0) {
+                    hspan(cy + dy, cx - wo, cx + wo, color);
+                } else {
+                    hspan(cy + dy, cx - wo, cx - wi - 1, color);
+                    hspan(cy + dy, cx + wi + 1, cx + wo, color);
+                }
+            }
+        }
+
+        // same pixels as fillRing(cx, cy, inner.radius, outer.radius, color)
+        void fillRing(int cx, int cy, const CircleRows& inner, const CircleRows& outer, const Ink& color) {
+            const int ri = inner.radius;
+            const int ro = outer.radius;
+            for (int dy = -ro; dy <= ro; dy++) {
+                int wo = outer.half[dy + ro];
+                if (dy < -ri || dy > ri) {
+                    hspan(cy + dy, cx - wo, cx + wo, color);
+                } else {
+                    int wi = inner.half[dy + ri];
+                    hspan(cy + dy, cx - wo, cx - wi - 1, color);
+                    hspan(cy + dy, cx + wi + 1, cx + wo, color);
+                }
+            }
+        }
+
+        // pixels with (dx/rx)^2 + (dy/ry)^2 <= 1, evaluated in float like the per pixel test
+        void fillEllipse(int cx, int cy, int rx, int ry, const Ink& color) {
+            for (int dy = -ry; dy <= ry; dy++) {
+                int w = ellipseHalf(dy, rx, ry);
+                if (w >= 0) hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        // pixels with |dx| + |dy| <= half
+        void fillDiamond(int cx, int cy, int half, const Ink& color) {
+            for (int dy = -half; dy <= half; dy++) {
+                int w = half - (dy < 0 ? -dy : dy);
+                hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        // part of fillCircle above row 'y_end' (exclusive)
+        void fillCircleTop(int cx, int cy, int radius, int y_end, const Ink& color) {
+            for (int dy = -radius; dy <= radius && cy + dy < y_end; dy++) {
+                int w = isqrt(radius * radius - dy * dy);
+                if (w >= 0) hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        void fillCircleTop(int cx, int cy, const CircleRows& circle, int y_end, const Ink& color) {
+            const int r = circle.radius;
+            for (int dy = -r; dy <= r && cy + dy < y_end; dy++) {
+                int w = circle.half[dy + r];
+                hspan(cy + dy, cx - w, cx + w, color);
+            }
+        }
+
+        // move content by (dx, dy), uncovered pixels keep their value
+        // 'scratch' must hold BUFFER_SIZE bytes
+        void shift(int dx, int dy, uint8_t* scratch) {
+            memcpy(scratch, pixels, BUFFER_SIZE);
+            int x0 = dx < 0 ? -dx : 0;
+            int x1 = dx > 0 ? Spec::WIDTH - dx : Spec::WIDTH;
+            if (x1 <= x0) return;
+            for (int y = 0; y < Spec::HEIGHT; y++) {
+                int sy = y + dy;
+                if ((unsigned)sy >= (unsigned)Spec::HEIGHT) continue;
+                memcpy(pixels + offset(x0, y), scratch + offset(x0 + dx, sy), (x1 - x0) * PIXEL_SIZE);
+            }
+        }
+
+    private:
+        uint8_t* pixels;
+    };
+
+    // 256 colors of an indexed render buffer, kept pre-converted to the panel format of 'Spec'
+    // indices 0..PALETTE_GRADIENT_FIRST - 1 are flat colors added on first use (indexOf),
+    // the rest is left for gradient ramps. Changing an entry (set) recolors every pixel
+    // using it at the next pack, without rendering again.
+    template <class Spec>
+    class Palette
+    {
+    public:
+        Palette() : flat_count(0) {
+            memset(colors, 0, sizeof(colors));
+            memset(lcd, 0, sizeof(lcd));
+        }
+
+        // index of 'color' among the flat colors, added if missing
+        // a full flat range returns the nearest flat color
+        uint8_t indexOf(const Color& color) {
+            for (int i = 0; i < flat_count; i++) {
+                if (same(colors[i], color)) return (uint8_t)i;
+            }
+            if (flat_count < PALETTE_GRADIENT_FIRST) {
+                set((uint8_t)flat_count, color);
+                return (uint8_t)flat_count++;
+            }
+            int best = 0;
+            int best_distance = 3 * 256 * 256;
+            for (int i = 0; i < flat_count; i++) {
+                int dr = colors[i].r - color.r, dg = colors[i].g - color.g, db = colors[i].b - color.b;
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = i;
+                }
+            }
+            return (uint8_t)best;
+        }
+
+        // new flat entry, also when 'color' is already in the palette (an entry to animate with set)
+        // return PALETTE_GRADIENT_FIRST - 1 when the flat range is full, shared with later reserves
+        uint8_t reserve(const Color& color) {
+            uint8_t index = (uint8_t)std::min(flat_count, PALETTE_GRADIENT_FIRST - 1);
+            if (flat_count < PALETTE_GRADIENT_FIRST) flat_count++;
+            set(index, color);
+            return index;
+        }
+
+        void set(uint8_t index, const Color& color) {
+            colors[index] = color;
+            uint8_t* e = lcd[index];
+            if (Spec::DEPTH == LCD_12BIT) {
+                // 12 bit value RRRRGGGGBBBB, two of them make the 3 packed bytes
+                uint16_t v = (uint16_t)(((color.r & 0xF0) << 4) | (color.g & 0xF0) | (color.b >> 4));
+                memcpy(e, &v, sizeof(v));
+            } else {
+                e[0] = color.r & 0xFC;
+                e[1] = color.g & 0xFC;
+                e[2] = color.b & 0xFC;
+            }
+        }
+
+        const Color& color(uint8_t index) const { return colors[index]; }
+
+        // linear ramp 'from' .. 'to' in 'count' entries starting at 'first', clipped at 255
+        void gradient(int first, int count, const Color& from, const Color& to) {
+            for (int i = 0; i < count && first + i < 256; i++) {
+                float t = count > 1 ? (float)i / (count - 1) : 0.0f;
+                Color c;
+                c.r = (uint8_t)(from.r + (to.r - from.r) * t + 0.5f);
+                c.g = (uint8_t)(from.g + (to.g - from.g) * t + 0.5f);
+                c.b = (uint8_t)(from.b + (to.b - from.b) * t + 0.5f);
+                set((uint8_t)(first + i), c);
+            }
+        }
+
+        // indexed buffer -> panel format
+        void pack(uint8_t* output, const uint8_t* indices) const {
+            packRows(output, indices, Spec::HEIGHT);
+        }
+
+        // 'rows' rows of palette indices -> panel format, 'output' at LCD_STRIDE * first row
+        // one table load per pixel, no per channel shifts and masks
+        void packRows(uint8_t* output, const uint8_t* indices, int rows) const {
+            const int pixels = Spec::WIDTH * rows;
+            if (Spec::DEPTH == LCD_12BIT) {
+                // 4 pixels -> 6 bytes per step, W is even
+                int i = 0;
+                uint8_t* o = output;
+                for (; i + 4 <= pixels; i += 4, o += 6) {
+                    uint32_t a = (uint32_t)entry12(indices[i]) << 12 | entry12(indices[i + 1]);
+                    uint32_t b = (uint32_t)entry12(indices[i + 2]) << 12 | entry12(indices[i + 3]);
+                    o[0] = (uint8_t)(a >> 16);
+                    o[1] = (uint8_t)(a >> 8);
+                    o[2] = (uint8_t)a;
+                    o[3] = (uint8_t)(b >> 16);
+                    o[4] = (uint8_t)(b >> 8);
+                    o[5] = (uint8_t)b;
+                }
+                for (; i < pixels; i += 2, o += 3) {
+                    uint32_t a = (uint32_t)entry12(indices[i]) << 12 | entry12(indices[i + 1]);
+                    o[0] = (uint8_t)(a >> 16);
+                    o[1] = (uint8_t)(a >> 8);
+                    o[2] = (uint8_t)a;
+                }
+            } else {
+                // 4 byte stores overlapping the next pixel, the last pixel is stored with 3
+                uint8_t* o = output;
+                for (int i = 0; i < pixels - 1; i++, o += 3) {
+                    memcpy(o, lcd[indices[i]], 4);
+                }
+                if (pixels > 0) memcpy(o, lcd[indices[pixels - 1]], 3);
+            }
+        }
+
+    private:
+        static bool same(const Color& a, const Color& b) {
+            return a.r == b.r && a.g == b.g && a.b == b.b;
+        }
+
+        uint16_t entry12(uint8_t index) const {
+            uint16_t v;
+            memcpy(&v, lcd[index], sizeof(v));
+            return v;
+        }
+
+        Color colors[256];
+        uint8_t lcd[256][4];    // 12 bit: uint16_t RRRRGGGGBBBB, 18 bit: 3 panel bytes
+        int flat_count;
+    };
+
+    // retained opaque shapes of one frame, later shapes are on top
+    //   RenderCore::DisplayList<Display> list;
+    //   list.fill(black); list.circle(x, y, spans.get(120), white); list.ring(...);
+    //   list.resolve(rgb_buffer);     // each covered pixel written once
+    //   list.resolve(index_buffer, palette);   // same as palette indices
+    // add functions return false when 'Capacity' shapes are recorded, the shape is dropped
+    template <class Spec, int Capacity = 16>
+    class DisplayList
+    {
+    public:
+        DisplayList() : count(0) {}
+
+        void reset() { count = 0; }
+        int size() const { return count; }
+
+        // whole buffer, usually the first shape
+        bool fill(const Color& color) {
+            return add(FILL, color, 0, 0, 0, 0, 0, Spec::HEIGHT - 1, nullptr, nullptr);
+        }
+
+        bool circle(int cx, int cy, int radius, const Color& color) {
+            return add(CIRCLE, color, cx, cy, radius, 0, cy - radius, cy + radius, nullptr, nullptr);
+        }
+
+        bool circle(int cx, int cy, const CircleRows& rows, const Color& color) {
+            return add(CIRCLE, color, cx, cy, rows.radius, 0, cy - rows.radius, cy + rows.radius, rows.half, nullptr);
+        }
+
+        bool ring(int cx, int cy, int inner, int outer, const Color& color) {
+            return add(RING, color, cx, cy, outer, inner, cy - outer, cy + outer, nullptr, nullptr);
+        }
+
+        bool ring(int cx, int cy, const CircleRows& inner, const CircleRows& outer, const Color& color) {
+            return add(RING, color, cx, cy, outer.radius, inner.radius, cy - outer.radius, cy + outer.radius,
+                       outer.half, inner.half);
+        }
+
+        // part of circle above row 'y_end' (exclusive)
+        bool circleTop(int cx, int cy, const CircleRows& rows, int y_end, const Color& color) {
+            return add(CIRCLE, color, cx, cy, rows.radius, 0, cy - rows.radius, std::min(cy + rows.radius, y_end - 1),
+                       rows.half, nullptr);
+        }
+
+        bool ellipse(int cx, int cy, int rx, int ry, const Color& color) {
+            return add(ELLIPSE, color, cx, cy, rx, ry, cy - ry, cy + ry, nullptr, nullptr);
+        }
+
+        bool diamond(int cx, int cy, int half, const Color& color) {
+            return add(DIAMOND, color, cx, cy, half, 0, cy - half, cy + half, nullptr, nullptr);
+        }
+
+        bool hspan(int y, int x0, int x1, const Color& color) {
+            return add(HSPAN, color, x0, y, x1, 0, y, y, nullptr, nullptr);
+        }
+
+        // one span per row y0..y1, 'rows' = x0, x1 of each row (x0 > x1 empty), kept by the caller
+        bool spans(int y0, int y1, const int16_t* rows, const Color& color) {
+            return add(SPANS, color, 0, y0, 0, 0, y0, y1, rows, nullptr);
+        }
+
+        // draw back to front like the equivalent Canvas calls, for reference and overdraw counts
+        void paint(uint8_t* buffer) const {
+            for (int i = 0; i < count; i++) {
+                const Shape& s = shapes[i];
+                for (int y = std::max(s.y0, 0); y <= std::min(s.y1, Spec::HEIGHT - 1); y++) {
+                    Span spans[2];
+                    int n = rowSpans(s, y, spans);
+                    for (int k = 0; k < n; k++) {
+                        int x0 = std::max(spans[k].x0, 0);
+                        int x1 = std::min(spans[k].x1, Spec::WIDTH - 1);
+                        if (x0 <= x1) fillRow(buffer + Spec::offset(0, y), x0, x1, s.color);
+                    }
+                }
+            }
+        }
+
+        // same pixels as paint(), each row resolved front to back: a shape only
+        // writes the parts of its spans no shape above it has covered
+        void resolve(uint8_t* buffer) const {
+            resolveRows(buffer, 0, Spec::HEIGHT);
+        }
+
+        // rows first_row..first_row + rows - 1 only, row 'first_row' at 'band' (band rendering)
+        void resolveRows(uint8_t* band, int first_row, int rows) const {
+            Color inks[Capacity];
+            for (int i = 0; i < count; i++) inks[i] = shapes[i].color;
+            resolveInks(band, first_row, rows, inks);
+        }
+
+        // indexed: 1 byte per pixel, shape colors looked up (or added) in 'palette' once per call
+        void resolve(uint8_t* indices, Palette<Spec>& palette) const {
+            resolveRows(indices, 0, Spec::HEIGHT, palette);
+        }
+
+        void resolveRows(uint8_t* band, int first_row, int rows, Palette<Spec>& palette) const {
+            uint8_t inks[Capacity];
+            for (int i = 0; i < count; i++) inks[i] = palette.indexOf(shapes[i].color);
+            resolveInks(band, first_row, rows, inks);
+        }
+
+    private:
+        template <class Ink>
+        void resolveInks(uint8_t* band, int first_row, int rows, const Ink* inks) const {
+            for (int y = first_row; y < first_row + rows; y++) {
+                uint8_t* row = band + (y - first_row) * Spec::WIDTH * (int)sizeof(Ink);
+                // uncovered parts of the row, sorted
+                Span open[2 * Capacity + 2];
+                int open_count = 1;
+                open[0] = { 0, Spec::WIDTH - 1 };
+
+                for (int i = count - 1; i >= 0 && open_count > 0; i--) {
+                    const Shape& s = shapes[i];
+                    if (y < s.y0 || y > s.y1) continue;
+                    Span spans[2];
+                    int n = rowSpans(s, y, spans);
+                    for (int k = 0; k < n; k++) {
+                        open_count = cover(open, open_count, spans[k], row, inks[i]);
+                    }
+                }
+            }
+        }
+
+        enum Kind : uint8_t { FILL, CIRCLE, RING, ELLIPSE, DIAMOND, HSPAN, SPANS };
+
+        struct Span
+        {
+            int x0, x1;
+        };
+
+        struct Shape
+        {
+            Kind kind;
+            Color color;
+            int x, y;           // center, HSPAN: x0, y, SPANS: 0, y0
+            int a, b;           // CIRCLE: radius, RING: outer, inner, ELLIPSE: rx, ry, DIAMOND: half, HSPAN: x1
+            int y0, y1;         // covered rows
+            const int16_t* rows;        // half width table of radius 'a' or null, SPANS: x0, x1 per row
+            const int16_t* inner_rows;  // RING: table of radius 'b' or null
+        };
+
+        bool add(Kind kind, const Color& color, int x, int y, int a, int b, int y0, int y1,
+                 const int16_t* rows, const int16_t* inner_rows) {
+            if (count >= Capacity) return false;
+            shapes[count++] = { kind, color, x, y, a, b, y0, y1, rows, inner_rows };
+            return true;
+        }
+
+        static int circleHalf(int radius, const int16_t* rows, int dy) {
+            if (dy < -radius || dy > radius) return -1;
+            return rows ? rows[dy + radius] : isqrt(radius * radius - dy * dy);
+        }
+
+        // spans of 's' on row 'y' (inside y0..y1), unclipped, returns count 0..2
+        static int rowSpans(const Shape& s, int y, Span* out) {
+            int dy = y - s.y;
+            int w;
+            switch (s.kind) {
+            case FILL:
+                out[0] = { 0, Spec::WIDTH - 1 };
+                return 1;
+            case CIRCLE:
+                w = circleHalf(s.a, s.rows, dy);
+                if (w < 0) return 0;
+                out[0] = { s.x - w, s.x + w };
+                return 1;
+            case RING: {
+                int wo = circleHalf(s.a, s.rows, dy);
+                if (wo < 0) return 0;
+                int wi = circleHalf(s.b, s.inner_rows, dy);
+                if (wi < 0) {
+                    out[0] = { s.x - wo, s.x + wo };
+                    return 1;
+                }
+                out[0] = { s.x - wo, s.x - wi - 1 };
+                out[1] = { s.x + wi + 1, s.x + wo };
+                return 2;
+            }
+            case ELLIPSE:
+                w = ellipseHalf(dy, s.a, s.b);
+                if (w < 0) return 0;
+                out[0] = { s.x - w, s.x + w };
+                return 1;
+            case DIAMOND:
+                w = s.a - (dy < 0 ? -dy : dy);
+                out[0] = { s.x - w, s.x + w };
+                return 1;
+            case HSPAN:
+                out[0] = { s.x, s.a };
+                return 1;
+            case SPANS:
+                out[0] = { s.rows[dy * 2], s.rows[dy * 2 + 1] };
+                return 1;
+            }
+            return 0;
+        }
+
+        // write the part of 'span' inside 'open' spans and remove it from them
+        template <class Ink>
+        static int cover(Span* open, int open_count, Span span, uint8_t* row, const Ink& color) {
+            if (span.x0 > span.x1) return open_count;
+            for (int i = 0; i < open_count; i++) {
+                Span& o = open[i];
+                if (o.x1 < span.x0) continue;
+                if (o.x0 > span.x1) break;      // sorted, nothing further overlaps
+                int x0 = std::max(o.x0, span.x0);
+                int x1 = std::min(o.x1, span.x1);
+                fillRow(row, x0, x1, color);
+                bool left = o.x0 < x0;
+                bool right = x1 < o.x1;
+                if (left && right) {
+                    // split in two
+                    memmove(open + i + 2, open + i + 1, (open_count - i - 1) * sizeof(Span));
+                    open[i + 1] = { x1 + 1, o.x1 };
+                    o.x1 = x0 - 1;
+                    return open_count + 1;
+                }
+                if (left) {
+                    o.x1 = x0 - 1;
+                } else if (right) {
+                    o.x0 = x1 + 1;
+                } else {
+                    memmove(open + i, open + i + 1, (open_count - i - 1) * sizeof(Span));
+                    open_count--;
+                    i--;
+                }
+            }
+            return open_count;
+        }
+
+        Shape shapes[Capacity];
+        int count;
+    };
+};
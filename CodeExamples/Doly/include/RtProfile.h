@@ -0,0 +1,296 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Real-time scheduling profile for the eye, LCD and servo threads.
+//
+// Threads announce their role with RtProfile::enter(), after RtProfile::init()
+// the role's policy, priority and CPU set are applied to the calling thread.
+// Without init() every call is a no-op, so library code can always call it.
+//   RT_RENDER   renders eye frames, default SCHED_OTHER on core 3 (isolcpus=3)
+//   RT_PRESENT  converts and writes frames to the LCDs, default SCHED_FIFO 70 on core 2
+//   RT_SERVO    servo keys, LED ticks and arm power, default SCHED_FIFO 80 on core 2
+// sleepUntil() measures wakeup latency per role for tuning under load.
+
+enum RtRole : uint8_t
+{
+    RT_RENDER = 0,
+    RT_PRESENT = 1,
+    RT_SERVO = 2,
+    RT_ROLE_COUNT = 3,
+};
+
+namespace RtProfile
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct RoleConfig
+    {
+        int policy;     // SCHED_OTHER or SCHED_FIFO / SCHED_RR
+        int priority;   // 1..99 for real-time policies, ignored for SCHED_OTHER
+        int cpu;        // -1 = any cpu
+    };
+
+    struct RtConfig
+    {
+        RoleConfig roles[RT_ROLE_COUNT];
+        bool lock_memory;       // mlockall(MCL_CURRENT | MCL_FUTURE)
+        uint32_t latency_budget_us;  // wakeups later than this count as over budget
+    };
+
+    struct RoleState
+    {
+        bool entered;
+        pid_t tid;          // last thread that entered the role
+        int8_t result;      // enter() result of that thread
+    };
+
+    struct LatencyStats
+    {
+        uint32_t samples;
+        uint32_t over_budget;
+        float avg_us;
+        float max_us;
+    };
+
+    static std::mutex rt_mutex;
+    static bool configured = false;
+    static bool memory_locked = false;
+    static RtConfig config = {};
+    static RoleState roles[RT_ROLE_COUNT];
+    static LatencyStats latency[RT_ROLE_COUNT];
+
+    static const char* role_names[RT_ROLE_COUNT] = { "render", "present", "servo" };
+
+    inline RtConfig defaultConfig() {
+        RtConfig c = {};
+        c.roles[RT_RENDER] = { SCHED_OTHER, 0, 3 };
+        c.roles[RT_PRESENT] = { SCHED_FIFO, 70, 2 };
+        c.roles[RT_SERVO] = { SCHED_FIFO, 80, 2 };
+        c.lock_memory = true;
+        c.latency_budget_us = 200;
+        return c;
+    }
+
+    // parse "present=fifo:70@2,servo=rr:80,render=other@3,lock=0,budget=200" over 'c'
+    // missing fields keep their value, cpu '@-1' = any
+    // return 0 success
+    // return -1 syntax error
+    inline int8_t parse(const char* text, RtConfig* c) {
+        char buffer[256];
+        strncpy(buffer, text, sizeof(buffer) - 1);
+        buffer[sizeof(buffer) - 1] = 0;
+        char* save = nullptr;
+        for (char* item = strtok_r(buffer, ",", &save); item; item = strtok_r(nullptr, ",", &save)) {
+            char* value = strchr(item, '=');
+            if (!value) return -1;
+            *value++ = 0;
+            if (strcmp(item, "lock") == 0) {
+                c->lock_memory = atoi(value) != 0;
+                continue;
+            }
+            if (strcmp(item, "budget") == 0) {
+                c->latency_budget_us = (uint32_t)atoi(value);
+                continue;
+            }
+            int role = -1;
+            for (int r = 0; r < RT_ROLE_COUNT; r++) {
+                if (strcmp(item, role_names[r]) == 0) role = r;
+            }
+            if (role < 0) return -1;
+            RoleConfig& rc = c->roles[role];
+
+            char* cpu = strchr(value, '@');
+            if (cpu) {
+                *cpu++ = 0;
+                rc.cpu = atoi(cpu);
+            }
+            char* priority = strchr(value, ':');
+            if (priority) {
+                *priority++ = 0;
+                rc.priority = atoi(priority);
+            }
+            if (strcmp(value, "fifo") == 0) rc.policy = SCHED_FIFO;
+            else if (strcmp(value, "rr") == 0) rc.policy = SCHED_RR;
+            else if (strcmp(value, "other") == 0) rc.policy = SCHED_OTHER;
+            else if (value[0] != 0) return -1;
+        }
+        return 0;
+    }
+
+    inline pid_t currentTid() {
+        return (pid_t)syscall(SYS_gettid);
+    }
+
+    // apply 'rc' to thread 'tid', 0 = calling thread
+    // return 0 success
+    // return -1 policy / priority refused (needs CAP_SYS_NICE or rtprio limit)
+    // return -2 cpu affinity refused
+    inline int8_t applyTo(pid_t tid, const RoleConfig& rc) {
+        int8_t result = 0;
+        struct sched_param param = {};
+        param.sched_priority = (rc.policy == SCHED_OTHER) ? 0 : rc.priority;
+        if (sched_setscheduler(tid, rc.policy, &param) != 0) result = -1;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (rc.cpu >= 0) {
+            CPU_SET(rc.cpu, &set);
+        } else {
+            long count = sysconf(_SC_NPROCESSORS_CONF);
+            for (long i = 0; i < count && i < CPU_SETSIZE; i++) CPU_SET(i, &set);
+        }
+        if (sched_setaffinity(tid, sizeof(set), &set) != 0 && result == 0) result = -2;
+        return result;
+    }
+
+    // enable profile, lock process memory if configured
+    // return 0 success
+    // return -1 mlockall failed, scheduling still configured
+    inline int8_t init(const RtConfig& rt_config = defaultConfig()) {
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        config = rt_config;
+        configured = true;
+        memset(roles, 0, sizeof(roles));
+        memset(latency, 0, sizeof(latency));
+        memory_locked = false;
+        if (config.lock_memory) {
+            memory_locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+            if (!memory_locked) return -1;
+        }
+        return 0;
+    }
+
+    inline bool isActive() {
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        return configured;
+    }
+
+    // apply role settings to the calling thread
+    // return 0 success
+    // return 1 profile not initialized, nothing changed
+    // return -1 / -2 see applyTo
+    inline int8_t enter(RtRole role) {
+        RoleConfig rc;
+        {
+            std::lock_guard<std::mutex> lock(rt_mutex);
+            if (!configured) return 1;
+            rc = config.roles[role];
+        }
+        pid_t tid = currentTid();
+        int8_t result = applyTo(0, rc);
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        roles[role].entered = true;
+        roles[role].tid = tid;
+        roles[role].result = result;
+        return result;
+    }
+
+    // takes a role for the current scope and restores the previous scheduling,
+    // for code running on a thread it does not own (ex. Timeline::play caller)
+    class ScopedRole
+    {
+    public:
+        explicit ScopedRole(RtRole role) : active(false) {
+            if (!isActive()) return;
+            old_policy = sched_getscheduler(0);
+            sched_getparam(0, &old_param);
+            sched_getaffinity(0, sizeof(old_set), &old_set);
+            active = true;
+            // not recorded for verify(), the thread goes back to its own settings
+            RoleConfig rc;
+            {
+                std::lock_guard<std::mutex> lock(rt_mutex);
+                rc = config.roles[role];
+            }
+            applyTo(0, rc);
+        }
+        ~ScopedRole() {
+            if (!active) return;
+            sched_setscheduler(0, old_policy, &old_param);
+            sched_setaffinity(0, sizeof(old_set), &old_set);
+        }
+        ScopedRole(const ScopedRole&) = delete;
+        ScopedRole& operator=(const ScopedRole&) = delete;
+
+    private:
+        bool active;
+        int old_policy;
+        struct sched_param old_param;
+        cpu_set_t old_set;
+    };
+
+    // sleep until 'deadline' and record the wakeup latency of 'role'
+    // returns latency in microseconds
+    inline int64_t sleepUntil(RtRole role, Clock::time_point deadline) {
+        std::this_thread::sleep_until(deadline);
+        int64_t late_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - deadline).count();
+        if (late_us < 0) late_us = 0;
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        LatencyStats& s = latency[role];
+        s.samples++;
+        s.avg_us += ((float)late_us - s.avg_us) / s.samples;
+        s.max_us = std::max(s.max_us, (float)late_us);
+        uint32_t budget = configured ? config.latency_budget_us : 200;
+        if (late_us > budget) s.over_budget++;
+        return late_us;
+    }
+
+    inline LatencyStats getLatency(RtRole role) {
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        return latency[role];
+    }
+
+    inline void resetLatency() {
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        memset(latency, 0, sizeof(latency));
+    }
+
+    // read back policy, priority and affinity of every entered role thread
+    // writes one line per role to 'out' if not null
+    // return 0 all roles run as configured
+    // return 1 some role differs, was refused or memory is not locked
+    inline int8_t verify(FILE* out = nullptr) {
+        std::lock_guard<std::mutex> lock(rt_mutex);
+        if (!configured) return 1;
+        int8_t result = (config.lock_memory && !memory_locked) ? 1 : 0;
+        if (out) fprintf(out, "rt: memory %s\n", memory_locked ? "locked" : "not locked");
+        for (int r = 0; r < RT_ROLE_COUNT; r++) {
+            const RoleConfig& rc = config.roles[r];
+            if (!roles[r].entered) {
+                if (out) fprintf(out, "rt: %-7s not entered\n", role_names[r]);
+                continue;
+            }
+            pid_t tid = roles[r].tid;
+            int policy = sched_getscheduler(tid);
+            struct sched_param param = {};
+            sched_getparam(tid, &param);
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(tid, sizeof(set), &set);
+
+            // threads that already exited are judged by their enter() result
+            bool ok = (policy < 0) ? roles[r].result == 0 :
+                      policy == rc.policy &&
+                      (rc.policy == SCHED_OTHER || param.sched_priority == rc.priority) &&
+                      (rc.cpu < 0 || (CPU_COUNT(&set) == 1 && CPU_ISSET(rc.cpu, &set)));
+            if (!ok) result = 1;
+            if (out) {
+                fprintf(out, "rt: %-7s tid %d policy %d prio %d cpus %d%s%s\n", role_names[r], (int)tid,
+                        policy, param.sched_priority, CPU_COUNT(&set),
+                        policy < 0 ? " (thread exited)" : "", ok ? "" : " MISMATCH");
+            }
+        }
+        return result;
+    }
+};
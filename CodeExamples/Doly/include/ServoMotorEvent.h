@@ -0,0 +1,21 @@
+#pragma once
+#include "ServoMotor.h"
+#include "ServoMotorEventListener.h"
+
+// Servo motion events, listeners are called from the servo control thread
+namespace ServoMotorEvent
+{
+	// 'priority' listeners are called before the others
+	void AddListener(ServoMotorEventListener* observer, bool priority = false);
+	void RemoveListener(ServoMotorEventListener* observer);
+
+	void AddListenerOnComplete(void(*onEvent)(ServoChannel channel));
+	void RemoveListenerOnComplete(void(*onEvent)(ServoChannel channel));
+
+	void AddListenerOnAbort(void(*onEvent)(ServoChannel channel));
+	void RemoveListenerOnAbort(void(*onEvent)(ServoChannel channel));
+
+	// raise events, used by ServoMotor
+	void ServoMotorComplete(ServoChannel channel);
+	void ServoMotorAbort(ServoChannel channel);
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include "ServoMotor.h"
+
+// derive and register with ServoMotorEvent::AddListener
+class ServoMotorEventListener
+{
+public:
+	// servo stopped before reaching target
+	virtual void onServoMotorAbort(ServoChannel channel);
+
+	// servo reached target position
+	virtual void onServoMotorComplete(ServoChannel channel);
+};
@@ -0,0 +1,319 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Gpio_x86_sim.h"
+
+// x86 stand-in for ServoMotor.h, ServoMotorEvent.h and libServoMotor.a
+//
+// Physical model: every command is a PWM pulse width, the horn follows it at a
+// rate limited angular speed (speed 100 = SERVO_SIM_MAX_DPS) and only while the
+// arm power pin is HIGH. After power is enabled the servo electronics need
+// ServoSim::wake_us before moving. Complete / abort events are raised from the
+// simulation thread like the library raises them from its control thread.
+#define DOLY_X86_SIM_SERVO
+
+// just for information, ignored if used more than defined (220 degree)
+// Arm servos can not rotate more than that.
+#define SERVO_ARM_MAX_ANGLE 220
+
+// degree per second at speed 100, typical 0.1s/60deg hobby servo
+#define SERVO_SIM_MAX_DPS 600.0f
+#define SERVO_SIM_TICK_US 2000
+
+enum ServoChannel : uint8_t
+{
+    SERVO_LEFT,
+    SERVO_RIGHT,
+    SERVO_0,
+    SERVO_1,
+};
+
+class ServoMotorEventListener
+{
+public:
+    // servo stopped before reaching target
+    virtual void onServoMotorAbort(ServoChannel /*channel*/) {}
+
+    // servo reached target position
+    virtual void onServoMotorComplete(ServoChannel /*channel*/) {}
+};
+
+namespace ServoSim
+{
+    #define SERVO_SIM_CHANNELS 4
+
+    struct ServoModel
+    {
+        bool configured;
+        uint16_t min_us;
+        uint16_t max_us;
+        uint16_t max_angle;
+        bool invert;
+        float angle;        // estimated horn position
+        float target;       // commanded position
+        float rate_dps;     // current angular speed limit
+        bool moving;
+        uint16_t pulse_us;  // last PWM command
+    };
+
+    static std::mutex servo_mutex;
+    static ServoModel servos[SERVO_SIM_CHANNELS];
+    static std::vector<ServoMotorEventListener*> observers;
+    static std::vector<void(*)(ServoChannel)> complete_listeners;
+    static std::vector<void(*)(ServoChannel)> abort_listeners;
+
+    // power on to first movement
+    static uint32_t wake_us = 20000;
+
+    static std::atomic<bool> running(false);
+    static std::thread sim_thread;
+
+    // power pin of channel, 0 if channel has no power control
+    inline uint8_t powerPin(uint8_t channel) {
+        if (channel == SERVO_LEFT) return Pin_Servo_Left_Enable;
+        if (channel == SERVO_RIGHT) return Pin_Servo_Right_Enable;
+        return 0;
+    }
+
+    inline bool isPowered(uint8_t channel, uint64_t now_ns) {
+        uint8_t pin = powerPin(channel);
+        if (pin == 0) return true;
+        if (GpioSim::pinState(pin) != HIGH) return false;
+        return now_ns - GpioSim::pinChangedNs(pin) >= (uint64_t)wake_us * 1000;
+    }
+
+    inline void raise(ServoChannel channel, bool complete) {
+        std::vector<ServoMotorEventListener*> obs;
+        std::vector<void(*)(ServoChannel)> fns;
+        {
+            std::lock_guard<std::mutex> lock(servo_mutex);
+            obs = observers;
+            fns = complete ? complete_listeners : abort_listeners;
+        }
+        GpioSim::record(complete ? GpioSim::LOG_SERVO_COMPLETE : GpioSim::LOG_SERVO_ABORT, channel, 0);
+        for (ServoMotorEventListener* o : obs) {
+            if (complete) o->onServoMotorComplete(channel);
+            else o->onServoMotorAbort(channel);
+        }
+        for (auto fn : fns) fn(channel);
+    }
+
+    static void step(float dt) {
+        uint64_t now = GpioSim::nowNs();
+        ServoChannel done[SERVO_SIM_CHANNELS];
+        int done_count = 0;
+        {
+            std::lock_guard<std::mutex> lock(servo_mutex);
+            for (uint8_t ch = 0; ch < SERVO_SIM_CHANNELS; ch++) {
+                ServoModel& s = servos[ch];
+                if (!s.moving || !isPowered(ch, now)) continue;
+                float delta = s.target - s.angle;
+                float max_step = s.rate_dps * dt;
+                if (fabsf(delta) <= max_step) {
+                    s.angle = s.target;
+                    s.moving = false;
+                    done[done_count++] = (ServoChannel)ch;
+                } else {
+                    s.angle += (delta > 0 ? max_step : -max_step);
+                }
+            }
+        }
+        for (int i = 0; i < done_count; i++) raise(done[i], true);
+    }
+
+    static void loop() {
+        auto last = std::chrono::steady_clock::now();
+        auto next = last;
+        while (running.load()) {
+            next += std::chrono::microseconds(SERVO_SIM_TICK_US);
+            std::this_thread::sleep_until(next);
+            auto now = std::chrono::steady_clock::now();
+            step(std::chrono::duration<float>(now - last).count());
+            last = now;
+        }
+    }
+
+    // stop simulation thread, called automatically at exit
+    inline void shutdown() {
+        if (!running.exchange(false)) return;
+        if (sim_thread.joinable()) sim_thread.join();
+    }
+
+    static struct ThreadGuard
+    {
+        ~ThreadGuard() { shutdown(); }
+    } thread_guard;
+
+    // current simulated horn angle
+    inline float getAngle(ServoChannel channel) {
+        if (channel >= SERVO_SIM_CHANNELS) return 0;
+        std::lock_guard<std::mutex> lock(servo_mutex);
+        return servos[channel].angle;
+    }
+
+    inline bool isMoving(ServoChannel channel) {
+        if (channel >= SERVO_SIM_CHANNELS) return false;
+        std::lock_guard<std::mutex> lock(servo_mutex);
+        return servos[channel].moving;
+    }
+
+    // last PWM pulse width sent to channel
+    inline uint16_t getPulseUs(ServoChannel channel) {
+        if (channel >= SERVO_SIM_CHANNELS) return 0;
+        std::lock_guard<std::mutex> lock(servo_mutex);
+        return servos[channel].pulse_us;
+    }
+
+    // set power on to movement delay
+    inline void setWakeLatency(uint32_t us) {
+        wake_us = us;
+    }
+};
+
+namespace ServoMotorEvent
+{
+    // 'priority' listeners are called before the others
+    inline void AddListener(ServoMotorEventListener* observer, bool priority = false) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        if (priority) ServoSim::observers.insert(ServoSim::observers.begin(), observer);
+        else ServoSim::observers.push_back(observer);
+    }
+
+    inline void RemoveListener(ServoMotorEventListener* observer) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        auto& v = ServoSim::observers;
+        v.erase(std::remove(v.begin(), v.end(), observer), v.end());
+    }
+
+    inline void AddListenerOnComplete(void(*onEvent)(ServoChannel channel)) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        ServoSim::complete_listeners.push_back(onEvent);
+    }
+
+    inline void RemoveListenerOnComplete(void(*onEvent)(ServoChannel channel)) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        auto& v = ServoSim::complete_listeners;
+        v.erase(std::remove(v.begin(), v.end(), onEvent), v.end());
+    }
+
+    inline void AddListenerOnAbort(void(*onEvent)(ServoChannel channel)) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        ServoSim::abort_listeners.push_back(onEvent);
+    }
+
+    inline void RemoveListenerOnAbort(void(*onEvent)(ServoChannel channel)) {
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        auto& v = ServoSim::abort_listeners;
+        v.erase(std::remove(v.begin(), v.end(), onEvent), v.end());
+    }
+
+    inline void ServoMotorComplete(ServoChannel channel) {
+        ServoSim::raise(channel, true);
+    }
+
+    inline void ServoMotorAbort(ServoChannel channel) {
+        ServoSim::raise(channel, false);
+    }
+};
+
+namespace ServoMotor
+{
+    // initialize all motors
+    inline void Init() {
+        if (ServoSim::running.exchange(true)) return;
+        {
+            std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+            for (uint8_t ch = 0; ch < SERVO_SIM_CHANNELS; ch++) {
+                ServoSim::servos[ch] = {};
+                ServoSim::servos[ch].min_us = 500;
+                ServoSim::servos[ch].max_us = 2500;
+                ServoSim::servos[ch].max_angle = (ch <= SERVO_RIGHT) ? SERVO_ARM_MAX_ANGLE : 180;
+            }
+        }
+        ServoSim::sim_thread = std::thread(ServoSim::loop);
+    }
+
+    //return true if module ready
+    inline bool isActive() {
+        return ServoSim::running.load();
+    }
+
+    // setup servo default values
+    // 'angle' ignored for SERVO_LEFT & SERVO_RIGHT,
+    // return 0 success
+    // return -1 frequency interval error
+    // return -2 angle error
+    inline int8_t setup(ServoChannel channel, uint16_t min_us, uint16_t max_us, uint16_t angle, bool invert) {
+        if (channel >= SERVO_SIM_CHANNELS) return -2;
+        if (min_us >= max_us || max_us > 20000) return -1;
+        if (channel > SERVO_RIGHT && angle == 0) return -2;
+
+        std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+        ServoSim::ServoModel& s = ServoSim::servos[channel];
+        s.configured = true;
+        s.min_us = min_us;
+        s.max_us = max_us;
+        s.max_angle = (channel <= SERVO_RIGHT) ? SERVO_ARM_MAX_ANGLE : angle;
+        s.invert = invert;
+        return 0;
+    }
+
+    // sets servo position
+    // return 0 success
+    // return -1 max angle exceed error
+    // return -2 speed range error (0-100)
+    // return -3 undefined channel
+    inline int8_t set(ServoChannel channel, float angle, uint8_t speed) {
+        if (channel >= SERVO_SIM_CHANNELS) return -3;
+        if (speed > 100) return -2;
+
+        bool aborted = false;
+        {
+            std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+            ServoSim::ServoModel& s = ServoSim::servos[channel];
+            if (angle < 0 || angle > s.max_angle) return -1;
+
+            float ratio = angle / s.max_angle;
+            if (s.invert) ratio = 1.0f - ratio;
+            s.pulse_us = (uint16_t)(s.min_us + (s.max_us - s.min_us) * ratio);
+            aborted = s.moving && s.target != angle;
+            s.target = angle;
+            s.rate_dps = SERVO_SIM_MAX_DPS * std::max<uint8_t>(speed, 1) / 100.0f;
+            s.moving = (s.angle != angle);
+        }
+        if (aborted) ServoSim::raise(channel, false);
+        // one channel register burst on the PWM controller
+        GpioSim::busDelay(5);
+        GpioSim::record(GpioSim::LOG_SERVO_SET, channel, angle, speed);
+
+        // already at target, complete right away
+        if (!ServoSim::isMoving(channel)) ServoSim::raise(channel, true);
+        return 0;
+    }
+
+    // stops servo
+    // return 0 success
+    // return -1 undefined servo
+    inline int8_t stop(ServoChannel channel) {
+        if (channel >= SERVO_SIM_CHANNELS) return -1;
+        bool was_moving;
+        {
+            std::lock_guard<std::mutex> lock(ServoSim::servo_mutex);
+            ServoSim::ServoModel& s = ServoSim::servos[channel];
+            was_moving = s.moving;
+            s.moving = false;
+            s.target = s.angle;
+            s.pulse_us = 0;
+        }
+        GpioSim::busDelay(5);
+        GpioSim::record(GpioSim::LOG_SERVO_STOP, channel, 0);
+        if (was_moving) ServoSim::raise(channel, false);
+        return 0;
+    }
+};
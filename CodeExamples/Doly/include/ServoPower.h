@@ -0,0 +1,254 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// include real or x86 simulated device headers before this file
+#ifndef DOLY_X86_SIM_GPIO
+#include "Gpio.h"
+#endif
+#ifndef DOLY_X86_SIM_SERVO
+#include "ServoMotor.h"
+#include "ServoMotorEvent.h"
+#endif
+#include "RtProfile.h"
+
+// Automatic arm servo power gating.
+//
+// Each arm enable pin is dropped 'idle_ms' after the last onServoMotorComplete
+// of that arm. ServoPower::set() re-enables power transparently, and moves known
+// in advance (prearm, Timeline keys) power up 'wake_us' early so the first
+// motion is never delayed past the latency budget.
+
+namespace ServoPower
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct PowerStats
+    {
+        uint32_t power_on;          // enable pin raised
+        uint32_t power_off;         // enable pin dropped after idle
+        uint32_t prearmed;          // moves that found power already settled
+        uint32_t cold_starts;       // moves that had to wait for power
+        uint32_t budget_misses;     // cold starts slower than latency budget
+        float max_wake_latency_ms;  // worst move start delay caused by power up
+        float powered_ms[2];        // per arm
+    };
+
+    struct ArmState
+    {
+        bool powered;
+        uint32_t moves;                 // set() calls still waiting for their complete / abort
+        float target;                   // angle of the last set()
+        Clock::time_point powered_at;   // pin raised
+        Clock::time_point idle_since;   // last complete / abort
+        std::vector<Clock::time_point> prearm_at;  // scheduled power on times, sorted
+    };
+
+    static std::mutex power_mutex;
+    static std::condition_variable power_cv;
+    static ArmState arms[2];
+    static PowerStats stats = {};
+
+    static uint32_t idle_ms = 2000;
+    static uint32_t wake_us = 20000;
+    static uint32_t budget_us = 30000;
+
+    static std::atomic<bool> running(false);
+    static std::thread manager_thread;
+
+    inline PinId enablePin(uint8_t arm) {
+        return arm == SERVO_LEFT ? Pin_Servo_Left_Enable : Pin_Servo_Right_Enable;
+    }
+
+    // lock must be held
+    static void powerOn(uint8_t arm, Clock::time_point now) {
+        if (arms[arm].powered) return;
+        GPIO::writePin(enablePin(arm), HIGH);
+        arms[arm].powered = true;
+        arms[arm].powered_at = now;
+        arms[arm].idle_since = now;
+        stats.power_on++;
+    }
+
+    // lock must be held
+    static void powerOff(uint8_t arm, Clock::time_point now) {
+        if (!arms[arm].powered) return;
+        GPIO::writePin(enablePin(arm), LOW);
+        arms[arm].powered = false;
+        stats.power_off++;
+        stats.powered_ms[arm] += std::chrono::duration<float, std::milli>(now - arms[arm].powered_at).count();
+    }
+
+    class Listener : public ServoMotorEventListener
+    {
+    public:
+        void onServoMotorComplete(ServoChannel channel) override { idle(channel); }
+        void onServoMotorAbort(ServoChannel channel) override { idle(channel); }
+
+    private:
+        // every move ends with one complete or abort, from whichever thread raises it;
+        // a retarget aborts the previous move while the new one keeps the arm busy
+        void idle(ServoChannel channel) {
+            if (channel > SERVO_RIGHT) return;
+            std::lock_guard<std::mutex> lock(power_mutex);
+            ArmState& a = arms[channel];
+            if (a.moves > 0) a.moves--;
+            if (a.moves > 0) return;
+            a.idle_since = Clock::now();
+            power_cv.notify_all();
+        }
+    };
+
+    static Listener listener;
+
+    static void manage() {
+        RtProfile::enter(RT_SERVO);
+        std::unique_lock<std::mutex> lock(power_mutex);
+        while (running.load()) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point wake = Clock::time_point::max();
+            for (uint8_t arm = 0; arm < 2; arm++) {
+                ArmState& a = arms[arm];
+                while (!a.prearm_at.empty() && a.prearm_at.front() <= now) {
+                    powerOn(arm, now);
+                    a.prearm_at.erase(a.prearm_at.begin());
+                }
+                Clock::time_point next_prearm = a.prearm_at.empty() ? Clock::time_point::max() : a.prearm_at.front();
+                wake = std::min(wake, next_prearm);
+
+                if (a.powered && a.moves == 0) {
+                    // not worth a power cycle when the next move is close
+                    bool move_soon = next_prearm != Clock::time_point::max() &&
+                                     next_prearm - now < std::chrono::milliseconds(idle_ms);
+                    Clock::time_point off_at = a.idle_since + std::chrono::milliseconds(idle_ms);
+                    if (off_at > now) wake = std::min(wake, off_at);
+                    else if (!move_soon) powerOff(arm, now);
+                }
+            }
+            if (wake == Clock::time_point::max()) power_cv.wait(lock);
+            else power_cv.wait_until(lock, wake);
+        }
+    }
+
+    // start power manager, arms start powered off
+    // 'idle_ms'   power off delay after last move
+    // 'wake_us'   power on to servo ready time
+    // 'budget_us' allowed move start delay, exceeding it counts as budget miss
+    // return 0 success
+    // return 1 already running
+    inline int8_t init(uint32_t idle_time_ms = 2000, uint32_t wake_time_us = 20000, uint32_t latency_budget_us = 30000) {
+        if (running.exchange(true)) return 1;
+        {
+            std::lock_guard<std::mutex> lock(power_mutex);
+            idle_ms = idle_time_ms;
+            wake_us = wake_time_us;
+            budget_us = latency_budget_us;
+            stats = {};
+            for (uint8_t arm = 0; arm < 2; arm++) {
+                arms[arm] = {};
+                GPIO::init(enablePin(arm), GPIO_OUTPUT, LOW);
+            }
+        }
+        ServoMotorEvent::AddListener(&listener, true);
+        manager_thread = std::thread(manage);
+        return 0;
+    }
+
+    // stop manager and cut power of both arms
+    inline void release() {
+        if (!running.exchange(false)) return;
+        power_cv.notify_all();
+        if (manager_thread.joinable()) manager_thread.join();
+        ServoMotorEvent::RemoveListener(&listener);
+        std::lock_guard<std::mutex> lock(power_mutex);
+        Clock::time_point now = Clock::now();
+        for (uint8_t arm = 0; arm < 2; arm++) powerOff(arm, now);
+    }
+
+    // manager thread still running at exit (no release() before exit / return from main)
+    static struct ManagerThreadGuard { ~ManagerThreadGuard() { release(); } } manager_thread_guard;
+
+    // power up 'channel' so it is settled at 'move_at'
+    inline void prearm(ServoChannel channel, Clock::time_point move_at) {
+        if (channel > SERVO_RIGHT || !running.load()) return;
+        std::lock_guard<std::mutex> lock(power_mutex);
+        std::vector<Clock::time_point>& list = arms[channel].prearm_at;
+        Clock::time_point on_at = move_at - std::chrono::microseconds(wake_us);
+        list.insert(std::upper_bound(list.begin(), list.end(), on_at), on_at);
+        power_cv.notify_all();
+    }
+
+    // ServoMotor::set with power handling, same return values
+    // if power was off the call waits for the servo to be ready
+    inline int8_t set(ServoChannel channel, float angle, uint8_t speed) {
+        bool counted = false;
+        if (channel <= SERVO_RIGHT && running.load()) {
+            std::unique_lock<std::mutex> lock(power_mutex);
+            ArmState& a = arms[channel];
+            Clock::time_point now = Clock::now();
+            // the same target again while moving raises no event of its own
+            counted = a.moves == 0 || a.target != angle;
+            if (counted) a.moves++;
+            a.target = angle;
+            powerOn(channel, now);
+
+            Clock::time_point ready = a.powered_at + std::chrono::microseconds(wake_us);
+            if (ready > now) {
+                float wait_ms = std::chrono::duration<float, std::milli>(ready - now).count();
+                stats.cold_starts++;
+                stats.max_wake_latency_ms = std::max(stats.max_wake_latency_ms, wait_ms);
+                if (wait_ms * 1000 > budget_us) stats.budget_misses++;
+                lock.unlock();
+                std::this_thread::sleep_until(ready);
+            } else {
+                stats.prearmed++;
+            }
+        }
+        int8_t result = ServoMotor::set(channel, angle, speed);
+        // rejected, no event will end this move
+        if (counted && result < 0) {
+            std::lock_guard<std::mutex> lock(power_mutex);
+            ArmState& a = arms[channel];
+            if (a.moves > 0) a.moves--;
+            if (a.moves == 0) {
+                a.idle_since = Clock::now();
+                power_cv.notify_all();
+            }
+        }
+        return result;
+    }
+
+    inline bool isPowered(ServoChannel channel) {
+        if (channel > SERVO_RIGHT) return true;
+        std::lock_guard<std::mutex> lock(power_mutex);
+        return arms[channel].powered;
+    }
+
+    // power on to servo ready time
+    inline uint32_t wakeLatencyUs() {
+        return wake_us;
+    }
+
+    inline bool isActive() {
+        return running.load();
+    }
+
+    // powered_ms includes the running period of arms still on
+    inline PowerStats getStats() {
+        std::lock_guard<std::mutex> lock(power_mutex);
+        PowerStats result = stats;
+        Clock::time_point now = Clock::now();
+        for (uint8_t arm = 0; arm < 2; arm++) {
+            if (arms[arm].powered) {
+                result.powered_ms[arm] += std::chrono::duration<float, std::milli>(now - arms[arm].powered_at).count();
+            }
+        }
+        return result;
+    }
+};
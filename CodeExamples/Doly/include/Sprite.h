@@ -0,0 +1,197 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "RenderCore.h"
+
+// Sprites: small pieces of art drawn over a render buffer with transparency.
+//
+// A sprite is stored row by row as runs of pixels, transparent pixels are not
+// stored at all. Colors are premultiplied by alpha, so drawing a pixel is
+// out = color + out * (255 - alpha) / 255, and a run is one of
+//   SOLID  alpha 255, copied with one memcpy
+//   BLEND  partly transparent (anti-aliased edges), blended 16 bytes per step
+// The cost of a draw depends on the pixels covered, not on how the art was made.
+//
+//   Sprite::Image<Color> tear;
+//   Sprite::build(tear, 17, 22, 8, 8, [](int x, int y, Color& color) -> uint8_t { ...; return alpha; });
+//   Sprite::draw<Display>(rgb_buffer, tear, x, y);
+//
+// Image<uint8_t> holds palette indices (Canvas<Spec, uint8_t>), which cannot be
+// blended: pixels with alpha >= 128 are kept as SOLID, the rest are transparent.
+
+namespace Sprite
+{
+    enum RunKind : uint8_t
+    {
+        SOLID = 0,
+        BLEND = 1,
+    };
+
+    struct Run
+    {
+        int16_t x;              // first pixel, from the left of the sprite
+        uint16_t length;        // pixels
+        RunKind kind;
+        uint32_t offset;        // in Image::data
+    };
+
+    // sprite data kept elsewhere (an Image, an atlas file)
+    template <class Ink = RenderCore::Color>
+    struct View
+    {
+        int width, height;
+        int origin_x, origin_y;
+        const uint32_t* rows;
+        const Run* runs;
+        const uint8_t* data;
+    };
+
+    template <class Ink = RenderCore::Color>
+    struct Image
+    {
+        static constexpr int PIXEL_SIZE = sizeof(Ink);
+
+        int width = 0, height = 0;
+        int origin_x = 0, origin_y = 0;    // pixel placed at the position given to draw()
+        std::vector<uint32_t> rows;        // first run of each row, height + 1 entries
+        std::vector<Run> runs;
+        std::vector<uint8_t> data;         // SOLID: pixels, BLEND: pixels then 255 - alpha per byte
+
+        size_t bytes() const {
+            return sizeof(*this) + rows.size() * sizeof(uint32_t) + runs.size() * sizeof(Run) + data.size();
+        }
+
+        View<Ink> view() const {
+            return { width, height, origin_x, origin_y, rows.data(), runs.data(), data.data() };
+        }
+    };
+
+    typedef uint8_t U8x16 __attribute__((vector_size(16)));
+    typedef uint16_t U16x16 __attribute__((vector_size(32)));
+
+    // (value + 127) / 255 for value <= 255 * 255, without a division
+    inline uint32_t div255(uint32_t value) {
+        value += 128;
+        return (value + (value >> 8)) >> 8;
+    }
+
+    // out = src + out * inverse / 255 per byte, 'src' premultiplied
+    inline void blendRow(uint8_t* out, const uint8_t* src, const uint8_t* inverse, size_t bytes) {
+        size_t i = 0;
+        // 255 * 255 + 128 + 255 fits in 16 bits, the sum stays <= 255 for premultiplied colors
+        for (; i + 16 <= bytes; i += 16) {
+            U8x16 vo, vs, vi;
+            memcpy(&vo, out + i, 16);
+            memcpy(&vs, src + i, 16);
+            memcpy(&vi, inverse + i, 16);
+            U16x16 t = __builtin_convertvector(vo, U16x16) * __builtin_convertvector(vi, U16x16) + 128;
+            t = (t + (t >> 8)) >> 8;
+            vo = __builtin_convertvector(t + __builtin_convertvector(vs, U16x16), U8x16);
+            memcpy(out + i, &vo, 16);
+        }
+        for (; i < bytes; i++) {
+            out[i] = (uint8_t)(src[i] + div255(out[i] * inverse[i]));
+        }
+    }
+
+    inline RenderCore::Color premultiply(const RenderCore::Color& color, uint8_t alpha) {
+        return { (uint8_t)div255(color.r * alpha), (uint8_t)div255(color.g * alpha), (uint8_t)div255(color.b * alpha) };
+    }
+
+    // run kind of a pixel, -1 transparent
+    inline int runKind(const RenderCore::Color&, uint8_t alpha) {
+        return alpha == 0 ? -1 : (alpha == 255 ? SOLID : BLEND);
+    }
+
+    inline int runKind(uint8_t, uint8_t alpha) {
+        return alpha >= 128 ? SOLID : -1;
+    }
+
+    inline void storePixel(uint8_t* p, const RenderCore::Color& color, uint8_t alpha) {
+        RenderCore::putPixel(p, premultiply(color, alpha));
+    }
+
+    inline void storePixel(uint8_t* p, uint8_t index, uint8_t) {
+        p[0] = index;
+    }
+
+    // 'width' x 'height' sprite, 'shade(x, y, Ink& ink)' gives the color (not premultiplied)
+    // and returns the alpha of each pixel, (origin_x, origin_y) is the pixel placed at the draw position
+    template <class Ink, class Shader>
+    void build(Image<Ink>& image, int width, int height, int origin_x, int origin_y, Shader shade) {
+        const int P = Image<Ink>::PIXEL_SIZE;
+        image.width = width;
+        image.height = height;
+        image.origin_x = origin_x;
+        image.origin_y = origin_y;
+        image.rows.assign(height + 1, 0);
+        image.runs.clear();
+        image.data.clear();
+
+        std::vector<Ink> inks(width);
+        std::vector<uint8_t> alphas(width);
+        for (int y = 0; y < height; y++) {
+            image.rows[y] = (uint32_t)image.runs.size();
+            for (int x = 0; x < width; x++) {
+                inks[x] = Ink();
+                alphas[x] = shade(x, y, inks[x]);
+            }
+            for (int x = 0; x < width;) {
+                int kind = runKind(inks[x], alphas[x]);
+                int end = x + 1;
+                while (end < width && runKind(inks[end], alphas[end]) == kind) end++;
+                if (kind >= 0) {
+                    Run run = { (int16_t)x, (uint16_t)(end - x), (RunKind)kind, (uint32_t)image.data.size() };
+                    int n = end - x;
+                    image.data.resize(image.data.size() + n * P * (kind == BLEND ? 2 : 1));
+                    uint8_t* p = image.data.data() + run.offset;
+                    for (int i = 0; i < n; i++) {
+                        storePixel(p + i * P, inks[x + i], alphas[x + i]);
+                    }
+                    if (kind == BLEND) {
+                        for (int i = 0; i < n; i++) {
+                            memset(p + (n + i) * P, 255 - alphas[x + i], P);
+                        }
+                    }
+                    image.runs.push_back(run);
+                }
+                x = end;
+            }
+        }
+        image.rows[height] = (uint32_t)image.runs.size();
+    }
+
+    // 'image' with its origin at (x, y) over a render buffer of 'Spec', clipped
+    template <class Spec, class Ink>
+    void draw(uint8_t* buffer, const View<Ink>& image, int x, int y) {
+        const int P = sizeof(Ink);
+        const int left = x - image.origin_x;
+        const int top = y - image.origin_y;
+        const int first = std::max(0, -top);
+        const int last = std::min(image.height, Spec::HEIGHT - top);
+        for (int r = first; r < last; r++) {
+            uint8_t* row = buffer + (size_t)(top + r) * Spec::WIDTH * P;
+            for (uint32_t i = image.rows[r]; i < image.rows[r + 1]; i++) {
+                const Run& run = image.runs[i];
+                int x0 = left + run.x;
+                int c0 = std::max(x0, 0);
+                int c1 = std::min(x0 + run.length, Spec::WIDTH);
+                if (c0 >= c1) continue;
+                const uint8_t* src = image.data + run.offset + (c0 - x0) * P;
+                if (run.kind == SOLID) {
+                    memcpy(row + c0 * P, src, (c1 - c0) * P);
+                } else {
+                    blendRow(row + c0 * P, src, src + run.length * P, (c1 - c0) * P);
+                }
+                RenderCore::countWrites(c1 - c0);
+            }
+        }
+    }
+
+    template <class Spec, class Ink>
+    void draw(uint8_t* buffer, const Image<Ink>& image, int x, int y) {
+        draw<Spec>(buffer, image.view(), x, y);
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Bounded lock-free single producer / single consumer queue.
+// Exactly one thread may push and exactly one thread may pop.
+// 'Capacity' must be a power of two, one slot is kept free.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // producer side
+    // return false if queue is full
+    bool push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) & (Capacity - 1);
+        if (next == head.load(std::memory_order_acquire)) return false;
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    // return false if queue is empty
+    bool pop(T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h];
+        head.store((h + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    // approximate when called while the other side is running
+    size_t size() const
+    {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+
+private:
+    T items[Capacity];
+    // producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
@@ -0,0 +1,350 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// include real or x86 simulated device headers before this file
+#ifndef DOLY_X86_SIM_LCD
+#include "LcdControl.h"
+#endif
+#ifndef DOLY_X86_SIM_SERVO
+#include "ServoMotor.h"
+#endif
+#include "PwmShadow.h"
+#include "ServoPower.h"
+#include "FrameArena.h"
+#include "RtProfile.h"
+#include "FramePacer.h"
+#include "FrameCache.h"
+
+// Multimodal expression timeline.
+//
+// One expression is a set of tracks (eye frames per LCD, servo keyframes,
+// LED keyframes) scheduled against a single steady_clock origin. Every event
+// has an absolute deadline in microseconds, nothing is paced with sleep_for,
+// so lateness in one track never shifts the others:
+//  - eye tracks run on their own thread, start each frame early by the measured
+//    render + write cost and skip slots instead of drifting when behind
+//  - servo keys that fire late get a higher speed so the arm still arrives on time,
+//    with ServoPower running the arms are pre-armed ahead of every key
+//  - LED colors are interpolated from clock time and flushed once per control tick
+//  - eye frames are rendered into the FrameArena buffers of their display when the
+//    arena is initialized, otherwise into buffers allocated once per play()
+//  - with RtProfile initialized the eye thread runs as RT_PRESENT and the control
+//    loop as RT_SERVO, wakeup latency of both is reported per track
+//  - eye tracks with a key function skip frames whose key did not change (FramePacer)
+//    and write frames of keys seen before from FrameCache when it is initialized
+
+// degree per second at servo speed 100, used to turn key durations into speed
+#define TIMELINE_SERVO_MAX_DPS 600.0f
+// LED interpolation / PwmShadow flush period
+#define TIMELINE_LED_TICK_US 20000
+// wakeup jitter below this is not counted as late
+#define TIMELINE_LATE_SLACK_US 1000
+
+namespace Timeline
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // draws one 24 bit frame for 't_us' microseconds after track start
+    typedef std::function<void(uint8_t* buffer24, uint32_t t_us)> EyeDraw;
+
+    // parameters of the frame at 't_us' as FramePacer key, optional
+    typedef std::function<uint64_t(uint32_t t_us)> EyeKey;
+
+    struct EyeTrack
+    {
+        LcdSide side;
+        uint32_t start_ms;
+        uint32_t duration_ms;
+        uint32_t frame_ms;      // frame slot length
+        EyeDraw draw;
+        EyeKey key;             // empty = render every slot
+    };
+
+    struct ServoKey
+    {
+        uint32_t time_ms;       // move starts
+        ServoChannel channel;
+        float angle;
+        uint32_t duration_ms;   // move should take, 0 = full speed
+    };
+
+    struct LedKey
+    {
+        uint32_t time_ms;       // color reached at this time, linear from previous key
+        LcdSide side;
+        uint8_t r, g, b;
+    };
+
+    struct Expression
+    {
+        std::vector<EyeTrack> eyes;
+        std::vector<ServoKey> servos;
+        std::vector<LedKey> leds;
+    };
+
+    struct TrackStats
+    {
+        uint32_t events;        // frames presented / keys applied / led ticks
+        uint32_t late;          // events finished after deadline
+        uint32_t dropped;       // frame slots skipped to catch up
+        uint32_t unchanged;     // frame slots skipped because the image is static
+        uint32_t cached;        // frames written from FrameCache without rendering
+        float max_late_ms;
+        float avg_late_ms;      // over late events
+        float avg_cost_ms;      // measured execution cost
+        float avg_wake_us;      // scheduling latency, wakeup after the requested time
+        float max_wake_us;
+    };
+
+    struct PlayStats
+    {
+        TrackStats eye[2];      // per LcdSide
+        TrackStats servo;
+        TrackStats led;
+        float duration_ms;
+    };
+
+    static float servo_angle[4] = { 0, 0, 0, 0 };  // last commanded angle per channel
+    static std::atomic<bool> abort_requested(false);
+
+    inline int64_t usSince(Clock::time_point origin) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin).count();
+    }
+
+    inline void addLate(TrackStats& s, int64_t late_us) {
+        if (late_us <= TIMELINE_LATE_SLACK_US) return;
+        float late_ms = late_us / 1000.0f;
+        s.late++;
+        s.avg_late_ms += (late_ms - s.avg_late_ms) / s.late;
+        s.max_late_ms = std::max(s.max_late_ms, late_ms);
+    }
+
+    inline void addWake(TrackStats& s, uint32_t& samples, int64_t wake_us) {
+        samples++;
+        s.avg_wake_us += ((float)wake_us - s.avg_wake_us) / samples;
+        s.max_wake_us = std::max(s.max_wake_us, (float)wake_us);
+    }
+
+    static void playEyes(const std::vector<EyeTrack>& tracks, Clock::time_point origin, PlayStats& stats) {
+        RtProfile::enter(RT_PRESENT);
+        uint32_t wakeups[2] = { 0, 0 };
+        struct EyeState
+        {
+            uint32_t slot;
+            float cost_us;      // EWMA of draw + convert + write
+            uint8_t* rgb;
+            uint8_t* lcd;
+            std::vector<uint8_t> rgb_owned;
+            std::vector<uint8_t> lcd_owned;
+        };
+        std::vector<EyeState> state(tracks.size());
+        bool arena_used[2] = { false, false };
+        for (size_t i = 0; i < tracks.size(); i++) {
+            EyeState& s = state[i];
+            s.slot = 0;
+            s.cost_us = 0;
+            uint8_t side = tracks[i].side & 1;
+            if (FrameArena::isActive() && !arena_used[side]) {
+                // one track per display can own the arena buffers
+                arena_used[side] = true;
+                s.rgb = FrameArena::get((LcdSide)side).render;
+                s.lcd = FrameArena::get((LcdSide)side).lcd;
+            } else {
+                s.rgb_owned.resize(LCD_WIDTH * LCD_HEIGHT * 3);
+                s.lcd_owned.resize(LcdControl::getBufferSize());
+                s.rgb = s.rgb_owned.data();
+                s.lcd = s.lcd_owned.data();
+            }
+        }
+
+        while (!abort_requested.load()) {
+            // earliest pending frame over all eye tracks
+            int next = -1;
+            int64_t next_start = 0;
+            for (size_t i = 0; i < tracks.size(); i++) {
+                const EyeTrack& t = tracks[i];
+                uint64_t slot_us = (uint64_t)state[i].slot * t.frame_ms * 1000;
+                if (slot_us >= (uint64_t)t.duration_ms * 1000) continue;
+                int64_t deadline = (int64_t)t.start_ms * 1000 + slot_us;
+                int64_t start = deadline - (int64_t)state[i].cost_us;
+                if (next < 0 || start < next_start) {
+                    next = (int)i;
+                    next_start = start;
+                }
+            }
+            if (next < 0) break;
+
+            const EyeTrack& t = tracks[next];
+            EyeState& s = state[next];
+            TrackStats& ts = stats.eye[t.side & 1];
+            int64_t wake_us = RtProfile::sleepUntil(RT_PRESENT, origin + std::chrono::microseconds(next_start));
+            addWake(ts, wakeups[t.side & 1], wake_us);
+
+            // behind by more than a slot, skip to the slot this frame can still make
+            int64_t now = usSince(origin);
+            int64_t frame_us = (int64_t)t.frame_ms * 1000;
+            int64_t deadline = (int64_t)t.start_ms * 1000 + (int64_t)s.slot * frame_us;
+            if (now + (int64_t)s.cost_us > deadline + frame_us) {
+                uint32_t target = (uint32_t)((now + (int64_t)s.cost_us - (int64_t)t.start_ms * 1000) / frame_us);
+                ts.dropped += target - s.slot;
+                s.slot = target;
+                deadline = (int64_t)t.start_ms * 1000 + (int64_t)s.slot * frame_us;
+                if ((uint64_t)s.slot * frame_us >= (uint64_t)t.duration_ms * 1000) continue;
+            }
+
+            // content for the exact presentation time, not for the wakeup time
+            uint32_t t_us = (uint32_t)(deadline - (int64_t)t.start_ms * 1000);
+            uint64_t key = t.key ? t.key(t_us) : 0;
+            if (t.key && !FramePacer::needsFrame(t.side, key)) {
+                ts.unchanged++;
+                s.slot++;
+                continue;
+            }
+            int64_t begin = usSince(origin);
+            if (t.key && FrameCache::present(key, (uint8_t)t.side) == 0) {
+                ts.cached++;
+            } else {
+                t.draw(s.rgb, t_us);
+                LcdControl::LcdBufferFrom24Bit(s.lcd, s.rgb);
+                LcdData frame = { (uint8_t)t.side, s.lcd };
+                LcdControl::writeLcd(&frame);
+                if (t.key) FrameCache::store(key, (uint8_t)t.side, s.lcd);
+            }
+            int64_t end = usSince(origin);
+
+            float cost = (float)(end - begin);
+            s.cost_us = (s.cost_us == 0) ? cost : s.cost_us * 0.8f + cost * 0.2f;
+            ts.events++;
+            ts.avg_cost_ms += (cost / 1000.0f - ts.avg_cost_ms) / ts.events;
+            addLate(ts, end - deadline);
+            s.slot++;
+        }
+    }
+
+    static void applyServo(const ServoKey& key, int64_t late_us, TrackStats& ts) {
+        float distance = fabsf(key.angle - servo_angle[key.channel & 3]);
+        uint8_t speed = 100;
+        if (key.duration_ms > 0 && distance > 0) {
+            // arrive at time_ms + duration_ms even when starting late
+            float remaining_s = (key.duration_ms * 1000.0f - late_us) / 1000000.0f;
+            if (remaining_s > 0) {
+                float dps = distance / remaining_s;
+                speed = (uint8_t)std::min(100.0f, std::max(1.0f, ceilf(dps * 100.0f / TIMELINE_SERVO_MAX_DPS)));
+            }
+        }
+        if (ServoPower::isActive()) ServoPower::set(key.channel, key.angle, speed);
+        else ServoMotor::set(key.channel, key.angle, speed);
+        servo_angle[key.channel & 3] = key.angle;
+        ts.events++;
+        addLate(ts, late_us);
+    }
+
+    static void applyLeds(const std::vector<LedKey>& keys, uint32_t t_ms) {
+        static const PwmId pins[2][3] = {
+            { Pwm_Led_Left_R, Pwm_Led_Left_G, Pwm_Led_Left_B },
+            { Pwm_Led_Right_R, Pwm_Led_Right_G, Pwm_Led_Right_B },
+        };
+        for (uint8_t side = 0; side < 2; side++) {
+            const LedKey* prev = nullptr;
+            const LedKey* next = nullptr;
+            for (const LedKey& k : keys) {
+                if (k.side != side) continue;
+                if (k.time_ms <= t_ms) prev = &k;
+                else if (!next) next = &k;
+            }
+            if (!prev) continue;
+            float c[3] = { (float)prev->r, (float)prev->g, (float)prev->b };
+            if (next) {
+                float f = (float)(t_ms - prev->time_ms) / (next->time_ms - prev->time_ms);
+                c[0] += (next->r - c[0]) * f;
+                c[1] += (next->g - c[1]) * f;
+                c[2] += (next->b - c[2]) * f;
+            }
+            for (int i = 0; i < 3; i++) {
+                PwmShadow::writePwm(pins[side][i], (uint16_t)(c[i] * 4095.0f / 255.0f));
+            }
+        }
+    }
+
+    // request running play() to return early
+    inline void abort() {
+        abort_requested.store(true);
+    }
+
+    // play expression, blocks until every track finished
+    // servo and LED keys must be sorted by time
+    // LEDs are written through PwmShadow, init it before playing LED keys
+    inline PlayStats play(const Expression& expression) {
+        PlayStats stats = {};
+        abort_requested.store(false);
+        RtProfile::ScopedRole role(RT_SERVO);
+        // moves too early to pre-arm unpowered arms shift the whole expression, not just the arm
+        int64_t lead_us = 0;
+        if (ServoPower::isActive()) {
+            for (const ServoKey& k : expression.servos) {
+                if (ServoPower::isPowered(k.channel)) continue;
+                lead_us = std::max(lead_us, (int64_t)ServoPower::wakeLatencyUs() - (int64_t)k.time_ms * 1000);
+            }
+        }
+        Clock::time_point origin = Clock::now() + std::chrono::microseconds(lead_us);
+
+        for (const ServoKey& k : expression.servos) {
+            ServoPower::prearm(k.channel, origin + std::chrono::milliseconds(k.time_ms));
+        }
+
+        std::thread eye_thread;
+        if (!expression.eyes.empty()) {
+            eye_thread = std::thread(playEyes, std::cref(expression.eyes), origin, std::ref(stats));
+        }
+
+        uint32_t end_ms = 0;
+        for (const ServoKey& k : expression.servos) end_ms = std::max(end_ms, k.time_ms);
+        for (const LedKey& k : expression.leds) end_ms = std::max(end_ms, k.time_ms);
+
+        // control track: servo keys at their own deadlines, LEDs on the tick grid
+        size_t servo_index = 0;
+        int64_t led_tick = 0;
+        bool led_done = expression.leds.empty();
+        uint32_t wakeups[2] = { 0, 0 };     // servo, led
+        while (!abort_requested.load() && (servo_index < expression.servos.size() || !led_done)) {
+            int64_t servo_due = servo_index < expression.servos.size()
+                ? (int64_t)expression.servos[servo_index].time_ms * 1000 : INT64_MAX;
+            int64_t led_due = led_done ? INT64_MAX : led_tick;
+            int64_t due = std::min(servo_due, led_due);
+            int64_t wake_us = RtProfile::sleepUntil(RT_SERVO, origin + std::chrono::microseconds(due));
+            if (due == servo_due) addWake(stats.servo, wakeups[0], wake_us);
+            else addWake(stats.led, wakeups[1], wake_us);
+
+            int64_t now = usSince(origin);
+            while (servo_index < expression.servos.size() &&
+                   (int64_t)expression.servos[servo_index].time_ms * 1000 <= now) {
+                const ServoKey& key = expression.servos[servo_index++];
+                applyServo(key, now - (int64_t)key.time_ms * 1000, stats.servo);
+            }
+            if (!led_done && led_tick <= now) {
+                int64_t begin = usSince(origin);
+                applyLeds(expression.leds, (uint32_t)(now / 1000));
+                PwmShadow::flush();
+                int64_t end = usSince(origin);
+                stats.led.events++;
+                stats.led.avg_cost_ms += ((end - begin) / 1000.0f - stats.led.avg_cost_ms) / stats.led.events;
+                addLate(stats.led, now - led_tick);
+
+                // next tick on the grid, missed ticks are not replayed
+                led_tick += TIMELINE_LED_TICK_US * (1 + (now - led_tick) / TIMELINE_LED_TICK_US);
+                if (now / 1000 > end_ms) led_done = true;
+            }
+        }
+
+        if (eye_thread.joinable()) eye_thread.join();
+        stats.duration_ms = usSince(origin) / 1000.0f;
+        return stats;
+    }
+};
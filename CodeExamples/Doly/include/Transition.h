@@ -0,0 +1,129 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "RenderCore.h"
+
+// Transitions between two expressions.
+//
+// A transition frame is made from the image on screen when the outgoing
+// expression ends ('from') and the first frame of the incoming one ('to'),
+// both 24 bit render buffers, into a third buffer that is packed and written
+// like any frame:
+//   CROSS_FADE  fixed point blend, 8 bit alpha, 16 bytes per step
+//   WIPE        rows of 'to' grow from the top, one memcpy per row
+//   IRIS_CLOSE  the eyelid closes over 'from' and opens over 'to', drawn from
+//               the same row mask as a blink (the caller passes the mask of
+//               closure(progress))
+//
+//   for (int i = 1; i <= frames; i++) {
+//       Transition::render<Display>(Transition::CROSS_FADE, (float)i / frames, eye.render, from, to);
+//       Display::pack(eye.lcd, eye.render); LcdControl::writeLcd(&eye.frame);
+//   }
+//
+// The blend uses GCC vector extensions, compiled to NEON on the device and SSE2
+// on x86. Blending in the panel format is not done: 12 bit pixels share bytes.
+
+#define TRANSITION_DEFAULT_FRAMES 12
+
+namespace Transition
+{
+    enum Kind : uint8_t
+    {
+        CROSS_FADE = 0,
+        WIPE = 1,
+        IRIS_CLOSE = 2,
+    };
+
+    // one span per row first_row..last_row, x0, x1 per row (ex. an eyelid)
+    struct RowMask
+    {
+        int first_row, last_row;
+        const int16_t* rows;
+    };
+
+    struct TransitionStats
+    {
+        uint32_t frames;
+        float avg_us;           // render() of one frame
+        float max_us;
+    };
+
+    static TransitionStats transition_stats = {};
+
+    typedef uint8_t U8x16 __attribute__((vector_size(16)));
+    typedef uint16_t U16x16 __attribute__((vector_size(32)));
+
+    // out = (a * (256 - alpha) + b * alpha + 128) >> 8 per byte, 'alpha' 0..256
+    inline void crossFade(uint8_t* out, const uint8_t* a, const uint8_t* b, uint32_t alpha, size_t bytes) {
+        if (alpha > 256) alpha = 256;
+        const uint16_t wa = (uint16_t)(256 - alpha);
+        const uint16_t wb = (uint16_t)alpha;
+        size_t i = 0;
+        // 255 * 256 + 128 fits in 16 bits
+        for (; i + 16 <= bytes; i += 16) {
+            U8x16 va, vb;
+            memcpy(&va, a + i, 16);
+            memcpy(&vb, b + i, 16);
+            U16x16 sum = __builtin_convertvector(va, U16x16) * wa + __builtin_convertvector(vb, U16x16) * wb + 128;
+            U8x16 vo = __builtin_convertvector(sum >> 8, U8x16);
+            memcpy(out + i, &vo, 16);
+        }
+        for (; i < bytes; i++) {
+            out[i] = (uint8_t)((a[i] * wa + b[i] * wb + 128) >> 8);
+        }
+    }
+
+    // rows above 'edge' from 'b', the rest from 'a'
+    inline void wipe(uint8_t* out, const uint8_t* a, const uint8_t* b, int edge, int rows, int stride) {
+        edge = std::max(0, std::min(edge, rows));
+        memcpy(out, b, (size_t)edge * stride);
+        memcpy(out + (size_t)edge * stride, a + (size_t)edge * stride, (size_t)(rows - edge) * stride);
+    }
+
+    // eyelid closure of an IRIS_CLOSE transition, 0 open .. 1 closed at the middle .. 0 open
+    inline float closure(float progress) {
+        return progress < 0.5f ? progress * 2.0f : (1.0f - progress) * 2.0f;
+    }
+
+    // frame 'progress' (0 = from .. 1 = to) of transition 'kind' into 'out', 24 bit buffers of 'Spec'
+    // IRIS_CLOSE covers 'eyelid' (the mask of closure(progress)) with 'eyelid_color'
+    template <class Spec>
+    void render(Kind kind, float progress, uint8_t* out, const uint8_t* from, const uint8_t* to,
+                const RowMask* eyelid = nullptr, const RenderCore::Color& eyelid_color = RenderCore::Color()) {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point begin = Clock::now();
+        progress = std::max(0.0f, std::min(progress, 1.0f));
+        switch (kind) {
+        case CROSS_FADE:
+            crossFade(out, from, to, (uint32_t)(progress * 256.0f + 0.5f), Spec::BUFFER_SIZE);
+            break;
+        case WIPE:
+            wipe(out, from, to, (int)(progress * Spec::HEIGHT + 0.5f), Spec::HEIGHT, Spec::STRIDE);
+            break;
+        case IRIS_CLOSE:
+            memcpy(out, progress < 0.5f ? from : to, Spec::BUFFER_SIZE);
+            if (!eyelid) break;
+            for (int y = std::max(eyelid->first_row, 0); y <= std::min(eyelid->last_row, Spec::HEIGHT - 1); y++) {
+                const int16_t* span = eyelid->rows + (y - eyelid->first_row) * 2;
+                int x0 = std::max((int)span[0], 0);
+                int x1 = std::min((int)span[1], Spec::WIDTH - 1);
+                if (x0 <= x1) RenderCore::fillRow(out + Spec::offset(0, y), x0, x1, eyelid_color);
+            }
+            break;
+        }
+        float us = std::chrono::duration<float, std::micro>(Clock::now() - begin).count();
+        transition_stats.frames++;
+        transition_stats.avg_us += (us - transition_stats.avg_us) / transition_stats.frames;
+        transition_stats.max_us = std::max(transition_stats.max_us, us);
+    }
+
+    inline TransitionStats getStats() {
+        return transition_stats;
+    }
+
+    inline void resetStats() {
+        transition_stats = {};
+    }
+};
@@ -1,5 +1,25 @@
 // #include "LcdControl.h"
+// #include "ServoMotor.h"
+// #include "Gpio.h"
 #include "../Doly/include/LcdControl_x86_sim.h"
+#include "../Doly/include/Gpio_x86_sim.h"
+#include "../Doly/include/ServoMotor_x86_sim.h"
+#include "../Doly/include/ServoPower.h"
+#include "../Doly/include/Timeline.h"
+#include "../Doly/include/FrameRecorder.h"
+#include "../Doly/include/RenderCore.h"
+#include "../Doly/include/FrameArena.h"
+#include "../Doly/include/RtProfile.h"
+#include "../Doly/include/FramePacer.h"
+#include "../Doly/include/AsyncLog.h"
+#include "../Doly/include/BandPipeline.h"
+#include "../Doly/include/FrameCache.h"
+#include "../Doly/include/Clip.h"
+#include "../Doly/include/ClipStream.h"
+#include "../Doly/include/ParamMemo.h"
+#include "../Doly/include/Transition.h"
+#include "../Doly/include/Sprite.h"
+#include "../Doly/include/Atlas.h"
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -9,12 +29,22 @@
 #include <cstdlib>
 #include <random>
 #include <ctime>
+#include <string>
+#include <dirent.h>
 
-// LCD屏幕参数
-const int SCREEN_WIDTH = LCD_WIDTH;
-const int SCREEN_HEIGHT = LCD_HEIGHT;
-const int SCREEN_CENTER_X = SCREEN_WIDTH / 2;
-const int SCREEN_CENTER_Y = SCREEN_HEIGHT / 2;
+// LCD屏幕参数，编译时确定尺寸和颜色深度，绘制函数按此特化
+typedef RenderCore::DisplaySpec<LCD_WIDTH, LCD_HEIGHT, LCD_12BIT> EyeDisplay;
+typedef RenderCore::Canvas<EyeDisplay> EyeCanvas;
+// 每帧记录的形状列表，按行解析，每个像素只写一次
+typedef RenderCore::DisplayList<EyeDisplay> EyeList;
+// 调色板模式：每像素1字节调色板索引，转换时查表展开为屏幕格式
+typedef RenderCore::Canvas<EyeDisplay, uint8_t> EyeIndexCanvas;
+typedef RenderCore::Palette<EyeDisplay> EyePalette;
+
+const int SCREEN_WIDTH = EyeDisplay::WIDTH;
+const int SCREEN_HEIGHT = EyeDisplay::HEIGHT;
+const int SCREEN_CENTER_X = EyeDisplay::CENTER_X;
+const int SCREEN_CENTER_Y = EyeDisplay::CENTER_Y;
 
 // 眼睛参数 (根据图片调整)
 const int EYE_BACKGROUND_RADIUS = 120;    // 整个眼睛背景半径
@@ -24,10 +54,17 @@ const int HIGHLIGHT_RADIUS = 20;          // 白色高光半径
 const int HIGHLIGHT_OFFSET_X = -30;        // 高光X偏移
 const int HIGHLIGHT_OFFSET_Y = -30;        // 高光Y偏移
 
+// 愤怒时瞳孔收缩到70%
+const int ANGRY_PUPIL_MIN_RADIUS = PUPIL_RADIUS * 7 / 10;
+
+// 固定半径圆形的每行半宽表，编译时生成
+// 瞳孔表覆盖愤怒时的所有瞳孔半径和虹膜环外圆
+static constexpr RenderCore::CircleSpans<EYE_BACKGROUND_RADIUS, EYE_BACKGROUND_RADIUS> EYE_SPANS;
+static constexpr RenderCore::CircleSpans<ANGRY_PUPIL_MIN_RADIUS, PUPIL_RADIUS + IRIS_RING_WIDTH> PUPIL_SPANS;
+static constexpr RenderCore::CircleSpans<HIGHLIGHT_RADIUS, HIGHLIGHT_RADIUS> HIGHLIGHT_SPANS;
+
 // 定义颜色
-struct Color {
-    uint8_t r, g, b;
-};
+using RenderCore::Color;
 
 const Color COLOR_BLACK_BG = {0, 0, 0};           // 黑色屏幕背景
 const Color COLOR_WHITE_EYE = {255, 255, 255};    // 白色眼球
@@ -59,184 +96,459 @@ const int MAX_FLAME_PARTICLES = 12;
 const int FLAME_AREA_WIDTH = 200;
 const int FLAME_AREA_HEIGHT = 80;
 
+// 调色板模式 (--indexed)
+// 平面颜色按首次使用加入调色板，火焰的黄/橙/红亮度渐变放在保留的渐变区
+const int FLAME_RAMP_LEVELS = 32;                      // 每种火焰颜色的亮度级数
+const int FLAME_RAMP_FIRST = PALETTE_GRADIENT_FIRST;   // 黄、橙、红依次排列
+static EyePalette eye_palette;
+static bool indexed_mode = false;
+static uint8_t angry_iris_slot = 0;    // 愤怒虹膜占一个调色板项，按愤怒程度改颜色
+
+/**
+ * @brief 初始化调色板：火焰渐变和愤怒虹膜项
+ */
+void init_eye_palette() {
+    const Color black = {0, 0, 0};
+    eye_palette.gradient(FLAME_RAMP_FIRST, FLAME_RAMP_LEVELS, black, COLOR_FLAME_YELLOW);
+    eye_palette.gradient(FLAME_RAMP_FIRST + FLAME_RAMP_LEVELS, FLAME_RAMP_LEVELS, black, COLOR_FLAME_ORANGE);
+    eye_palette.gradient(FLAME_RAMP_FIRST + 2 * FLAME_RAMP_LEVELS, FLAME_RAMP_LEVELS, black, COLOR_FLAME_RED);
+    angry_iris_slot = eye_palette.reserve(COLOR_BLUE_IRIS);
+}
+
+// 颜色在渲染缓冲区中的值：24位颜色或调色板索引
+template <class Ink> Ink eye_ink(const Color& color);
+
+template <> inline Color eye_ink<Color>(const Color& color) {
+    return color;
+}
+
+template <> inline uint8_t eye_ink<uint8_t>(const Color& color) {
+    return eye_palette.indexOf(color);
+}
+
+// 愤怒虹膜：24位颜色，或颜色随愤怒程度改变的调色板项
+template <class Ink> Ink angry_iris_ink(const Color& color);
+
+template <> inline Color angry_iris_ink<Color>(const Color& color) {
+    return color;
+}
+
+template <> inline uint8_t angry_iris_ink<uint8_t>(const Color&) {
+    return angry_iris_slot;
+}
+
+// 火焰颜色 zone: 0 黄色中心, 1 橙色中间, 2 红色边缘，按强度变暗
+template <class Ink> Ink flame_ink(int zone, float intensity);
+
+template <> inline Color flame_ink<Color>(int zone, float intensity) {
+    const Color& base = zone == 0 ? COLOR_FLAME_YELLOW : (zone == 1 ? COLOR_FLAME_ORANGE : COLOR_FLAME_RED);
+    Color final_color;
+    final_color.r = (uint8_t)(base.r * intensity);
+    final_color.g = (uint8_t)(base.g * intensity);
+    final_color.b = (uint8_t)(base.b * intensity);
+    return final_color;
+}
+
+template <> inline uint8_t flame_ink<uint8_t>(int zone, float intensity) {
+    int level = (int)(intensity * (FLAME_RAMP_LEVELS - 1) + 0.5f);
+    level = std::max(0, std::min(FLAME_RAMP_LEVELS - 1, level));
+    return (uint8_t)(FLAME_RAMP_FIRST + zone * FLAME_RAMP_LEVELS + level);
+}
+
+// 解析形状列表到24位或调色板索引缓冲区
+template <class Ink> void resolve_eye_list(const EyeList& list, uint8_t* buffer);
+
+template <> inline void resolve_eye_list<Color>(const EyeList& list, uint8_t* buffer) {
+    list.resolve(buffer);
+}
+
+template <> inline void resolve_eye_list<uint8_t>(const EyeList& list, uint8_t* buffer) {
+    list.resolve(buffer, eye_palette);
+}
+
+// 连续参数（愤怒程度、眨眼进度）取整到若干档，每档的局部图像只生成一次（ParamMemo）
+const int PUPIL_IMAGE_RADIUS = PUPIL_RADIUS + IRIS_RING_WIDTH;
+const int PUPIL_IMAGE_SIZE = PUPIL_IMAGE_RADIUS * 2 + 1;
+typedef RenderCore::DisplaySpec<PUPIL_IMAGE_SIZE, PUPIL_IMAGE_SIZE, LCD_18BIT> PupilSpec;
+const int EYELID_ROWS = EYE_BACKGROUND_RADIUS * 2 + 1;
+
+// 一档愤怒程度的瞳孔和虹膜，图像中心是瞳孔中心，每行只覆盖 -half..half
+template <class Ink>
+struct PupilImage {
+    Color iris_color;
+    int16_t half[PUPIL_IMAGE_SIZE];     // 虹膜外圆每行半宽，-1 为空行
+    std::vector<uint8_t> pixels;        // PUPIL_IMAGE_SIZE x PUPIL_IMAGE_SIZE，24位颜色或调色板索引
+    size_t bytes() const { return sizeof(*this) + pixels.size(); }
+};
+
+// 一档眨眼进度的眼皮，每行覆盖 x0..x1
+struct EyelidMask {
+    int first_row, last_row;
+    int16_t rows[EYELID_ROWS][2];
+    size_t bytes() const { return sizeof(*this); }
+};
+
+static ParamMemo::Table<PupilImage<Color>> pupil_images;
+static ParamMemo::Table<PupilImage<uint8_t>> pupil_index_images;
+static ParamMemo::Table<EyelidMask> eyelid_masks;
+
+template <class Ink> ParamMemo::Table<PupilImage<Ink>>& pupil_table();
+
+template <> inline ParamMemo::Table<PupilImage<Color>>& pupil_table<Color>() {
+    return pupil_images;
+}
+
+template <> inline ParamMemo::Table<PupilImage<uint8_t>>& pupil_table<uint8_t>() {
+    return pupil_index_images;
+}
+
+/**
+ * @brief 生成某个愤怒程度的瞳孔图像：黑色瞳孔随愤怒收缩，虹膜由蓝变红
+ */
+template <class Ink>
+void build_pupil_image(PupilImage<Ink>& image, float anger_level) {
+    // 半径取整后只有 ANGRY_PUPIL_MIN_RADIUS..PUPIL_RADIUS 几档，每档都有预生成的表
+    int pupil_radius = (int)(PUPIL_RADIUS * (0.7f + 0.3f * (1.0f - anger_level)));
+    int outer_radius = pupil_radius + IRIS_RING_WIDTH;
+    image.iris_color.r = (uint8_t)(COLOR_BLUE_IRIS.r + (COLOR_ANGRY_RED.r - COLOR_BLUE_IRIS.r) * anger_level);
+    image.iris_color.g = (uint8_t)(COLOR_BLUE_IRIS.g + (COLOR_ANGRY_RED.g - COLOR_BLUE_IRIS.g) * anger_level);
+    image.iris_color.b = (uint8_t)(COLOR_BLUE_IRIS.b + (COLOR_ANGRY_RED.b - COLOR_BLUE_IRIS.b) * anger_level);
+    // 调色板模式虹膜使用固定的调色板项，颜色在绘制时设置
+    Ink iris = angry_iris_ink<Ink>(image.iris_color);
+    Ink pupil = eye_ink<Ink>(COLOR_BLACK_PUPIL);
+
+    image.pixels.assign(PUPIL_IMAGE_SIZE * PUPIL_IMAGE_SIZE * sizeof(Ink), 0);
+    RenderCore::Canvas<PupilSpec, Ink> canvas(image.pixels.data());
+    const int c = PUPIL_IMAGE_RADIUS;
+    if (PUPIL_SPANS.contains(pupil_radius) && PUPIL_SPANS.contains(outer_radius)) {
+        canvas.fillCircle(c, c, PUPIL_SPANS.get(pupil_radius), pupil);
+        canvas.fillRing(c, c, PUPIL_SPANS.get(pupil_radius), PUPIL_SPANS.get(outer_radius), iris);
+    } else {
+        canvas.fillCircle(c, c, pupil_radius, pupil);
+        canvas.fillRing(c, c, pupil_radius, outer_radius, iris);
+    }
+    for (int dy = -c; dy <= c; ++dy) {
+        image.half[dy + c] = (int16_t)(dy < -outer_radius || dy > outer_radius ? -1 : RenderCore::isqrt(outer_radius * outer_radius - dy * dy));
+    }
+}
+
+/**
+ * @brief 当前档数下某个愤怒程度的瞳孔图像
+ */
+template <class Ink>
+const PupilImage<Ink>& pupil_image(float anger_level) {
+    ParamMemo::Table<PupilImage<Ink>>& table = pupil_table<Ink>();
+    int step = ParamMemo::quantize(anger_level, table.steps());
+    return table.get(step, [&](PupilImage<Ink>& image) {
+        build_pupil_image<Ink>(image, ParamMemo::level(step, table.steps()));
+    });
+}
+
+/**
+ * @brief 把瞳孔图像复制到 (center_x, center_y)，每行一次memcpy
+ */
+template <class Ink>
+void blit_pupil_image(uint8_t* buffer, const PupilImage<Ink>& image, int center_x, int center_y) {
+    const int c = PUPIL_IMAGE_RADIUS;
+    for (int dy = -c; dy <= c; ++dy) {
+        int y = center_y + dy;
+        int half = image.half[dy + c];
+        if (half < 0 || y < 0 || y >= SCREEN_HEIGHT) continue;
+        int x0 = std::max(center_x - half, 0);
+        int x1 = std::min(center_x + half, SCREEN_WIDTH - 1);
+        if (x0 > x1) continue;
+        memcpy(buffer + (y * SCREEN_WIDTH + x0) * sizeof(Ink),
+               image.pixels.data() + ((dy + c) * PUPIL_IMAGE_SIZE + x0 - center_x + c) * sizeof(Ink),
+               (x1 - x0 + 1) * sizeof(Ink));
+    }
+}
+
+/**
+ * @brief 眨眼进度对应的档，同一档的画面相同
+ */
+int blink_step(float blink_progress) {
+    return ParamMemo::quantize(blink_progress, eyelid_masks.steps());
+}
+
+/**
+ * @brief 某档眨眼进度的眼皮：眼睛圆形在眼皮下沿以上的部分
+ */
+const EyelidMask& eyelid_mask(int step) {
+    return eyelid_masks.get(step, [step](EyelidMask& mask) {
+        // 0.0 = 完全睁开, 1.0 = 完全闭上
+        float blink_progress = ParamMemo::level(step, eyelid_masks.steps());
+        int eyelid_height = (int)(blink_progress * EYE_BACKGROUND_RADIUS * 2);
+        int y_end = SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS + eyelid_height;
+        const RenderCore::CircleRows& circle = EYE_SPANS.get(EYE_BACKGROUND_RADIUS);
+        mask.first_row = SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS;
+        mask.last_row = std::min(SCREEN_CENTER_Y + EYE_BACKGROUND_RADIUS, y_end - 1);
+        for (int i = 0; i < EYELID_ROWS; ++i) {
+            mask.rows[i][0] = (int16_t)(SCREEN_CENTER_X - circle.half[i]);
+            mask.rows[i][1] = (int16_t)(SCREEN_CENTER_X + circle.half[i]);
+        }
+    });
+}
+
+// 叠加图案（火焰粒子、眉毛、泪滴）预先生成为精灵：透明像素不存，不透明行段整段复制，
+// 抗锯齿边缘按预乘alpha混合（Sprite），每帧只画覆盖到的像素
+const int FLAME_SPRITE_RADIUS = 20;         // 粒子半径 size * life * flicker 不超过 20
+const int FLAME_SPRITE_LEVELS = 16;         // 粒子亮度 life * flicker 的档数
+const int FLAME_SPRITE_KEYS = (FLAME_SPRITE_RADIUS + 1) * (FLAME_SPRITE_LEVELS + 1);
+const int EYEBROW_THICKNESS = 9;
+const int EYEBROW_SLANT = 12;               // 最大倾斜12像素
+const int EYEBROW_LENGTH = EYE_BACKGROUND_RADIUS - 30;
+const int EYEBROW_HEIGHT = EYEBROW_THICKNESS + EYEBROW_SLANT + 1;
+const int TEAR_SPRITE_MAX_SIZE = 32;
+const int TEAR_SIZE = 8;                    // 悲伤表情的泪滴，图案文件按这个大小打包
+const int SPRITE_SUBSAMPLES = 4;            // 边缘覆盖度每像素 4x4 采样
+
+template <class Ink>
+struct OverlaySprites {
+    ParamMemo::Table<Sprite::Image<Ink>> flames{FLAME_SPRITE_KEYS - 1};    // 半径 * (档数 + 1) + 亮度档
+    ParamMemo::Table<Sprite::Image<Ink>> eyebrows{0};                      // 左右眼相同
+};
+
+static OverlaySprites<Color> overlay_sprites;
+static OverlaySprites<uint8_t> overlay_index_sprites;
+static ParamMemo::Table<Sprite::Image<Color>> tear_sprites(TEAR_SPRITE_MAX_SIZE);
+
+template <class Ink> OverlaySprites<Ink>& overlay_table();
+
+template <> inline OverlaySprites<Color>& overlay_table<Color>() {
+    return overlay_sprites;
+}
+
+template <> inline OverlaySprites<uint8_t>& overlay_table<uint8_t>() {
+    return overlay_index_sprites;
+}
+
+/**
+ * @brief 以 (x, y) 为中心的像素被形状覆盖的比例 0..255，inside(fx, fy) 判断采样点是否在形状内
+ */
+template <class Inside>
+uint8_t sample_coverage(int x, int y, Inside inside) {
+    int hits = 0;
+    for (int sy = 0; sy < SPRITE_SUBSAMPLES; ++sy) {
+        for (int sx = 0; sx < SPRITE_SUBSAMPLES; ++sx) {
+            float fx = x - 0.5f + (sx + 0.5f) / SPRITE_SUBSAMPLES;
+            float fy = y - 0.5f + (sy + 0.5f) / SPRITE_SUBSAMPLES;
+            if (inside(fx, fy)) hits++;
+        }
+    }
+    return (uint8_t)(hits * 255 / (SPRITE_SUBSAMPLES * SPRITE_SUBSAMPLES));
+}
+
+/**
+ * @brief 某个半径和亮度的火焰粒子：中心黄色，中间橙色，边缘红色，越往外越暗
+ */
+template <class Ink>
+const Sprite::Image<Ink>& flame_sprite(int radius, float brightness) {
+    radius = std::max(1, std::min(radius, FLAME_SPRITE_RADIUS));
+    int level = ParamMemo::quantize(brightness, FLAME_SPRITE_LEVELS);
+    return overlay_table<Ink>().flames.get(radius * (FLAME_SPRITE_LEVELS + 1) + level, [&](Sprite::Image<Ink>& sprite) {
+        float scale = ParamMemo::level(level, FLAME_SPRITE_LEVELS);
+        const int c = radius + 1;
+        Sprite::build(sprite, c * 2 + 1, c * 2 + 1, c, c, [&](int x, int y, Ink& ink) -> uint8_t {
+            int dx = x - c;
+            int dy = y - c;
+            float dist = std::min(sqrtf((float)(dx * dx + dy * dy)) / radius, 1.0f);
+            int zone = dist < 0.3f ? 0 : (dist < 0.7f ? 1 : 2);
+            ink = flame_ink<Ink>(zone, (1.0f - dist) * scale);
+            return sample_coverage(dx, dy, [&](float fx, float fy) { return fx * fx + fy * fy <= radius * radius; });
+        });
+    });
+}
+
+/**
+ * @brief 泪滴：圆形主体加上下方变窄的尖端，中心在主体圆心
+ */
+const Sprite::Image<Color>& tear_sprite(int size) {
+    size = std::max(1, std::min(size, TEAR_SPRITE_MAX_SIZE));
+    return tear_sprites.get(size, [size](Sprite::Image<Color>& sprite) {
+        const int c = size + 1;
+        Sprite::build(sprite, c * 2 + 1, c * 2 + size / 2 + 1, c, c, [&](int x, int y, Color& color) -> uint8_t {
+            color = COLOR_TEAR;
+            return sample_coverage(x - c, y - c, [&](float fx, float fy) {
+                if (fx * fx + fy * fy <= size * size) return true;
+                float tip = fy - size;      // 尖端每往下一行窄一个像素
+                return tip > 0.0f && tip < size / 2 + 0.5f && fabsf(fx) <= (size - tip) / 2;
+            });
+        });
+    });
+}
+
+/**
+ * @brief 眉毛（粗线条，向右下倾斜），以中心定位，边缘抗锯齿
+ */
+template <class Ink>
+void build_eyebrow_sprite(Sprite::Image<Ink>& eyebrow) {
+    Ink eyebrow_color = eye_ink<Ink>(COLOR_BLACK_PUPIL);
+    Sprite::build(eyebrow, EYEBROW_LENGTH + 1, EYEBROW_HEIGHT, EYEBROW_LENGTH / 2, EYEBROW_HEIGHT / 2,
+                  [&](int x, int y, Ink& ink) -> uint8_t {
+        ink = eyebrow_color;
+        return sample_coverage(x, y, [](float fx, float fy) {
+            // 眉毛倾斜角度
+            float top = fx / EYEBROW_LENGTH * EYEBROW_SLANT;
+            return fx >= -0.5f && fx <= EYEBROW_LENGTH + 0.5f && fy >= top - 0.5f && fy < top + EYEBROW_THICKNESS - 0.5f;
+        });
+    });
+}
+
+// 打包的图案（--pack-atlas 生成，--atlas 加载）：同名图案代替内置精灵，直接从映射绘制
+// 调色板模式不能混合，仍使用内置精灵
+enum ArtSprite {
+    ART_TEAR,
+    ART_EYEBROW,
+    ART_COUNT
+};
+const char* const ART_NAMES[ART_COUNT] = { "tear", "eyebrow" };
+static Atlas::Reader art_atlas;
+static Sprite::View<Color> art_sprites[ART_COUNT];
+static bool art_loaded[ART_COUNT] = {};
+
+// 绘制打包的图案，没有时返回 false
+template <class Ink> bool draw_art(uint8_t* buffer, ArtSprite art, int x, int y);
+
+template <> inline bool draw_art<Color>(uint8_t* buffer, ArtSprite art, int x, int y) {
+    if (!art_loaded[art]) return false;
+    Sprite::draw<EyeDisplay>(buffer, art_sprites[art], x, y);
+    return true;
+}
+
+template <> inline bool draw_art<uint8_t>(uint8_t*, ArtSprite, int, int) {
+    return false;
+}
+
+/**
+ * @brief 打包图案文件：目录中的 .pam/.ppm 图片（文件名为图案名，以中心定位），
+ * 没有提供图片的内置图案（泪滴、眉毛）按内置精灵打包
+ */
+int pack_atlas(const char* path, const char* art_dir) {
+    Atlas::Writer atlas;
+    Sprite::Image<Color> eyebrow;
+    build_eyebrow_sprite<Color>(eyebrow);
+    atlas.add(ART_NAMES[ART_TEAR], tear_sprite(TEAR_SIZE));
+    atlas.add(ART_NAMES[ART_EYEBROW], eyebrow);
+
+    int images = 0;
+    DIR* dir = nullptr;
+    if (art_dir) {
+        dir = opendir(art_dir);
+        if (!dir) {
+            std::cerr << "无法打开图案目录: " << art_dir << std::endl;
+            return -1;
+        }
+    }
+    while (dir) {
+        struct dirent* entry = readdir(dir);
+        if (!entry) break;
+        std::string file = entry->d_name;
+        size_t dot = file.rfind('.');
+        if (dot == std::string::npos || (file.compare(dot, std::string::npos, ".pam") != 0 &&
+                                         file.compare(dot, std::string::npos, ".ppm") != 0)) {
+            continue;
+        }
+        std::string image_path = std::string(art_dir) + "/" + file;
+        int8_t result = atlas.addImage(file.substr(0, dot).c_str(), image_path.c_str());
+        if (result != 0) {
+            std::cerr << (result == -1 ? "图案名太长: " : "无法读取图片: ") << image_path << std::endl;
+            closedir(dir);
+            return -1;
+        }
+        images++;
+    }
+    if (dir) closedir(dir);
+
+    int64_t bytes = atlas.write(path);
+    if (bytes < 0) {
+        std::cerr << "无法写入图案文件: " << path << std::endl;
+        return -1;
+    }
+    std::cout << "图案: " << atlas.count() << " 个 (图片 " << images << "), 文件大小: " << bytes / 1024 << " KB" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief 映射图案文件，内置图案的同名图案代替内置精灵
+ */
+int load_atlas(const char* path) {
+    int8_t result = art_atlas.open(path);
+    if (result != 0) {
+        LOG_ERROR("无法打开图案文件: " << path << " 错误: " << (int)result);
+        return -1;
+    }
+    int replaced = 0;
+    for (int i = 0; i < ART_COUNT; ++i) {
+        art_loaded[i] = art_atlas.find(ART_NAMES[i], art_sprites[i]) == 0;
+        if (art_loaded[i]) replaced++;
+    }
+    LOG_PRINT("🖼 图案: " << art_atlas.count() << " 个, " << art_atlas.header()->data_bytes / 1024
+              << " KB, 代替内置精灵 " << replaced << " 个");
+    return 0;
+}
+
 /**
  * @brief 在24位缓冲区中设置像素颜色
  */
 void set_pixel_24bit(uint8_t* buffer, int x, int y, const Color& color) {
-    if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-        int index = (y * SCREEN_WIDTH + x) * 3;
-        buffer[index] = color.r;
-        buffer[index + 1] = color.g;
-        buffer[index + 2] = color.b;
-    }
+    EyeCanvas(buffer).setPixel(x, y, color);
 }
 
 /**
  * @brief 清空整个24位缓冲区
  */
 void clear_buffer_24bit(uint8_t* buffer, const Color& color) {
-    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
-        for (int x = 0; x < SCREEN_WIDTH; ++x) {
-            set_pixel_24bit(buffer, x, y, color);
-        }
-    }
+    EyeCanvas(buffer).clear(color);
 }
 
 /**
  * @brief 绘制填充的圆形
  */
 void draw_filled_circle_24bit(uint8_t* buffer, int center_x, int center_y, int radius, const Color& color) {
-    int radius_sq = radius * radius;
-    
-    for (int y = center_y - radius; y <= center_y + radius; ++y) {
-        for (int x = center_x - radius; x <= center_x + radius; ++x) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                int dx = x - center_x;
-                int dy = y - center_y;
-                if (dx * dx + dy * dy <= radius_sq) {
-                    set_pixel_24bit(buffer, x, y, color);
-                }
-            }
-        }
-    }
+    EyeCanvas(buffer).fillCircle(center_x, center_y, radius, color);
 }
 
 /**
  * @brief 绘制环形（外圆减去内圆）
  */
 void draw_ring_24bit(uint8_t* buffer, int center_x, int center_y, int inner_radius, int outer_radius, const Color& color) {
-    int outer_sq = outer_radius * outer_radius;
-    int inner_sq = inner_radius * inner_radius;
-    
-    for (int y = center_y - outer_radius; y <= center_y + outer_radius; ++y) {
-        for (int x = center_x - outer_radius; x <= center_x + outer_radius; ++x) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                int dx = x - center_x;
-                int dy = y - center_y;
-                int dist_sq = dx * dx + dy * dy;
-                if (dist_sq <= outer_sq && dist_sq > inner_sq) {
-                    set_pixel_24bit(buffer, x, y, color);
-                }
-            }
-        }
-    }
+    EyeCanvas(buffer).fillRing(center_x, center_y, inner_radius, outer_radius, color);
 }
 
 /**
  * @brief 绘制椭圆（用于眨眼效果）
  */
 void draw_filled_ellipse_24bit(uint8_t* buffer, int center_x, int center_y, int radius_x, int radius_y, const Color& color) {
-    for (int y = center_y - radius_y; y <= center_y + radius_y; ++y) {
-        for (int x = center_x - radius_x; x <= center_x + radius_x; ++x) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                float dx = (float)(x - center_x) / radius_x;
-                float dy = (float)(y - center_y) / radius_y;
-                if (dx * dx + dy * dy <= 1.0f) {
-                    set_pixel_24bit(buffer, x, y, color);
-                }
-            }
-        }
-    }
+    EyeCanvas(buffer).fillEllipse(center_x, center_y, radius_x, radius_y, color);
 }
 
 /**
  * @brief 绘制四角星型高光
  */
 void draw_star_highlight_24bit(uint8_t* buffer, int center_x, int center_y, int size, const Color& color) {
-    // 四角星由四个三角形组成，每个三角形指向不同方向
-    int half_size = size / 2;
-    
-    // 绘制四个三角形，形成四角星
-    // 1. 向上的三角形
-    for (int y = center_y - half_size; y <= center_y; ++y) {
-        int width = (y - (center_y - half_size)) * 2 + 1;
-        for (int x = center_x - width/2; x <= center_x + width/2; ++x) {
-            set_pixel_24bit(buffer, x, y, color);
-        }
-    }
-    
-    // 2. 向下的三角形
-    for (int y = center_y; y <= center_y + half_size; ++y) {
-        int width = ((center_y + half_size) - y) * 2 + 1;
-        for (int x = center_x - width/2; x <= center_x + width/2; ++x) {
-            set_pixel_24bit(buffer, x, y, color);
-        }
-    }
-    
-    // 3. 向左的三角形
-    for (int x = center_x - half_size; x <= center_x; ++x) {
-        int height = (x - (center_x - half_size)) * 2 + 1;
-        for (int y = center_y - height/2; y <= center_y + height/2; ++y) {
-            set_pixel_24bit(buffer, x, y, color);
-        }
-    }
-    
-    // 4. 向右的三角形
-    for (int x = center_x; x <= center_x + half_size; ++x) {
-        int height = ((center_x + half_size) - x) * 2 + 1;
-        for (int y = center_y - height/2; y <= center_y + height/2; ++y) {
-            set_pixel_24bit(buffer, x, y, color);
-        }
-    }
+    // 四角星由上下左右四个三角形组成，合起来是一个菱形，按行绘制
+    EyeCanvas(buffer).fillDiamond(center_x, center_y, size / 2, color);
 }
 
 /**
  * @brief 绘制火焰粒子
  */
-void draw_flame_particle_24bit(uint8_t* buffer, const FlameParticle& particle) {
+template <class Ink>
+void draw_flame_particle(uint8_t* buffer, const FlameParticle& particle) {
     if (particle.life <= 0.0f) return;
     
-    int center_x = particle.x;
-    int center_y = particle.y;
     int radius = (int)(particle.size * particle.life * particle.flicker);
     
     if (radius <= 0) return;
     
-    // 绘制火焰粒子（渐变圆形）
-    for (int y = center_y - radius; y <= center_y + radius; ++y) {
-        for (int x = center_x - radius; x <= center_x + radius; ++x) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                int dx = x - center_x;
-                int dy = y - center_y;
-                int dist_sq = dx * dx + dy * dy;
-                
-                if (dist_sq <= radius * radius) {
-                    // 计算距离中心的相对位置
-                    float dist = sqrt(dist_sq) / radius;
-                    
-                    // 根据距离计算颜色强度
-                    float intensity = (1.0f - dist) * particle.life * particle.flicker;
-                    
-                    // 混合火焰颜色
-                    Color final_color;
-                    if (dist < 0.3f) {
-                        // 中心：黄色
-                        final_color.r = (uint8_t)(COLOR_FLAME_YELLOW.r * intensity);
-                        final_color.g = (uint8_t)(COLOR_FLAME_YELLOW.g * intensity);
-                        final_color.b = (uint8_t)(COLOR_FLAME_YELLOW.b * intensity);
-                    } else if (dist < 0.7f) {
-                        // 中间：橙色
-                        final_color.r = (uint8_t)(COLOR_FLAME_ORANGE.r * intensity);
-                        final_color.g = (uint8_t)(COLOR_FLAME_ORANGE.g * intensity);
-                        final_color.b = (uint8_t)(COLOR_FLAME_ORANGE.b * intensity);
-                    } else {
-                        // 边缘：红色
-                        final_color.r = (uint8_t)(COLOR_FLAME_RED.r * intensity);
-                        final_color.g = (uint8_t)(COLOR_FLAME_RED.g * intensity);
-                        final_color.b = (uint8_t)(COLOR_FLAME_RED.b * intensity);
-                    }
-                    
-                    set_pixel_24bit(buffer, x, y, final_color);
-                }
-            }
-        }
-    }
+    // 火焰粒子（渐变圆形）按半径和亮度取预先生成的精灵，边缘和背景混合
+    Sprite::draw<EyeDisplay>(buffer, flame_sprite<Ink>(radius, particle.life * particle.flicker), particle.x, particle.y);
 }
 
 /**
- * @brief 绘制火焰效果
+ * @brief 更新火焰粒子，返回 MAX_FLAME_PARTICLES 个粒子
  */
-void draw_flame_effect_24bit(uint8_t* buffer, int center_x, int center_y, int frame_count) {
+const FlameParticle* update_flame_effect(int center_x, int center_y, int frame_count) {
     static FlameParticle particles[MAX_FLAME_PARTICLES];
     static bool initialized = false;
     
@@ -261,7 +573,7 @@ void draw_flame_effect_24bit(uint8_t* buffer, int center_x, int center_y, int fr
         initialized = true;
     }
     
-    // 更新和绘制火焰粒子
+    // 更新火焰粒子
     for (int i = 0; i < MAX_FLAME_PARTICLES; ++i) {
         // 更新粒子位置和生命周期
         particles[i].y -= particles[i].speed;
@@ -275,227 +587,387 @@ void draw_flame_effect_24bit(uint8_t* buffer, int center_x, int center_y, int fr
             particles[i].life = 0.8f + (rand() % 20) / 100.0f;
             particles[i].size = 8 + rand() % 12;
         }
-        
-        // 绘制火焰粒子
-        draw_flame_particle_24bit(buffer, particles[i]);
+    }
+    return particles;
+}
+
+/**
+ * @brief 绘制火焰效果
+ */
+template <class Ink>
+void draw_flame_effect(uint8_t* buffer, int center_x, int center_y, int frame_count) {
+    const FlameParticle* particles = update_flame_effect(center_x, center_y, frame_count);
+    for (int i = 0; i < MAX_FLAME_PARTICLES; ++i) {
+        draw_flame_particle<Ink>(buffer, particles[i]);
     }
 }
 
 /**
  * @brief 绘制愤怒的眉毛
  */
-void draw_angry_eyebrow_24bit(uint8_t* buffer, int center_x, int center_y, bool is_left) {
+template <class Ink>
+void draw_angry_eyebrow(uint8_t* buffer, int center_x, int center_y, bool is_left) {
     int eyebrow_y = center_y - EYE_BACKGROUND_RADIUS - 25;
-    int eyebrow_start_x, eyebrow_end_x;
+    // 左眼眉毛在左半边，右眼眉毛在右半边，长度相同
+    int eyebrow_start_x = is_left ? center_x - EYE_BACKGROUND_RADIUS + 10 : center_x + 20;
+    int x = eyebrow_start_x + EYEBROW_LENGTH / 2;
+    int y = eyebrow_y + EYEBROW_HEIGHT / 2;
+    if (draw_art<Ink>(buffer, ART_EYEBROW, x, y)) return;
     
-    if (is_left) {
-        // 左眼眉毛：向右下方倾斜
-        eyebrow_start_x = center_x - EYE_BACKGROUND_RADIUS + 10;
-        eyebrow_end_x = center_x - 20;
-    } else {
-        // 右眼眉毛：向左下方倾斜
-        eyebrow_start_x = center_x + 20;
-        eyebrow_end_x = center_x + EYE_BACKGROUND_RADIUS - 10;
-    }
-    
-    // 绘制眉毛（粗线条）
-    for (int x = eyebrow_start_x; x <= eyebrow_end_x; ++x) {
-        for (int y = eyebrow_y; y <= eyebrow_y + 8; ++y) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                // 计算眉毛倾斜角度
-                float progress = (float)(x - eyebrow_start_x) / (eyebrow_end_x - eyebrow_start_x);
-                int offset_y = (int)(progress * 12); // 最大倾斜12像素
-                
-                if (y >= eyebrow_y && y <= eyebrow_y + 8) {
-                    set_pixel_24bit(buffer, x, y + offset_y, COLOR_BLACK_PUPIL);
-                }
-            }
-        }
-    }
+    // 眉毛（粗线条）只生成一次
+    const Sprite::Image<Ink>& sprite = overlay_table<Ink>().eyebrows.get(0, [](Sprite::Image<Ink>& eyebrow) {
+        build_eyebrow_sprite<Ink>(eyebrow);
+    });
+    Sprite::draw<EyeDisplay>(buffer, sprite, x, y);
 }
 
 /**
  * @brief 绘制增强的愤怒眼睛
  */
-void draw_angry_eye_enhanced_24bit(uint8_t* buffer, int pupil_offset_x, int pupil_offset_y, 
-                                 float anger_level, bool show_flame, int frame_count) {
-    // 1. 清空为愤怒背景色（稍微偏红）
-    clear_buffer_24bit(buffer, COLOR_ANGRY_BG);
+template <class Ink>
+void draw_angry_eye_enhanced(uint8_t* buffer, int pupil_offset_x, int pupil_offset_y, 
+                             float anger_level, bool show_flame, int frame_count) {
+    // 背景和眼球记录后一次解析，瞳孔图像、眉毛和火焰画在上面
+    EyeList list;
     
-    // 2. 绘制白色眼球背景
-    draw_filled_circle_24bit(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_BACKGROUND_RADIUS, COLOR_WHITE_EYE);
+    // 1. 愤怒背景色（稍微偏红）
+    list.fill(COLOR_ANGRY_BG);
     
-    // 3. 根据愤怒程度调整瞳孔大小（愤怒时瞳孔收缩）
-    int current_pupil_radius = (int)(PUPIL_RADIUS * (0.7f + 0.3f * (1.0f - anger_level)));
+    // 2. 白色眼球背景
+    list.circle(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_SPANS.get(EYE_BACKGROUND_RADIUS), COLOR_WHITE_EYE);
     
-    // 4. 绘制黑色瞳孔
-    draw_filled_circle_24bit(buffer, SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y, 
-                            current_pupil_radius, COLOR_BLACK_PUPIL);
+    // 3. 根据愤怒程度取整后的瞳孔和虹膜图像（愤怒时瞳孔收缩，虹膜变红），每档只生成一次
+    const PupilImage<Ink>& pupil = pupil_image<Ink>(anger_level);
+    // 调色板模式只改虹膜项的颜色，不为每档愤怒程度新增调色板项
+    if (sizeof(Ink) == 1) eye_palette.set(angry_iris_slot, pupil.iris_color);
     
-    // 5. 绘制愤怒的红色虹膜环（根据愤怒程度调整颜色）
-    Color angry_iris_color;
-    angry_iris_color.r = (uint8_t)(COLOR_BLUE_IRIS.r + (COLOR_ANGRY_RED.r - COLOR_BLUE_IRIS.r) * anger_level);
-    angry_iris_color.g = (uint8_t)(COLOR_BLUE_IRIS.g + (COLOR_ANGRY_RED.g - COLOR_BLUE_IRIS.g) * anger_level);
-    angry_iris_color.b = (uint8_t)(COLOR_BLUE_IRIS.b + (COLOR_ANGRY_RED.b - COLOR_BLUE_IRIS.b) * anger_level);
+    resolve_eye_list<Ink>(list, buffer);
     
-    draw_ring_24bit(buffer, SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y,
-                   current_pupil_radius, current_pupil_radius + IRIS_RING_WIDTH, angry_iris_color);
+    // 4. 瞳孔和虹膜
+    blit_pupil_image<Ink>(buffer, pupil, SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y);
     
-    // 6. 绘制愤怒的眉毛
-    draw_angry_eyebrow_24bit(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, 
+    // 5. 绘制愤怒的眉毛
+    draw_angry_eyebrow<Ink>(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, 
                             (pupil_offset_x < 0)); // 根据瞳孔偏移判断左右眼
     
-    // 7. 绘制火焰效果
+    // 6. 绘制火焰效果
     if (show_flame) {
-        draw_flame_effect_24bit(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, frame_count);
+        draw_flame_effect<Ink>(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, frame_count);
     }
 }
 
 /**
- * @brief 应用屏幕震动效果
+ * @brief 绘制愤怒眼睛到显示缓冲区，调色板模式下写调色板索引
  */
-void apply_screen_shake_24bit(uint8_t* buffer, int intensity) {
+void draw_angry_eye(FrameArena::DisplayBuffers& eye, int pupil_offset_x, int pupil_offset_y,
+                    float anger_level, bool show_flame, int frame_count) {
+    if (indexed_mode) {
+        draw_angry_eye_enhanced<uint8_t>(eye.render, pupil_offset_x, pupil_offset_y, anger_level, show_flame, frame_count);
+    } else {
+        draw_angry_eye_enhanced<Color>(eye.render, pupil_offset_x, pupil_offset_y, anger_level, show_flame, frame_count);
+    }
+}
+
+/**
+ * @brief 应用屏幕震动效果，scratch为同样大小的临时缓冲区
+ */
+void apply_screen_shake(FrameArena::DisplayBuffers& eye, int intensity) {
     if (intensity <= 0) return;
     
-    std::vector<uint8_t> temp_buffer(SCREEN_WIDTH * SCREEN_HEIGHT * 3);
-    std::memcpy(temp_buffer.data(), buffer, temp_buffer.size());
-    
     // 随机震动偏移
     int shake_x = (rand() % (intensity * 2 + 1)) - intensity;
     int shake_y = (rand() % (intensity * 2 + 1)) - intensity;
     
-    // 应用震动偏移
-    for (int y = 0; y < SCREEN_HEIGHT; ++y) {
-        for (int x = 0; x < SCREEN_WIDTH; ++x) {
-            int new_x = x + shake_x;
-            int new_y = y + shake_y;
-            
-            if (new_x >= 0 && new_x < SCREEN_WIDTH && new_y >= 0 && new_y < SCREEN_HEIGHT) {
-                int old_index = (y * SCREEN_WIDTH + x) * 3;
-                int new_index = (new_y * SCREEN_WIDTH + new_x) * 3;
-                
-                buffer[old_index] = temp_buffer[new_index];
-                buffer[old_index + 1] = temp_buffer[new_index + 1];
-                buffer[old_index + 2] = temp_buffer[new_index + 2];
-            }
-        }
+    // 应用震动偏移，按行复制
+    if (indexed_mode) {
+        EyeIndexCanvas(eye.render).shift(shake_x, shake_y, eye.scratch);
+    } else {
+        EyeCanvas(eye.render).shift(shake_x, shake_y, eye.scratch);
     }
 }
 
 /**
- * @brief 绘制完整的卡通眼睛（根据图片风格）
+ * @brief 眯眼：用愤怒背景色盖住 squint_end 以上的眼球
  */
-void draw_cartoon_eye_24bit(uint8_t* buffer, int pupil_offset_x = 0, int pupil_offset_y = 0,
-                           const Color& iris_color = COLOR_BLUE_IRIS, bool show_highlight = true, bool star_highlight = false) {
-    // 1. 清空为黑色背景
-    clear_buffer_24bit(buffer, COLOR_BLACK_BG);
+void apply_angry_squint(FrameArena::DisplayBuffers& eye, int squint_end) {
+    if (indexed_mode) {
+        EyeIndexCanvas(eye.render).fillCircleTop(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_SPANS.get(EYE_BACKGROUND_RADIUS),
+                                                 squint_end, eye_ink<uint8_t>(COLOR_ANGRY_BG));
+    } else {
+        EyeCanvas(eye.render).fillCircleTop(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_SPANS.get(EYE_BACKGROUND_RADIUS),
+                                            squint_end, COLOR_ANGRY_BG);
+    }
+}
+
+/**
+ * @brief 记录完整的卡通眼睛（根据图片风格），后记录的形状在上层
+ */
+void record_cartoon_eye(EyeList& list, int pupil_offset_x = 0, int pupil_offset_y = 0,
+                        const Color& iris_color = COLOR_BLUE_IRIS, bool show_highlight = true, bool star_highlight = false) {
+    // 1. 黑色背景
+    list.fill(COLOR_BLACK_BG);
     
-    // 2. 绘制白色眼球背景
-    draw_filled_circle_24bit(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_BACKGROUND_RADIUS, COLOR_WHITE_EYE);
+    // 2. 白色眼球背景（查表）
+    list.circle(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_SPANS.get(EYE_BACKGROUND_RADIUS), COLOR_WHITE_EYE);
     
-    // 3. 绘制黑色大瞳孔
-    draw_filled_circle_24bit(buffer, SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y, 
-                            PUPIL_RADIUS, COLOR_BLACK_PUPIL);
+    // 3. 黑色大瞳孔
+    list.circle(SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y,
+                PUPIL_SPANS.get(PUPIL_RADIUS), COLOR_BLACK_PUPIL);
     
-    // 4. 绘制蓝色虹膜环
-    draw_ring_24bit(buffer, SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y,
-                   PUPIL_RADIUS, PUPIL_RADIUS + IRIS_RING_WIDTH, iris_color);
+    // 4. 蓝色虹膜环
+    list.ring(SCREEN_CENTER_X + pupil_offset_x, SCREEN_CENTER_Y + pupil_offset_y,
+              PUPIL_SPANS.get(PUPIL_RADIUS), PUPIL_SPANS.get(PUPIL_RADIUS + IRIS_RING_WIDTH), iris_color);
     
-    // 5. 绘制高光点
+    // 5. 高光点
     if (show_highlight) {
         if (star_highlight) {
-            // 四角星型高光
-            draw_star_highlight_24bit(buffer, 
-                                    SCREEN_CENTER_X + pupil_offset_x + HIGHLIGHT_OFFSET_X, 
-                                    SCREEN_CENTER_Y + pupil_offset_y + HIGHLIGHT_OFFSET_Y, 
-                                    HIGHLIGHT_RADIUS * 2, COLOR_WHITE_HIGHLIGHT);
+            // 四角星型高光（四个三角形合起来是菱形）
+            list.diamond(SCREEN_CENTER_X + pupil_offset_x + HIGHLIGHT_OFFSET_X,
+                         SCREEN_CENTER_Y + pupil_offset_y + HIGHLIGHT_OFFSET_Y,
+                         HIGHLIGHT_RADIUS, COLOR_WHITE_HIGHLIGHT);
         } else {
             // 圆形高光
-            draw_filled_circle_24bit(buffer, 
-                                    SCREEN_CENTER_X + pupil_offset_x + HIGHLIGHT_OFFSET_X, 
-                                    SCREEN_CENTER_Y + pupil_offset_y + HIGHLIGHT_OFFSET_Y, 
-                                    HIGHLIGHT_RADIUS, COLOR_WHITE_HIGHLIGHT);
+            list.circle(SCREEN_CENTER_X + pupil_offset_x + HIGHLIGHT_OFFSET_X,
+                        SCREEN_CENTER_Y + pupil_offset_y + HIGHLIGHT_OFFSET_Y,
+                        HIGHLIGHT_SPANS.get(HIGHLIGHT_RADIUS), COLOR_WHITE_HIGHLIGHT);
         }
     }
 }
 
+/**
+ * @brief 记录黄色眼皮，从上方覆盖眼睛圆形区域
+ */
+void record_eyelid(EyeList& list, float blink_progress) {
+    // blink_progress: 0.0 = 完全睁开, 1.0 = 完全闭上，按档取预先生成的眼皮
+    const EyelidMask& mask = eyelid_mask(blink_step(blink_progress));
+    list.spans(mask.first_row, mask.last_row, &mask.rows[0][0], COLOR_YELLOW_EYELID);
+}
+
+/**
+ * @brief 记录泪滴
+ */
+void record_tear(EyeList& list, int x, int y, int size = TEAR_SIZE) {
+    // 泪滴主体
+    list.circle(x, y, size, COLOR_TEAR);
+    // 泪滴尖端
+    for (int i = 1; i <= size/2; ++i) {
+        int tear_width = size - i;
+        list.hspan(y + size + i, x - tear_width/2, x + tear_width/2, COLOR_TEAR);
+    }
+}
+
+/**
+ * @brief 绘制完整的卡通眼睛（根据图片风格）
+ */
+void draw_cartoon_eye_24bit(uint8_t* buffer, int pupil_offset_x = 0, int pupil_offset_y = 0,
+                           const Color& iris_color = COLOR_BLUE_IRIS, bool show_highlight = true, bool star_highlight = false) {
+    EyeList list;
+    record_cartoon_eye(list, pupil_offset_x, pupil_offset_y, iris_color, show_highlight, star_highlight);
+    list.resolve(buffer);
+}
+
 /**
  * @brief 绘制眨眼状态 - 黄色眼皮覆盖，保持四角星型高光
  */
 void draw_blinking_eye_24bit(uint8_t* buffer, float blink_progress, bool star_highlight = true) {
-    // blink_progress: 0.0 = 完全睁开, 1.0 = 完全闭上
-    
-    // 先绘制正常眼睛，使用四角星型高光
-    draw_cartoon_eye_24bit(buffer, 0, 0, COLOR_BLUE_IRIS, true, star_highlight);
-    
-    // 计算眼皮覆盖的高度
-    int eyelid_height = (int)(blink_progress * EYE_BACKGROUND_RADIUS * 2);
-    
-    // 从上方绘制黄色眼皮覆盖
-    for (int y = SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS; y < SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS + eyelid_height; ++y) {
-        for (int x = SCREEN_CENTER_X - EYE_BACKGROUND_RADIUS; x <= SCREEN_CENTER_X + EYE_BACKGROUND_RADIUS; ++x) {
-            if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                // 检查是否在眼睛圆形区域内
-                int dx = x - SCREEN_CENTER_X;
-                int dy = y - SCREEN_CENTER_Y;
-                if (dx * dx + dy * dy <= EYE_BACKGROUND_RADIUS * EYE_BACKGROUND_RADIUS) {
-                    set_pixel_24bit(buffer, x, y, COLOR_YELLOW_EYELID);
-                }
-            }
-        }
-    }
+    // 正常眼睛加上层的眼皮，一次解析，被眼皮盖住的部分不再绘制
+    EyeList list;
+    record_cartoon_eye(list, 0, 0, COLOR_BLUE_IRIS, true, star_highlight);
+    record_eyelid(list, blink_progress);
+    list.resolve(buffer);
 }
 
 /**
  * @brief 绘制完全闭眼状态
  */
 void draw_closed_eye_24bit(uint8_t* buffer) {
-    clear_buffer_24bit(buffer, COLOR_BLACK_BG);
-    // 绘制黄色椭圆表示闭眼
-    draw_filled_ellipse_24bit(buffer, SCREEN_CENTER_X, SCREEN_CENTER_Y, 
-                             EYE_BACKGROUND_RADIUS, 8, COLOR_YELLOW_EYELID);
+    // 黄色椭圆表示闭眼
+    EyeList list;
+    list.fill(COLOR_BLACK_BG);
+    list.ellipse(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_BACKGROUND_RADIUS, 8, COLOR_YELLOW_EYELID);
+    list.resolve(buffer);
 }
 
 /**
- * @brief 绘制泪滴
+ * @brief 比较逐层绘制和按行解析时每个像素的平均写入次数
+ * 需要使用 -DRENDER_CORE_COUNT_WRITES 编译
  */
-void draw_tear_24bit(uint8_t* buffer, int x, int y, int size = 8) {
-    // 泪滴主体
-    draw_filled_circle_24bit(buffer, x, y, size, COLOR_TEAR);
-    // 泪滴尖端
-    for (int i = 1; i <= size/2; ++i) {
-        int tear_width = size - i;
-        for (int dx = -tear_width/2; dx <= tear_width/2; ++dx) {
-            set_pixel_24bit(buffer, x + dx, y + size + i, COLOR_TEAR);
+int report_overdraw() {
+#ifndef RENDER_CORE_COUNT_WRITES
+    std::cerr << "需要使用 -DRENDER_CORE_COUNT_WRITES 编译" << std::endl;
+    return -1;
+#else
+    std::vector<uint8_t> buffer(EyeDisplay::BUFFER_SIZE);
+    EyeList lists[4];
+    const char* names[4] = { "开心", "眨眼", "流泪", "闭眼" };
+    record_cartoon_eye(lists[0], 5, 3, COLOR_BLUE_IRIS, true, true);
+    record_cartoon_eye(lists[1], 0, 0, COLOR_BLUE_IRIS, true, true);
+    record_eyelid(lists[1], 0.5f);
+    record_cartoon_eye(lists[2], 0, 15);
+    record_tear(lists[2], SCREEN_CENTER_X - 30, 150);
+    lists[3].fill(COLOR_BLACK_BG);
+    lists[3].ellipse(SCREEN_CENTER_X, SCREEN_CENTER_Y, EYE_BACKGROUND_RADIUS, 8, COLOR_YELLOW_EYELID);
+
+    const double pixels = SCREEN_WIDTH * SCREEN_HEIGHT;
+    for (int i = 0; i < 4; ++i) {
+        RenderCore::pixelWrites(true);
+        lists[i].paint(buffer.data());
+        double before = RenderCore::pixelWrites(true) / pixels;
+        lists[i].resolve(buffer.data());
+        double after = RenderCore::pixelWrites(true) / pixels;
+        std::cout << names[i] << ": 逐层绘制 " << before << " 次/像素, 按行解析 " << after << " 次/像素" << std::endl;
+    }
+    return 0;
+#endif
+}
+
+/**
+ * @brief 剪辑压缩率和解码时间（不写LCD）
+ */
+int report_clip(const char* path) {
+    Clip::Reader clip;
+    if (clip.open(path) != 0) {
+        std::cerr << "无法打开剪辑: " << path << std::endl;
+        return -1;
+    }
+    const ClipHeader* header = clip.header();
+    uint32_t deltas = 0;
+    uint64_t delta_bytes = 0;
+    for (uint32_t i = 0; i < clip.count(); ++i) {
+        if (clip.frame(i).encoding != CLIP_ENCODING_DELTA) continue;
+        deltas++;
+        delta_bytes += clip.frame(i).size;
+    }
+    uint64_t raw_bytes = (uint64_t)clip.count() * header->frame_size;
+    std::cout << "帧数: " << clip.count() << ", 关键帧: " << clip.count() - deltas << ", 差分帧: " << deltas
+              << ", 平均差分 " << (deltas ? delta_bytes / deltas : 0) << " 字节" << std::endl;
+    std::cout << "压缩率: " << (double)raw_bytes / header->data_bytes << " (" << raw_bytes / 1024 << " KB -> "
+              << header->data_bytes / 1024 << " KB)" << std::endl;
+
+    // 多次完整解码，测量每帧时间
+    const int passes = 20;
+    Clip::Player player(clip);
+    uint64_t checksum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+        player.rewind();
+        for (uint32_t i = 0; i < clip.count(); ++i) {
+            const uint8_t* lcd = player.decode(i);
+            if (!lcd) {
+                std::cerr << "剪辑损坏，帧 " << i << std::endl;
+                return -1;
+            }
+            checksum += lcd[i % header->frame_size];
         }
     }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << "解码: " << ns / ((double)passes * clip.count()) << " ns/帧, 差分帧 "
+              << (deltas ? ns / ((double)passes * deltas) : 0.0) << " ns/帧 (校验 " << checksum << ")" << std::endl;
+    return 0;
 }
 
 /**
- * @brief 将24位缓冲区写入LCD
+ * @brief 缓冲区前部的调色板索引原地展开为24位，从后往前展开不会覆盖未读的索引
  */
-void write_eye_to_lcd(const std::vector<uint8_t>& temp_24bit_buffer, LcdData* frame_data) {
-    int lcd_buffer_size = LcdControl::getBufferSize();
-    std::vector<uint8_t> lcd_buffer(lcd_buffer_size);
-    
-    LcdControl::LcdBufferFrom24Bit(lcd_buffer.data(), 
-                                  const_cast<uint8_t*>(temp_24bit_buffer.data()));
-    
-    std::memcpy(frame_data->buffer, lcd_buffer.data(), lcd_buffer_size);
+void expand_indices_24bit(uint8_t* buffer) {
+    for (int i = SCREEN_WIDTH * SCREEN_HEIGHT - 1; i >= 0; --i) {
+        RenderCore::putPixel(buffer + i * 3, eye_palette.color(buffer[i]));
+    }
+}
+
+// 每个屏幕正在显示的画面，过渡动画从它开始
+struct ShownFrame {
+    bool in_render;     // 画面在 eye.render 中（直接绘制的帧、过渡帧）
+    bool rgb;           // eye.render 是24位，否则是调色板索引
+    EyeList list;       // in_render 为 false 时：最后显示的形状列表（含帧缓存命中）
+};
+static ShownFrame shown_frames[2];
+
+/**
+ * @brief 屏幕正在显示的画面转成24位，写入 rgb（不能是 eye.render）
+ */
+void shown_frame_24bit(const FrameArena::DisplayBuffers& eye, uint8_t* rgb) {
+    const ShownFrame& shown = shown_frames[eye.frame.side & 1];
+    if (!shown.in_render) {
+        if (shown.list.size() == 0) clear_buffer_24bit(rgb, COLOR_BLACK_BG);
+        else shown.list.resolve(rgb);
+    } else if (shown.rgb) {
+        memcpy(rgb, eye.render, EyeDisplay::BUFFER_SIZE);
+    } else {
+        // 调色板索引按当前调色板展开（愤怒虹膜项保持最后一帧的颜色）
+        memcpy(rgb, eye.render, EyeDisplay::INDEX_BUFFER_SIZE);
+        expand_indices_24bit(rgb);
+    }
+}
+
+/**
+ * @brief 将24位缓冲区写入LCD，调色板模式下 rgb 为 true 时也按24位转换（过渡帧）
+ */
+void write_eye_to_lcd(FrameArena::DisplayBuffers& eye, bool rgb = false) {
+    shown_frames[eye.frame.side & 1].in_render = true;
+    shown_frames[eye.frame.side & 1].rgb = rgb || !indexed_mode;
+    // 直接转换到预分配的LCD缓冲区
+    // 调色板模式查表展开索引，屏幕格式与编译时特化一致时使用特化的转换
+    if (indexed_mode && !rgb) {
+        eye_palette.pack(eye.lcd, eye.render);
+    } else if (EyeDisplay::matchesLcd()) {
+        EyeDisplay::pack(eye.lcd, eye.render);
+    } else {
+        LcdControl::LcdBufferFrom24Bit(eye.lcd, eye.render);
+    }
     
-    int result = LcdControl::writeLcd(frame_data);
+    int result = LcdControl::writeLcd(&eye.frame);
     if (result != 0) {
-        std::cerr << "Write LCD failed: " << (int)result << std::endl;
+        LOG_ERROR("Write LCD failed: " << (int)result);
+    }
+}
+
+/**
+ * @brief 按16行条带解析形状列表、转换并写入LCD
+ * 驱动支持部分写入时，条带转换完成后立即传输，与后面条带的渲染重叠
+ * key 相同的帧已在帧缓存中时直接写入缓存的LCD格式帧，不渲染也不转换
+ */
+void present_eye(const FramePacer::Key& key, const EyeList& list, FrameArena::DisplayBuffers& eye) {
+    shown_frames[eye.frame.side & 1].in_render = false;
+    shown_frames[eye.frame.side & 1].list = list;
+    if (FrameCache::present(key.value(), eye.frame.side) == 0) return;
+    if (indexed_mode) {
+        BandPipeline::render<EyeDisplay>(list, eye_palette, eye);
+    } else if (EyeDisplay::matchesLcd()) {
+        BandPipeline::render<EyeDisplay>(list, eye);
+    } else {
+        list.resolve(eye.render);
+        write_eye_to_lcd(eye);
     }
+    FrameCache::store(key.value(), eye.frame.side, eye.lcd);
+}
+
+// 帧参数标识：参数不变的帧不重新渲染和写入（FramePacer）
+enum EyeFrameKind {
+    FRAME_HAPPY = 1,
+    FRAME_BLINK,
+    FRAME_TEAR,
+    FRAME_SAD,
+    FRAME_ANGRY,
+    FRAME_ANGRY_SQUINT,
+    FRAME_ANGRY_BURST,
+    FRAME_IDLE,
+};
+
+/**
+ * @brief 左右眼参数相同，判断这一帧是否需要渲染
+ */
+bool eye_frame_needed(const FramePacer::Key& key) {
+    bool left = FramePacer::needsFrame(LcdLeft, key.value());
+    bool right = FramePacer::needsFrame(LcdRight, key.value());
+    return left || right;
 }
 
 /**
  * @brief 开心表情动画 - 正常眼睛 + 眨眼 + 眼球微动
  */
-void animate_happy_face(LcdData* frame_data_left, LcdData* frame_data_right,
-                       std::vector<uint8_t>& temp_buffer_left,
-                       std::vector<uint8_t>& temp_buffer_right) {
-    std::cout << "😊 开始开心表情..." << std::endl;
+void animate_happy_face(FrameArena::DisplayBuffers& left, FrameArena::DisplayBuffers& right) {
+    LOG_PRINT("😊 开始开心表情...");
     auto start_time = std::chrono::high_resolution_clock::now();
     
     // 眼球微动模式 - 表现兴奋状态，进一步减小幅度，增加频率
@@ -515,12 +987,14 @@ void animate_happy_face(LcdData* frame_data_left, LcdData* frame_data_right,
         int offset_x = eye_movements[current_movement][0];
         int offset_y = eye_movements[current_movement][1];
         
-        // 正常睁开的眼睛，使用四角星型高光
-        draw_cartoon_eye_24bit(temp_buffer_left.data(), offset_x, offset_y, COLOR_BLUE_IRIS, true, true);
-        draw_cartoon_eye_24bit(temp_buffer_right.data(), offset_x, offset_y, COLOR_BLUE_IRIS, true, true);
-        
-        write_eye_to_lcd(temp_buffer_left, frame_data_left);
-        write_eye_to_lcd(temp_buffer_right, frame_data_right);
+        // 正常睁开的眼睛，使用四角星型高光，眼球位置不变时不重新渲染
+        FramePacer::Key key = FramePacer::Key().add(FRAME_HAPPY).add(offset_x).add(offset_y);
+        if (eye_frame_needed(key)) {
+            EyeList eye;
+            record_cartoon_eye(eye, offset_x, offset_y, COLOR_BLUE_IRIS, true, true);
+            present_eye(key, eye, left);
+            present_eye(key, eye, right);
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(80));
         
         // 每3帧切换眼球位置，进一步增加微动频率
@@ -535,11 +1009,14 @@ void animate_happy_face(LcdData* frame_data_left, LcdData* frame_data_right,
             int step_count = sizeof(blink_steps) / sizeof(blink_steps[0]);
             
             for (int step = 0; step < step_count; ++step) {
-                draw_blinking_eye_24bit(temp_buffer_left.data(), blink_steps[step], true);
-                draw_blinking_eye_24bit(temp_buffer_right.data(), blink_steps[step], true);
-                
-                write_eye_to_lcd(temp_buffer_left, frame_data_left);
-                write_eye_to_lcd(temp_buffer_right, frame_data_right);
+                FramePacer::Key key = FramePacer::Key().add(FRAME_BLINK).add(blink_step(blink_steps[step]));
+                if (eye_frame_needed(key)) {
+                    EyeList eye;
+                    record_cartoon_eye(eye, 0, 0, COLOR_BLUE_IRIS, true, true);
+                    record_eyelid(eye, blink_steps[step]);
+                    present_eye(key, eye, left);
+                    present_eye(key, eye, right);
+                }
                 std::this_thread::sleep_for(std::chrono::milliseconds(60));
             }
         }
@@ -547,74 +1024,131 @@ void animate_happy_face(LcdData* frame_data_left, LcdData* frame_data_right,
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    std::cout << "😊 开心表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒" << std::endl;
+    LOG_PRINT("😊 开心表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒");
+}
+
+const int SAD_PUPIL_OFFSET_Y = 12;                                      // 眼球向下看
+// 眼睛占满屏幕，泪水从瞳孔下部流到屏幕下沿（眼睛下方在屏幕外）
+const int SAD_TEAR_START_Y = SCREEN_CENTER_Y + 40;
+
+int sad_tear_x(LcdSide side) {
+    return side == LcdLeft ? SCREEN_CENTER_X - 30 : SCREEN_CENTER_X + 30;
+}
+
+/**
+ * @brief 泪滴使用打包的图案（--atlas），画在解析后的画面上；调色板模式不能混合，仍用形状
+ */
+bool sad_tear_from_art() {
+    return art_loaded[ART_TEAR] && !indexed_mode;
+}
+
+/**
+ * @brief 记录流泪的悲伤眼睛，左眼泪滴偏左，右眼偏右；泪滴使用图案时不记录泪滴
+ */
+void record_sad_eye(EyeList& list, LcdSide side, int tear_y) {
+    record_cartoon_eye(list, 0, SAD_PUPIL_OFFSET_Y);
+    if (!sad_tear_from_art()) record_tear(list, sad_tear_x(side), tear_y);
+}
+
+/**
+ * @brief 24位的流泪悲伤眼睛
+ */
+void draw_sad_eye_24bit(uint8_t* buffer, LcdSide side, int tear_y) {
+    EyeList list;
+    record_sad_eye(list, side, tear_y);
+    list.resolve(buffer);
+    if (sad_tear_from_art()) draw_art<Color>(buffer, ART_TEAR, sad_tear_x(side), tear_y);
+}
+
+/**
+ * @brief 显示一帧流泪的悲伤眼睛，图案泪滴的帧整帧解析后写入，不进帧缓存
+ */
+void present_sad_eye(const FramePacer::Key& key, LcdSide side, int tear_y, FrameArena::DisplayBuffers& eye) {
+    if (sad_tear_from_art()) {
+        draw_sad_eye_24bit(eye.render, side, tear_y);
+        write_eye_to_lcd(eye);
+        return;
+    }
+    EyeList list;
+    record_sad_eye(list, side, tear_y);
+    present_eye(key, list, eye);
 }
 
 /**
  * @brief 悲伤表情动画 - 向下看 + 流泪
  */
-void animate_sad_face(LcdData* frame_data_left, LcdData* frame_data_right,
-                     std::vector<uint8_t>& temp_buffer_left,
-                     std::vector<uint8_t>& temp_buffer_right) {
-    std::cout << "😢 开始悲伤表情..." << std::endl;
+void animate_sad_face(FrameArena::DisplayBuffers& left, FrameArena::DisplayBuffers& right) {
+    LOG_PRINT("😢 开始悲伤表情...");
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    const int pupil_offset_y = 12; // 眼球向下看
+    const int pupil_offset_y = SAD_PUPIL_OFFSET_Y;
     
     // 泪水从眼睛下方流下
-    for (int tear_y = SCREEN_CENTER_Y + EYE_BACKGROUND_RADIUS + 15; 
-         tear_y < SCREEN_HEIGHT - 30; tear_y += 6) {
-        
-        draw_cartoon_eye_24bit(temp_buffer_left.data(), 0, pupil_offset_y);
-        draw_cartoon_eye_24bit(temp_buffer_right.data(), 0, pupil_offset_y);
+    for (int tear_y = SAD_TEAR_START_Y; tear_y < SCREEN_HEIGHT - 30; tear_y += 6) {
         
-        // 左眼流泪
-        draw_tear_24bit(temp_buffer_left.data(), SCREEN_CENTER_X - 30, tear_y);
-        // 右眼流泪
-        draw_tear_24bit(temp_buffer_right.data(), SCREEN_CENTER_X + 30, tear_y);
-        
-        write_eye_to_lcd(temp_buffer_left, frame_data_left);
-        write_eye_to_lcd(temp_buffer_right, frame_data_right);
+        FramePacer::Key key = FramePacer::Key().add(FRAME_TEAR).add(tear_y);
+        if (eye_frame_needed(key)) {
+            // 左右眼画面不同，帧缓存按屏幕区分
+            present_sad_eye(key, LcdLeft, tear_y, left);
+            present_sad_eye(key, LcdRight, tear_y, right);
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(150));
     }
     
-    // 保持悲伤表情
+    // 保持悲伤表情，画面静止，只在第一帧和保活时写入
     for (int i = 0; i < 30; ++i) {
-        draw_cartoon_eye_24bit(temp_buffer_left.data(), 0, pupil_offset_y);
-        draw_cartoon_eye_24bit(temp_buffer_right.data(), 0, pupil_offset_y);
-        write_eye_to_lcd(temp_buffer_left, frame_data_left);
-        write_eye_to_lcd(temp_buffer_right, frame_data_right);
+        FramePacer::Key key = FramePacer::Key().add(FRAME_SAD).add(pupil_offset_y);
+        if (eye_frame_needed(key)) {
+            EyeList eye;
+            record_cartoon_eye(eye, 0, pupil_offset_y);
+            present_eye(key, eye, left);
+            present_eye(key, eye, right);
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    std::cout << "😢 悲伤表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒" << std::endl;
+    LOG_PRINT("😢 悲伤表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒");
 }
 
+// 愤怒程度变化：从轻微愤怒到极度愤怒，再回到中等愤怒
+constexpr float ANGER_LEVELS[] = {0.3f, 0.6f, 0.9f, 1.0f, 0.8f, 0.5f, 0.7f, 0.9f, 0.6f, 0.4f};
+
+// 眼球微动模式 - 愤怒时眼球快速移动
+constexpr int ANGRY_EYE_MOVEMENTS[][2] = {
+    {0, 0},     // 正中
+    {-3, -2},   // 左上
+    {3, -2},    // 右上
+    {-3, 2},    // 左下
+    {3, 2},     // 右下
+    {0, 0}      // 回正中
+};
+
+// 屏幕震动强度随愤怒程度
+constexpr int angry_shake_intensity(float anger_level) {
+    return (int)(anger_level * 3);
+}
+
+// 过渡动画的最后一帧就是愤怒表情的第一帧（pose_angry_start），动画从第二帧开始画
+static bool angry_first_frame_shown = false;
+
 /**
  * @brief 愤怒表情动画 - 红色虹膜 + 眯眼
  */
-void animate_angry_face(LcdData* frame_data_left, LcdData* frame_data_right,
-                       std::vector<uint8_t>& temp_buffer_left,
-                       std::vector<uint8_t>& temp_buffer_right) {
-    std::cout << "😠 开始愤怒表情..." << std::endl;
+void animate_angry_face(FrameArena::DisplayBuffers& left, FrameArena::DisplayBuffers& right) {
+    LOG_PRINT("😠 开始愤怒表情...");
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    // 愤怒程度变化：从轻微愤怒到极度愤怒，再回到中等愤怒
-    float anger_levels[] = {0.3f, 0.6f, 0.9f, 1.0f, 0.8f, 0.5f, 0.7f, 0.9f, 0.6f, 0.4f};
-    int anger_count = sizeof(anger_levels) / sizeof(anger_levels[0]);
+    // 过渡动画已经画出并显示了第一帧，火焰粒子也已为它更新
+    bool first_frame_shown = angry_first_frame_shown;
+    angry_first_frame_shown = false;
     
-    // 眼球微动模式 - 愤怒时眼球快速移动
-    int eye_movements[][2] = {
-        {0, 0},     // 正中
-        {-3, -2},   // 左上
-        {3, -2},    // 右上
-        {-3, 2},    // 左下
-        {3, 2},     // 右下
-        {0, 0}      // 回正中
-    };
-    int movement_count = sizeof(eye_movements) / sizeof(eye_movements[0]);
+    const float* anger_levels = ANGER_LEVELS;
+    int anger_count = sizeof(ANGER_LEVELS) / sizeof(ANGER_LEVELS[0]);
+    
+    const int (*eye_movements)[2] = ANGRY_EYE_MOVEMENTS;
+    int movement_count = sizeof(ANGRY_EYE_MOVEMENTS) / sizeof(ANGRY_EYE_MOVEMENTS[0]);
     int current_movement = 0;
     
     for (int i = 0; i < 80; ++i) {
@@ -625,20 +1159,23 @@ void animate_angry_face(LcdData* frame_data_left, LcdData* frame_data_right,
         int offset_x = eye_movements[current_movement][0];
         int offset_y = eye_movements[current_movement][1];
         
-        // 使用增强的愤怒眼睛绘制函数
-        draw_angry_eye_enhanced_24bit(temp_buffer_left.data(), offset_x, offset_y, current_anger, true, i);
-        draw_angry_eye_enhanced_24bit(temp_buffer_right.data(), offset_x, offset_y, current_anger, true, i);
-        
-        // 应用屏幕震动效果（根据愤怒程度调整强度）
-        int shake_intensity = (int)(current_anger * 3);
-        if (shake_intensity > 0) {
-            apply_screen_shake_24bit(temp_buffer_left.data(), shake_intensity);
-            apply_screen_shake_24bit(temp_buffer_right.data(), shake_intensity);
+        // 火焰和震动每帧都在变化，帧号进入 key，每帧都会渲染
+        if (eye_frame_needed(FramePacer::Key().add(FRAME_ANGRY).add(i)) && !(i == 0 && first_frame_shown)) {
+            // 使用增强的愤怒眼睛绘制函数
+            draw_angry_eye(left, offset_x, offset_y, current_anger, true, i);
+            draw_angry_eye(right, offset_x, offset_y, current_anger, true, i);
+            
+            // 应用屏幕震动效果（根据愤怒程度调整强度）
+            int shake_intensity = angry_shake_intensity(current_anger);
+            if (shake_intensity > 0) {
+                apply_screen_shake(left, shake_intensity);
+                apply_screen_shake(right, shake_intensity);
+            }
+            
+            write_eye_to_lcd(left);
+            write_eye_to_lcd(right);
         }
         
-        write_eye_to_lcd(temp_buffer_left, frame_data_left);
-        write_eye_to_lcd(temp_buffer_right, frame_data_right);
-        
         // 根据愤怒程度调整动画速度
         int frame_delay = (int)(120 - current_anger * 40); // 愤怒时动画更快
         std::this_thread::sleep_for(std::chrono::milliseconds(frame_delay));
@@ -655,27 +1192,20 @@ void animate_angry_face(LcdData* frame_data_left, LcdData* frame_data_right,
             int step_count = sizeof(squint_steps) / sizeof(squint_steps[0]);
             
             for (int step = 0; step < step_count; ++step) {
-                // 眯眼时保持火焰效果
-                draw_angry_eye_enhanced_24bit(temp_buffer_left.data(), offset_x, offset_y, current_anger, true, i);
-                draw_angry_eye_enhanced_24bit(temp_buffer_right.data(), offset_x, offset_y, current_anger, true, i);
-                
-                // 应用眯眼效果（覆盖部分眼睛）
-                int squint_height = (int)(squint_steps[step] * EYE_BACKGROUND_RADIUS * 0.6f);
-                for (int y = SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS; y < SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS + squint_height; ++y) {
-                    for (int x = SCREEN_CENTER_X - EYE_BACKGROUND_RADIUS; x <= SCREEN_CENTER_X + EYE_BACKGROUND_RADIUS; ++x) {
-                        if (x >= 0 && x < SCREEN_WIDTH && y >= 0 && y < SCREEN_HEIGHT) {
-                            int dx = x - SCREEN_CENTER_X;
-                            int dy = y - SCREEN_CENTER_Y;
-                            if (dx * dx + dy * dy <= EYE_BACKGROUND_RADIUS * EYE_BACKGROUND_RADIUS) {
-                                set_pixel_24bit(temp_buffer_left.data(), x, y, COLOR_ANGRY_BG);
-                                set_pixel_24bit(temp_buffer_right.data(), x, y, COLOR_ANGRY_BG);
-                            }
-                        }
-                    }
+                if (eye_frame_needed(FramePacer::Key().add(FRAME_ANGRY_SQUINT).add(i).add(step))) {
+                    // 眯眼时保持火焰效果
+                    draw_angry_eye(left, offset_x, offset_y, current_anger, true, i);
+                    draw_angry_eye(right, offset_x, offset_y, current_anger, true, i);
+                    
+                    // 应用眯眼效果（覆盖部分眼睛）
+                    int squint_height = (int)(squint_steps[step] * EYE_BACKGROUND_RADIUS * 0.6f);
+                    int squint_end = SCREEN_CENTER_Y - EYE_BACKGROUND_RADIUS + squint_height;
+                    apply_angry_squint(left, squint_end);
+                    apply_angry_squint(right, squint_end);
+                    
+                    write_eye_to_lcd(left);
+                    write_eye_to_lcd(right);
                 }
-                
-                write_eye_to_lcd(temp_buffer_left, frame_data_left);
-                write_eye_to_lcd(temp_buffer_right, frame_data_right);
                 std::this_thread::sleep_for(std::chrono::milliseconds(80));
             }
         }
@@ -683,16 +1213,18 @@ void animate_angry_face(LcdData* frame_data_left, LcdData* frame_data_right,
         // 偶尔的强烈愤怒爆发（火焰更旺盛，震动更强）
         if (i % 25 == 20) {
             for (int burst = 0; burst < 5; ++burst) {
-                // 增强火焰效果
-                draw_angry_eye_enhanced_24bit(temp_buffer_left.data(), offset_x, offset_y, 1.0f, true, i + burst);
-                draw_angry_eye_enhanced_24bit(temp_buffer_right.data(), offset_x, offset_y, 1.0f, true, i + burst);
-                
-                // 强震动
-                apply_screen_shake_24bit(temp_buffer_left.data(), 5);
-                apply_screen_shake_24bit(temp_buffer_right.data(), 5);
-                
-                write_eye_to_lcd(temp_buffer_left, frame_data_left);
-                write_eye_to_lcd(temp_buffer_right, frame_data_right);
+                if (eye_frame_needed(FramePacer::Key().add(FRAME_ANGRY_BURST).add(i).add(burst))) {
+                    // 增强火焰效果
+                    draw_angry_eye(left, offset_x, offset_y, 1.0f, true, i + burst);
+                    draw_angry_eye(right, offset_x, offset_y, 1.0f, true, i + burst);
+                    
+                    // 强震动
+                    apply_screen_shake(left, 5);
+                    apply_screen_shake(right, 5);
+                    
+                    write_eye_to_lcd(left);
+                    write_eye_to_lcd(right);
+                }
                 std::this_thread::sleep_for(std::chrono::milliseconds(60));
             }
         }
@@ -700,16 +1232,14 @@ void animate_angry_face(LcdData* frame_data_left, LcdData* frame_data_right,
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    std::cout << "😠 愤怒表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒" << std::endl;
+    LOG_PRINT("😠 愤怒表情完成 - 实际运行" << (duration.count() / 1000.0) << "秒");
 }
 
 /**
  * @brief 静止眨眼动画 - 眼球移动 + 自然眨眼
  */
-void animate_idle_blink(LcdData* frame_data_left, LcdData* frame_data_right,
-                       std::vector<uint8_t>& temp_buffer_left,
-                       std::vector<uint8_t>& temp_buffer_right) {
-    std::cout << "😐 开始静止状态..." << std::endl;
+void animate_idle_blink(FrameArena::DisplayBuffers& left, FrameArena::DisplayBuffers& right) {
+    LOG_PRINT("😐 开始静止状态...");
     auto start_time = std::chrono::high_resolution_clock::now();
     
     // 眼球移动模式
@@ -730,19 +1260,24 @@ void animate_idle_blink(LcdData* frame_data_left, LcdData* frame_data_right,
             int offset_y = eye_movements[move][1];
             
             for (int frame = 0; frame < 20; ++frame) {
-                draw_cartoon_eye_24bit(temp_buffer_left.data(), offset_x, offset_y);
-                draw_cartoon_eye_24bit(temp_buffer_right.data(), offset_x, offset_y);
-                
-                write_eye_to_lcd(temp_buffer_left, frame_data_left);
-                write_eye_to_lcd(temp_buffer_right, frame_data_right);
+                // 注视期间画面静止，只有眼球移动的第一帧需要渲染
+                FramePacer::Key key = FramePacer::Key().add(FRAME_IDLE).add(offset_x).add(offset_y);
+                if (eye_frame_needed(key)) {
+                    EyeList eye;
+                    record_cartoon_eye(eye, offset_x, offset_y);
+                    present_eye(key, eye, left);
+                    present_eye(key, eye, right);
+                }
                 std::this_thread::sleep_for(std::chrono::milliseconds(70));
                 
                 // 随机眨眼
-                if (frame == 15 && move % 4 == 1) {
-                    draw_blinking_eye_24bit(temp_buffer_left.data(), 1.0f, true);
-                    draw_blinking_eye_24bit(temp_buffer_right.data(), 1.0f, true);
-                    write_eye_to_lcd(temp_buffer_left, frame_data_left);
-                    write_eye_to_lcd(temp_buffer_right, frame_data_right);
+                FramePacer::Key blink_key = FramePacer::Key().add(FRAME_BLINK).add(blink_step(1.0f));
+                if (frame == 15 && move % 4 == 1 && eye_frame_needed(blink_key)) {
+                    EyeList eye;
+                    record_cartoon_eye(eye, 0, 0, COLOR_BLUE_IRIS, true, true);
+                    record_eyelid(eye, 1.0f);
+                    present_eye(blink_key, eye, left);
+                    present_eye(blink_key, eye, right);
                     std::this_thread::sleep_for(std::chrono::milliseconds(100));
                 }
             }
@@ -751,22 +1286,288 @@ void animate_idle_blink(LcdData* frame_data_left, LcdData* frame_data_right,
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    std::cout << "😐 静止状态完成 - 实际运行" << (duration.count() / 1000.0) << "秒" << std::endl;
+    LOG_PRINT("😐 静止状态完成 - 实际运行" << (duration.count() / 1000.0) << "秒");
+}
+
+/**
+ * @brief 问候表情 - 眼睛、手臂和LED由同一个时间轴驱动
+ */
+void play_greeting_timeline() {
+    LOG_PRINT("👋 开始问候表情...");
+
+    // 眼睛：左右扫视，1.2秒时眨眼，画面按帧的呈现时间计算
+    // 最后显示的画面的时间（跳过和缓存命中的帧画面相同），结束后作为过渡起点
+    static uint32_t last_shown_us = 0;
+    auto draw_eye = [](uint8_t* buffer, uint32_t t_us) {
+        float t = t_us / 1000000.0f;
+        if (t > 1.2f && t < 1.5f) {
+            float blink = 1.0f - std::fabs(t - 1.35f) / 0.15f;
+            draw_blinking_eye_24bit(buffer, blink, true);
+            return;
+        }
+        int offset_x = (int)(10 * std::sin(t * 3.0f));
+        draw_cartoon_eye_24bit(buffer, offset_x, 0, COLOR_BLUE_IRIS, true, true);
+    };
+    // 和 draw_eye 使用相同的参数，眼球停在扫视两端时跳过渲染
+    auto eye_key = [](uint32_t t_us) -> uint64_t {
+        last_shown_us = t_us;
+        float t = t_us / 1000000.0f;
+        if (t > 1.2f && t < 1.5f) {
+            float blink = 1.0f - std::fabs(t - 1.35f) / 0.15f;
+            return FramePacer::Key().add(FRAME_BLINK).add(blink_step(blink)).value();
+        }
+        int offset_x = (int)(10 * std::sin(t * 3.0f));
+        return FramePacer::Key().add(FRAME_HAPPY).add(offset_x).add(0).value();
+    };
+
+    Timeline::Expression expression;
+    expression.eyes.push_back({ LcdLeft, 0, 3000, 80, draw_eye, eye_key });
+    expression.eyes.push_back({ LcdRight, 0, 3000, 80, draw_eye, eye_key });
+
+    // 右臂挥手
+    expression.servos = {
+        { 0,    SERVO_RIGHT, 120, 400 },
+        { 500,  SERVO_RIGHT, 80,  300 },
+        { 900,  SERVO_RIGHT, 120, 300 },
+        { 1300, SERVO_RIGHT, 80,  300 },
+        { 1700, SERVO_RIGHT, 0,   800 },
+    };
+
+    // LED渐亮为暖黄色再熄灭
+    expression.leds = {
+        { 0,    LcdLeft,  0,   0,   0 },
+        { 0,    LcdRight, 0,   0,   0 },
+        { 1000, LcdLeft,  255, 200, 0 },
+        { 1000, LcdRight, 255, 200, 0 },
+        { 3000, LcdLeft,  0,   0,   0 },
+        { 3000, LcdRight, 0,   0,   0 },
+    };
+
+    Timeline::PlayStats stats = Timeline::play(expression);
+    for (int side = 0; side < 2; ++side) {
+        FrameArena::DisplayBuffers& eye = FrameArena::get((LcdSide)side);
+        draw_eye(eye.render, last_shown_us);
+        shown_frames[side].in_render = true;
+        shown_frames[side].rgb = true;
+    }
+    LOG_PRINT("👋 问候表情完成 - 实际运行" << (stats.duration_ms / 1000.0) << "秒"
+              << " 眼睛帧 " << stats.eye[LcdLeft].events << "/" << stats.eye[LcdRight].events
+              << " 丢帧 " << stats.eye[LcdLeft].dropped + stats.eye[LcdRight].dropped
+              << " 未变化 " << stats.eye[LcdLeft].unchanged + stats.eye[LcdRight].unchanged
+              << " 缓存 " << stats.eye[LcdLeft].cached + stats.eye[LcdRight].cached
+              << " 最大延迟 " << std::max(stats.eye[LcdLeft].max_late_ms, stats.eye[LcdRight].max_late_ms) << "ms"
+              << " 手臂延迟 " << stats.servo.max_late_ms << "ms"
+              << " 调度延迟 " << std::max(stats.eye[LcdLeft].max_wake_us, stats.eye[LcdRight].max_wake_us) << "us");
+
+    ServoPower::PowerStats power = ServoPower::getStats();
+    LOG_PRINT("🔋 手臂上电 " << power.power_on << " 次, 断电 " << power.power_off << " 次"
+              << " 预上电 " << power.prearmed << " 冷启动 " << power.cold_starts
+              << " 超预算 " << power.budget_misses
+              << " 通电时间 " << power.powered_ms[SERVO_LEFT] << "/" << power.powered_ms[SERVO_RIGHT] << "ms");
+}
+
+// 表情切换过渡：从屏幕正在显示的画面到下一个表情的第一帧
+static int transition_frames = TRANSITION_DEFAULT_FRAMES;
+const int TRANSITION_FRAME_MS = 40;
+static std::vector<uint8_t> transition_target[2];     // 下一个表情的24位画面，起始画面放在 scratch
+
+// 表情的第一帧（24位），左右眼可以不同，按左、右眼的顺序调用
+typedef void (*EyePose)(uint8_t* rgb, LcdSide side);
+
+// 开心：眼球正中、四角星高光
+void pose_happy(uint8_t* rgb, LcdSide) {
+    draw_cartoon_eye_24bit(rgb, 0, 0, COLOR_BLUE_IRIS, true, true);
+}
+
+// 静止：眼球正中
+void pose_idle(uint8_t* rgb, LcdSide) {
+    draw_cartoon_eye_24bit(rgb, 0, 0);
+}
+
+// 悲伤：泪滴在起始位置
+void pose_sad_start(uint8_t* rgb, LcdSide side) {
+    draw_sad_eye_24bit(rgb, side, SAD_TEAR_START_Y);
+}
+
+// 愤怒：第一个愤怒程度和眼球位置，火焰第0帧
+// 画火焰会更新粒子（左右眼各一次，和动画第一帧相同），所以这一帧只画一次：
+// 过渡结束时屏幕上就是它，animate_angry_face 从第二帧开始画
+static_assert(angry_shake_intensity(ANGER_LEVELS[0]) == 0, "愤怒第一帧没有震动，pose_angry_start 不画震动");
+void pose_angry_start(uint8_t* rgb, LcdSide) {
+    if (indexed_mode) {
+        // 调色板模式的第一帧是索引画面，按调色板展开
+        draw_angry_eye_enhanced<uint8_t>(rgb, ANGRY_EYE_MOVEMENTS[0][0], ANGRY_EYE_MOVEMENTS[0][1], ANGER_LEVELS[0], true, 0);
+        expand_indices_24bit(rgb);
+    } else {
+        draw_angry_eye_enhanced<Color>(rgb, ANGRY_EYE_MOVEMENTS[0][0], ANGRY_EYE_MOVEMENTS[0][1], ANGER_LEVELS[0], true, 0);
+    }
+    angry_first_frame_shown = true;
+}
+
+/**
+ * @brief 两个表情之间的过渡动画，淡入淡出、擦除或眨眼（复用眼皮遮罩）
+ */
+void play_transition(Transition::Kind kind, EyePose to,
+                     FrameArena::DisplayBuffers& left, FrameArena::DisplayBuffers& right) {
+    if (transition_frames <= 0) return;
+    FrameArena::DisplayBuffers* eyes[2] = { &left, &right };
+    for (int side = 0; side < 2; ++side) {
+        shown_frame_24bit(*eyes[side], eyes[side]->scratch);
+        to(transition_target[side].data(), (LcdSide)side);
+    }
+
+    auto next_frame = std::chrono::steady_clock::now();
+    for (int i = 1; i <= transition_frames; ++i) {
+        float progress = (float)i / transition_frames;
+        Transition::RowMask eyelid = {};
+        if (kind == Transition::IRIS_CLOSE) {
+            const EyelidMask& mask = eyelid_mask(blink_step(Transition::closure(progress)));
+            eyelid = { mask.first_row, mask.last_row, &mask.rows[0][0] };
+        }
+        for (int side = 0; side < 2; ++side) {
+            FrameArena::DisplayBuffers& eye = *eyes[side];
+            Transition::render<EyeDisplay>(kind, progress, eye.render, eye.scratch, transition_target[side].data(),
+                                           &eyelid, COLOR_YELLOW_EYELID);
+            write_eye_to_lcd(eye, true);
+        }
+        next_frame += std::chrono::milliseconds(TRANSITION_FRAME_MS);
+        std::this_thread::sleep_until(next_frame);
+    }
+    // 过渡写过屏幕，下一个表情的第一帧一定要渲染
+    FramePacer::invalidate(LcdLeft);
+    FramePacer::invalidate(LcdRight);
 }
 
 /**
  * @brief 主函数
  */
-int main() {
-    std::cout << "=== 眼睛动画系统启动 ===" << std::endl;
+int main(int argc, char* argv[]) {
+    // 命令行：--record 文件    录制所有LCD帧
+    //          --replay 文件 [--fast]  回放录制（原速度或最快速度）
+    //          --check 文件 参考文件  比较帧哈希
+    //          --rt [配置]  实时调度，例如 present=fifo:70@2,servo=fifo:80@2,render=other@3,lock=1
+    //          --fixed-rate  每帧都渲染（关闭静止帧跳过，用于比较CPU时间）
+    //          --overdraw  每像素平均写入次数（需要 -DRENDER_CORE_COUNT_WRITES）
+    //          --indexed  调色板模式：渲染1字节调色板索引，转换时查表展开
+    //          --cache-mb N  LCD格式帧缓存大小（MB），0 关闭
+    //          --bake 录制文件 剪辑文件 [--from ms] [--to ms] [--keyframe N]  把录制编译成剪辑，每N帧一个关键帧，0 不用差分
+    //          --bake-ppm 图片格式 帧率 剪辑文件  把PPM图片序列编译成剪辑，例如 blink_%03d.ppm
+    //          --play-clip 剪辑文件 [--loop] [--fast] [--stream]  播放剪辑（mmap，不渲染），--stream 由后台线程分块读取
+    //          --clip-stats 剪辑文件  压缩率和解码时间
+    //          --anger-steps N / --blink-steps N  愤怒程度和眨眼进度的档数，每档的瞳孔图像和眼皮只生成一次
+    //          --memo-kb N  这些局部图像最多占用的内存（KB）
+    //          --transition-frames N  表情切换的过渡帧数（40ms一帧），0 直接切换
+    //          --pack-atlas 图案文件 [图片目录]  把 .pam/.ppm 图片和内置图案打包成图案文件
+    //          --atlas 图案文件  使用打包的图案（mmap，不解码不转换）
+    const char* record_path = nullptr;
+    bool rt_enabled = false;
+    RtProfile::RtConfig rt_config = RtProfile::defaultConfig();
+    const char* replay_path = nullptr;
+    bool replay_fast = false;
+    int cache_mb = FRAME_CACHE_DEFAULT_MB;
+    const char* bake_recording = nullptr;
+    const char* bake_images = nullptr;
+    int bake_fps = 0;
+    const char* clip_path = nullptr;
+    uint32_t bake_from_ms = 0, bake_to_ms = 0;
+    bool play_loop = false;
+    bool play_stream = false;
+    uint32_t keyframe_interval = CLIP_KEYFRAME_INTERVAL;
+    const char* atlas_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--rt") == 0) {
+            rt_enabled = true;
+            if (i + 1 < argc && std::strncmp(argv[i + 1], "--", 2) != 0 &&
+                RtProfile::parse(argv[++i], &rt_config) != 0) {
+                std::cerr << "实时调度配置错误: " << argv[i] << std::endl;
+                return -1;
+            }
+        } else if (std::strcmp(argv[i], "--overdraw") == 0) {
+            return report_overdraw();
+        } else if (std::strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cache_mb = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--indexed") == 0) {
+            indexed_mode = true;
+        } else if (std::strcmp(argv[i], "--fixed-rate") == 0) {
+            FramePacer::setEnabled(false);
+        } else if (std::strcmp(argv[i], "--bake") == 0 && i + 2 < argc) {
+            bake_recording = argv[++i];
+            clip_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--bake-ppm") == 0 && i + 3 < argc) {
+            bake_images = argv[++i];
+            bake_fps = std::atoi(argv[++i]);
+            clip_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            bake_from_ms = (uint32_t)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            bake_to_ms = (uint32_t)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--play-clip") == 0 && i + 1 < argc) {
+            clip_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--anger-steps") == 0 && i + 1 < argc) {
+            int steps = std::max(1, std::atoi(argv[++i]));
+            pupil_images.setSteps(steps);
+            pupil_index_images.setSteps(steps);
+        } else if (std::strcmp(argv[i], "--blink-steps") == 0 && i + 1 < argc) {
+            eyelid_masks.setSteps(std::max(1, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--transition-frames") == 0 && i + 1 < argc) {
+            transition_frames = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--memo-kb") == 0 && i + 1 < argc) {
+            ParamMemo::setBudget((size_t)std::max(0, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--keyframe") == 0 && i + 1 < argc) {
+            keyframe_interval = (uint32_t)std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--pack-atlas") == 0 && i + 1 < argc) {
+            // 打包图案不需要LCD
+            const char* art_dir = (i + 2 < argc && std::strncmp(argv[i + 2], "--", 2) != 0) ? argv[i + 2] : nullptr;
+            return pack_atlas(argv[i + 1], art_dir);
+        } else if (std::strcmp(argv[i], "--atlas") == 0 && i + 1 < argc) {
+            atlas_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--clip-stats") == 0 && i + 1 < argc) {
+            return report_clip(argv[i + 1]);
+        } else if (std::strcmp(argv[i], "--stream") == 0) {
+            play_stream = true;
+        } else if (std::strcmp(argv[i], "--loop") == 0) {
+            play_loop = true;
+        } else if (std::strcmp(argv[i], "--fast") == 0) {
+            replay_fast = true;
+        } else if (std::strcmp(argv[i], "--check") == 0 && i + 2 < argc) {
+            FrameReplay::CheckResult result;
+            int8_t check_result = FrameReplay::check(argv[i + 1], argv[i + 2], &result);
+            if (check_result < 0) {
+                std::cerr << "无法打开录制文件!" << std::endl;
+                return -1;
+            }
+            std::cout << "比较帧数: " << result.frames << ", 不一致: " << result.mismatched
+                      << ", 第一个不一致帧: " << result.first_mismatch << ", 缺少帧: " << result.missing << std::endl;
+            return check_result;
+        }
+    }
+
+    // 录制编译成剪辑不需要LCD
+    if (bake_recording) {
+        Clip::WriterStats stats = {};
+        int32_t frames = Clip::bakeRecording(bake_recording, clip_path, bake_from_ms, bake_to_ms, &stats, keyframe_interval);
+        if (frames < 0) {
+            std::cerr << "剪辑编译失败: " << frames << std::endl;
+            return -1;
+        }
+        std::cout << "剪辑帧数: " << frames << ", 关键帧: " << frames - stats.deltas << " (不同 " << stats.unique << "), 差分帧: " << stats.deltas
+                  << ", 文件大小: " << stats.bytes / 1024 << " KB, 压缩率: " << stats.ratio << std::endl;
+        return 0;
+    }
+
+    LOG_PRINT("=== 眼睛动画系统启动 ===");
     
-    // 初始化随机数种子
-    std::srand(std::time(nullptr));
+    // 初始化随机数种子，录制时使用固定种子以便和参考录制比较
+    std::srand(record_path ? 1 : std::time(nullptr));
     
     // 初始化LCD
     int8_t init_result = LcdControl::init(LCD_12BIT);
     if (init_result != 0) {
-        std::cerr << "LCD初始化失败! 错误: " << (int)init_result << std::endl;
+        LOG_ERROR("LCD初始化失败! 错误: " << (int)init_result);
         return -1;
     }
     
@@ -776,59 +1577,228 @@ int main() {
     // 获取缓冲区信息
     int lcd_buffer_size = LcdControl::getBufferSize();
     if (lcd_buffer_size <= 0) {
-        std::cerr << "无效的LCD缓冲区大小: " << lcd_buffer_size << std::endl;
+        LOG_ERROR("无效的LCD缓冲区大小: " << lcd_buffer_size);
         LcdControl::release();
         return -1;
     }
     
-    std::cout << "LCD初始化成功!" << std::endl;
-    
-    // 创建缓冲区
-    std::vector<uint8_t> left_lcd_buffer(lcd_buffer_size);
-    std::vector<uint8_t> right_lcd_buffer(lcd_buffer_size);
-    
-    int temp_buffer_size = SCREEN_WIDTH * SCREEN_HEIGHT * 3; // 24位缓冲区
-    std::vector<uint8_t> temp_buffer_left(temp_buffer_size);
-    std::vector<uint8_t> temp_buffer_right(temp_buffer_size);
+    LOG_PRINT("LCD初始化成功!");
+
+    // 调色板展开只支持编译时特化的屏幕格式
+    if (indexed_mode && !EyeDisplay::matchesLcd()) {
+        LOG_PRINT("警告: 屏幕格式与编译时特化不一致，不使用调色板模式");
+        indexed_mode = false;
+    }
+    if (indexed_mode) {
+        init_eye_palette();
+        LOG_PRINT("调色板模式：每像素1字节调色板索引");
+    }
+
+    if (atlas_path && load_atlas(atlas_path) != 0) {
+        LcdControl::release();
+        return -1;
+    }
+
+    if (replay_path) {
+        int32_t frames = FrameReplay::replay(replay_path, !replay_fast);
+        LOG_PRINT("回放帧数: " << frames);
+        LcdControl::release();
+        return frames < 0 ? -1 : 0;
+    }
+    if (bake_images) {
+        Clip::WriterStats stats = {};
+        int32_t images = bake_fps > 0 ? Clip::bakeImages(bake_images, 0, 1000 / bake_fps, clip_path, &stats) : -1;
+        if (images < 0) LOG_ERROR("剪辑编译失败: " << images);
+        else LOG_PRINT("剪辑图片数: " << images << ", 关键帧: " << stats.frames - stats.deltas << " (不同 " << stats.unique << "), 差分帧: " << stats.deltas
+                       << ", 文件大小: " << stats.bytes / 1024 << " KB");
+        LcdControl::release();
+        return images < 0 ? -1 : 0;
+    }
+    if (clip_path && play_stream) {
+        // 后台线程预读剪辑到固定数量的缓冲区，播放线程不读文件
+        Clip::Stream stream;
+        int8_t open_result = stream.open(clip_path, play_loop);
+        if (open_result != 0) {
+            LOG_ERROR("无法打开剪辑: " << clip_path << " 错误: " << (int)open_result);
+            LcdControl::release();
+            return -1;
+        }
+        Clip::PlayStats stats = {};
+        int32_t frames = Clip::playStream(stream, !replay_fast, &stats);
+        Clip::StreamStats io = stream.getStats();
+        LOG_PRINT("剪辑播放帧数: " << frames << " 延迟帧 " << stats.late << " 最大延迟 " << stats.max_late_ms
+                  << "ms 解码 " << stats.avg_decode_us << "us/帧 写入 " << stats.avg_write_us << "us/帧");
+        LOG_PRINT("📀 读取 " << io.frames_read << " 帧 " << io.bytes_read / 1024 << " KB, " << io.avg_read_us
+                  << "us/帧, 欠载 " << io.underruns << " 次, 最长等待 " << io.max_stall_ms << "ms");
+        stream.close();
+        LcdControl::release();
+        return frames < 0 ? -1 : 0;
+    }
+    if (clip_path) {
+        // 剪辑帧直接从映射写入LCD，播放时不渲染也不转换
+        Clip::Reader clip;
+        int8_t open_result = clip.open(clip_path);
+        if (open_result != 0) {
+            LOG_ERROR("无法打开剪辑: " << clip_path << " 错误: " << (int)open_result);
+            LcdControl::release();
+            return -1;
+        }
+        int32_t frames;
+        do {
+            Clip::PlayStats stats = {};
+            frames = Clip::play(clip, !replay_fast, &stats);
+            LOG_PRINT("剪辑播放帧数: " << frames << " 延迟帧 " << stats.late << " 最大延迟 " << stats.max_late_ms
+                      << "ms 解码 " << stats.avg_decode_us << "us/帧 写入 " << stats.avg_write_us << "us/帧");
+        } while (play_loop && frames > 0);
+        LcdControl::release();
+        return frames < 0 ? -1 : 0;
+    }
+    if (record_path && FrameRecorder::start(record_path) != 0) {
+        LOG_ERROR("无法创建录制文件: " << record_path);
+    }
+
+    // 实时调度：在创建其他线程之前设置，主线程负责渲染
+    if (rt_enabled) {
+        if (RtProfile::init(rt_config) != 0) {
+            LOG_PRINT("警告: mlockall失败，内存未锁定");
+        }
+        RtProfile::enter(RT_RENDER);
+    }
+
+    // 手臂和LED（问候表情使用）
+    // 手臂空闲1秒后自动断电，20ms上电时间，30ms延迟预算
+    ServoPower::init(1000, 20000, 30000);
+    GPIO::init(Pwm_Led_Left_R);
+    GPIO::init(Pwm_Led_Left_G);
+    GPIO::init(Pwm_Led_Left_B);
+    GPIO::init(Pwm_Led_Right_R);
+    GPIO::init(Pwm_Led_Right_G);
+    GPIO::init(Pwm_Led_Right_B);
+    // 真机上使用 PwmShadow::init(GPIO::pwm_i2c_fd)
+    PwmShadow::init(GpioSim::busWrite, GpioSim::busRead);
+    ServoMotor::Init();
+    ServoMotor::setup(SERVO_LEFT, 500, 2500, SERVO_ARM_MAX_ANGLE, false);
+    ServoMotor::setup(SERVO_RIGHT, 500, 2500, SERVO_ARM_MAX_ANGLE, true);
     
-    LcdData frame_data_left = { LcdLeft, left_lcd_buffer.data() };
-    LcdData frame_data_right = { LcdRight, right_lcd_buffer.data() };
+    // 一次性分配所有帧缓冲区（页对齐、预先缺页、锁定内存）
+    int8_t arena_result = FrameArena::init(EyeDisplay::BUFFER_SIZE, lcd_buffer_size);
+    if (arena_result < 0) {
+        LOG_ERROR("帧缓冲区分配失败!");
+        ServoPower::release();
+        LcdControl::release();
+        return -1;
+    }
+    if (arena_result == 2) {
+        LOG_PRINT("警告: 帧缓冲区无法锁定内存 (RLIMIT_MEMLOCK)");
+    }
+    FrameArena::DisplayBuffers& left_eye = FrameArena::get(LcdLeft);
+    FrameArena::DisplayBuffers& right_eye = FrameArena::get(LcdRight);
+
+    // 过渡动画的目标画面，渲染循环中不再分配
+    transition_target[LcdLeft].resize(EyeDisplay::BUFFER_SIZE);
+    transition_target[LcdRight].resize(EyeDisplay::BUFFER_SIZE);
+
+    // 重复出现的帧（眼球位置、眨眼步骤）缓存为LCD格式，命中时直接写入
+    if (cache_mb > 0 && FrameCache::init((uint32_t)cache_mb, lcd_buffer_size) < 0) {
+        LOG_PRINT("警告: 帧缓存分配失败，不使用帧缓存");
+    }
+
+    // 条带渲染：驱动支持部分写入时启动条带传输线程
+    if (BandPipeline::init() != 0) {
+        LOG_PRINT("LCD不支持部分写入，条带渲染后整帧写入");
+    }
+
+    // 启动时检查实时调度是否生效
+    AsyncLog::flush();
+    if (rt_enabled && RtProfile::verify(stdout) != 0) {
+        LOG_PRINT("警告: 实时调度设置未完全生效（需要CAP_SYS_NICE或rtprio限制）");
+    }
     
     // 检查LCD状态
     if (!LcdControl::isActive()) {
-        std::cerr << "LCD未激活!" << std::endl;
+        LOG_ERROR("LCD未激活!");
+        BandPipeline::release();
+        ServoPower::release();
         LcdControl::release();
         return -1;
     }
     
-    std::cout << "开始眼睛动画..." << std::endl;
+    LOG_PRINT("开始眼睛动画...");
+    FramePacer::resetStats();
     
     // 主动画循环
     int animation_cycle = 0;
     while (true) {
-        std::cout << "\n--- 第 " << ++animation_cycle << " 轮动画 ---" << std::endl;
+        LOG_PRINT("\n--- 第 " << ++animation_cycle << " 轮动画 ---");
         
-        animate_happy_face(&frame_data_left, &frame_data_right, temp_buffer_left, temp_buffer_right);
+        animate_happy_face(left_eye, right_eye);
         std::this_thread::sleep_for(std::chrono::seconds(2));
+        play_transition(Transition::CROSS_FADE, pose_idle, left_eye, right_eye);
         
-        animate_idle_blink(&frame_data_left, &frame_data_right, temp_buffer_left, temp_buffer_right);
+        animate_idle_blink(left_eye, right_eye);
         std::this_thread::sleep_for(std::chrono::seconds(1));
+        play_transition(Transition::IRIS_CLOSE, pose_sad_start, left_eye, right_eye);
         
-        animate_sad_face(&frame_data_left, &frame_data_right, temp_buffer_left, temp_buffer_right);
+        animate_sad_face(left_eye, right_eye);
         std::this_thread::sleep_for(std::chrono::seconds(2));
+        play_transition(Transition::WIPE, pose_angry_start, left_eye, right_eye);
         
-        animate_angry_face(&frame_data_left, &frame_data_right, temp_buffer_left, temp_buffer_right);
+        animate_angry_face(left_eye, right_eye);
         std::this_thread::sleep_for(std::chrono::seconds(2));
+        play_transition(Transition::CROSS_FADE, pose_happy, left_eye, right_eye);
+
+        play_greeting_timeline();
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        play_transition(Transition::IRIS_CLOSE, pose_happy, left_eye, right_eye);
+
+        // 静止帧跳过的效果：渲染/跳过帧数和每分钟CPU时间
+        FramePacer::PacerStats pacer = FramePacer::getStats();
+        LOG_PRINT("⏱ 渲染帧 " << pacer.rendered << " 跳过 " << pacer.skipped << " 保活 " << pacer.keepalive
+                  << " CPU " << pacer.cpu_ms_per_min << "ms/分钟");
+        if (FrameCache::isActive()) {
+            FrameCache::CacheStats cache = FrameCache::getStats();
+            LOG_PRINT("🗃 帧缓存 命中 " << cache.hits << " 未命中 " << cache.misses << " 命中率 " << cache.hit_rate * 100.0f
+                      << "% 帧 " << cache.entries << "/" << cache.capacity << " 内存 " << cache.used_bytes / 1024 << "/"
+                      << cache.budget_bytes / 1024 << " KB 淘汰 " << cache.evictions);
+        }
+        Transition::TransitionStats transition = Transition::getStats();
+        LOG_PRINT("🎬 过渡帧 " << transition.frames << " 平均 " << transition.avg_us << "us 最大 " << transition.max_us
+                  << "us，占帧时间 " << transition.avg_us * 100.0f / (TRANSITION_FRAME_MS * 1000) << "%");
+        ParamMemo::MemoStats memo = ParamMemo::getStats();
+        LOG_PRINT("🧩 局部图像 " << memo.entries << " 个 " << memo.bytes / 1024 << "/" << memo.budget_bytes / 1024
+                  << " KB 复用 " << memo.hits << " 生成 " << memo.misses << " 超出预算 " << memo.refused);
         
         // 可以添加退出条件
         if (animation_cycle >= 3) {
-            std::cout << "演示完成！退出程序..." << std::endl;
+            LOG_PRINT("演示完成！退出程序...");
             break;
         }
     }
     
     // 清理资源
+    if (FrameRecorder::isRecording()) {
+        FrameRecorder::stop();
+        FrameRecorder::RecordStats rec = FrameRecorder::getStats();
+        LOG_PRINT("录制帧数: " << rec.frames << " (重复 " << rec.repeats << "), 文件大小: "
+                  << rec.bytes / 1024 << " KB");
+    }
+    if (rt_enabled) {
+        AsyncLog::flush();
+        RtProfile::verify(stdout);
+        for (int role = RT_PRESENT; role <= RT_SERVO; ++role) {
+            RtProfile::LatencyStats lat = RtProfile::getLatency((RtRole)role);
+            LOG_PRINT("调度延迟 " << RtProfile::role_names[role] << ": 平均 " << lat.avg_us << "us 最大 "
+                      << lat.max_us << "us 超预算 " << lat.over_budget << "/" << lat.samples);
+        }
+    }
+    BandPipeline::BandStats bands = BandPipeline::getStats();
+    LOG_PRINT("条带渲染帧数 " << bands.frames << " 提前传输条带 " << bands.early_strips << "/" << bands.strips
+              << " 部分写入 " << bands.windows << " 次 渲染 " << bands.avg_render_us << "us 每帧 " << bands.avg_frame_us << "us");
+    BandPipeline::release();
+    FrameCache::release();
+    ServoPower::release();
+    FrameArena::release();
     LcdControl::release();
-    std::cout << "动画系统关闭完成。" << std::endl;
+    LOG_PRINT("动画系统关闭完成。");
     return 0;
 }
\ No newline at end of file
@@ -1,7 +1,34 @@
-#include "ServoMotor.h"
-#include "Gpio.h"
+// #include "ServoMotor.h"
+// #include "Gpio.h"
+#include "../Doly/include/Gpio_x86_sim.h"
+#include "../Doly/include/ServoMotor_x86_sim.h"
+#include "../Doly/include/GpioEventLoop.h"
+#include <stdio.h>
 #include <thread>
 
+// input line of the stop button (simulated line on x86)
+#define STOP_BUTTON_LINE 5
+
+// called from GpioEventLoop::dispatch() on the main thread
+static void onStopButton(const GpioEvent& event)
+{
+	if (!event.rising) return;
+	printf("stop button, arms stopped at left %.1f right %.1f\n", ServoSim::getAngle(SERVO_LEFT), ServoSim::getAngle(SERVO_RIGHT));
+	ServoMotor::stop(SERVO_LEFT);
+	ServoMotor::stop(SERVO_RIGHT);
+}
+
+// wait 'ms' while handling button events
+static void waitWithInput(int ms)
+{
+	auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+	while (std::chrono::steady_clock::now() < end)
+	{
+		GpioEventLoop::dispatch();
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
 /// <summary>
 /// This program demonstrates how to setup and control servos,
 /// Also this program requires pthread, ServoMotor, Gpio, Timer libraries
@@ -22,6 +49,14 @@ int main()
 	ServoMotor::setup(SERVO_LEFT, 500, 2500, SERVO_ARM_MAX_ANGLE, false);
 	ServoMotor::setup(SERVO_RIGHT, 500, 2500, SERVO_ARM_MAX_ANGLE, true);
 
+	// Stop button: edges are read by the event loop thread, debounced (20ms) and handled in waitWithInput
+	int button_fd = GpioEventLoop::requestEventFd("/dev/gpiochip0", STOP_BUTTON_LINE);
+	if (button_fd < 0 || GpioEventLoop::addPin(STOP_BUTTON_LINE, button_fd, 20000, onStopButton) != 0 ||
+		GpioEventLoop::start() != 0)
+	{
+		printf("stop button not available\n");
+	}
+
 	// Sets servo zero positions
 	// The 'speed' paramater range between 1-100
 	ServoMotor::set(SERVO_LEFT, 0, 100);
@@ -36,18 +71,35 @@ int main()
 	ServoMotor::set(SERVO_LEFT, 90, 1);
 	ServoMotor::set(SERVO_RIGHT, 90, 1);
 
-	// wait
-	std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+	// simulated press of the stop button during the slow move, with contact bounce
+	std::thread press([]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+		GpioSim::injectEdge(STOP_BUTTON_LINE, true, 0, 3);
+	});
+
+	// wait, the stop button ends the move early
+	waitWithInput(5000);
+	press.join();
 
 	ServoMotor::set(SERVO_LEFT, SERVO_ARM_MAX_ANGLE, 100);
 	ServoMotor::set(SERVO_RIGHT, SERVO_ARM_MAX_ANGLE, 100);
 
 	// wait servo
-	std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+	waitWithInput(3000);
+
+	GpioEventLoop::stop();
+	GpioEventLoop::removePin(STOP_BUTTON_LINE);
+	close(button_fd);
+	GpioEventLoop::LoopStats input = GpioEventLoop::getStats();
+	printf("button edges %llu, bounces dropped %llu\n", (unsigned long long)input.events_read, (unsigned long long)input.bounced);
 
 	// disable servo power
 	GPIO::writePin(Pin_Servo_Left_Enable, LOW);
 	GPIO::writePin(Pin_Servo_Right_Enable, LOW);
 
+	// simulated horn position and every command sent to the hardware
+	printf("left %.1f right %.1f\n", ServoSim::getAngle(SERVO_LEFT), ServoSim::getAngle(SERVO_RIGHT));
+	GpioSim::dumpLog(stdout);
+
 	return 0;
 }
\ No newline at end of file